@@ -1,27 +1,59 @@
 #include "AsyncChunkSource.h"
 
+#include "globals.h"
+#include "Profiler.h"
+
+namespace {
+	auto labeled(const char* name, const char* source) -> std::string {
+		return std::string{name} + "{source=\"" + source + "\"}";
+	}
+}
+
+AsyncChunkSource::AsyncChunkSource(const char* source)
+	: m_requests(Metrics::counter(labeled("dpg_chunk_requests_total", source), "Chunks requested from a source"))
+	, m_pending(Metrics::gauge(labeled("dpg_chunks_pending", source), "Requested chunks which are still generating or loading"))
+	, m_ready(Metrics::gauge(labeled("dpg_chunks_ready", source), "Chunks which finished loading and wait to be taken and uploaded"))
+	, m_latency(Metrics::histogram(labeled("dpg_chunk_latency_seconds", source), "Seconds from requesting a chunk until it is taken")) {}
+
 auto AsyncChunkSource::get(const glm::ivec3& chunkPos) -> std::optional<Chunk> {
 	// try to find in loaded chunks
 	const auto it = loadedChunks.find(chunkPos);
 	if (it != loadedChunks.end()) {
-		auto& f = it->second;
+		auto& f = it->second.chunk;
 		if (f.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+			m_latency.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - it->second.start).count());
 			Chunk c = f.get();
 			loadedChunks.erase(it);
 
 			// init chunk before returning it
-			c.createBuffers();
+			if (!global::headless)
+				c.createBuffers();
 			return c;
 		}
 	} else {
-		loadedChunks[chunkPos] = std::async(std::launch::async, [=] {
-			return getChunk(chunkPos);
-		});
+		loadedChunks[chunkPos] = {load(chunkPos), std::chrono::steady_clock::now()};
+		m_requests.add();
 	}
 
 	return {};
 }
 
+auto AsyncChunkSource::load(const glm::ivec3& chunkPos) -> std::future<Chunk> {
+	return std::async(std::launch::async, [=] {
+		Profiler::setThreadName("chunk source");
+		return getChunk(chunkPos);
+	});
+}
+
 void AsyncChunkSource::clear() {
 	loadedChunks.clear();
 }
+
+void AsyncChunkSource::updateMetrics() {
+	int64_t ready = 0;
+	for (const auto& [chunkPos, request] : loadedChunks)
+		if (request.chunk.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+			ready++;
+	m_ready.set(ready);
+	m_pending.set(static_cast<int64_t>(loadedChunks.size()) - ready);
+}
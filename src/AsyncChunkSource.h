@@ -1,23 +1,48 @@
 #pragma once
 
+#include <chrono>
 #include <future>
 #include <optional>
-#include <unordered_map>
 
 #include "Chunk.h"
+#include "MemoryTracker.h"
+#include "Metrics.h"
 
 class AsyncChunkSource {
 public:
-	AsyncChunkSource() = default;
+	/**
+	* The source labels the metrics of the chunks it provides, e.g. dpg_chunks_pending{source="disk"}.
+	*/
+	explicit AsyncChunkSource(const char* source);
 	virtual ~AsyncChunkSource() = default;
 
 	auto get(const glm::ivec3& chunkPos) -> std::optional<Chunk>;
 
 	void clear();
 
+	/**
+	* Counts the requested chunks which are still loading and those which are ready but not taken by get() yet.
+	*/
+	void updateMetrics();
+
 protected:
 	virtual auto getChunk(const glm::ivec3& chunkPos) -> Chunk = 0;
 
+	/**
+	* Starts loading a chunk. By default getChunk runs in a thread of its own.
+	*/
+	virtual auto load(const glm::ivec3& chunkPos) -> std::future<Chunk>;
+
 private:
-	std::unordered_map<glm::ivec3, std::future<Chunk>> loadedChunks;
+	struct Request {
+		std::future<Chunk> chunk;
+		std::chrono::steady_clock::time_point start;
+	};
+
+	TrackedMap<glm::ivec3, Request, MemoryTag::CHUNK_MAPS> loadedChunks;
+
+	Counter& m_requests;
+	Gauge& m_pending;
+	Gauge& m_ready;
+	Histogram& m_latency;
 };
@@ -0,0 +1,90 @@
+#include "CameraPath.h"
+
+#include <cstdint>
+#include <iomanip>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include "IO.h"
+
+namespace {
+	const auto magic = std::string{"dpg-camera-path"};
+	constexpr auto version = 1;
+}
+
+void CameraPath::record(double interval, const Camera& camera) {
+	m_samples.push_back({interval, camera.position, camera.pitch, camera.yaw});
+}
+
+auto CameraPath::apply(std::size_t frame, Camera& camera) const -> double {
+	const auto& s = m_samples.at(frame);
+	camera.position = s.position;
+	camera.pitch = s.pitch;
+	camera.yaw = s.yaw;
+	return s.interval;
+}
+
+auto CameraPath::samples() const -> const std::vector<CameraSample>& {
+	return m_samples;
+}
+
+auto CameraPath::size() const -> std::size_t {
+	return m_samples.size();
+}
+
+auto CameraPath::empty() const -> bool {
+	return m_samples.empty();
+}
+
+auto CameraPath::seconds() const -> double {
+	double total = 0;
+	for (const auto& s : m_samples)
+		total += s.interval;
+	return total;
+}
+
+void CameraPath::clear() {
+	m_samples.clear();
+}
+
+void CameraPath::save(const std::filesystem::path& path) const {
+	auto file = openFileOut(path);
+	file << magic << ' ' << version << '\n'
+		 << "radius " << chunkRadius << '\n'
+		 << "frames " << m_samples.size() << '\n';
+	for (const auto& s : m_samples) {
+		file << std::setprecision(std::numeric_limits<double>::max_digits10) << s.interval << std::setprecision(std::numeric_limits<float>::max_digits10);
+		for (const auto v : {s.position.x, s.position.y, s.position.z, s.pitch, s.yaw})
+			file << ' ' << v;
+		file << '\n';
+	}
+	file.close();
+	if (!file)
+		throw std::runtime_error("could not write " + path.string());
+}
+
+auto CameraPath::load(const std::filesystem::path& path) -> CameraPath {
+	auto file = openFileIn(path);
+	std::string word;
+	int fileVersion = 0;
+	if (!(file >> word >> fileVersion) || word != magic || fileVersion != version)
+		throw std::runtime_error(path.string() + " is not a camera path of version " + std::to_string(version));
+
+	CameraPath p;
+	std::size_t frames = 0;
+	if (!(file >> word >> p.chunkRadius) || word != "radius" || !(file >> word >> frames) || word != "frames")
+		throw std::runtime_error("invalid header in camera path " + path.string());
+
+	// each frame has 6 numbers of at least one digit preceded by whitespace, so a corrupt count is found before allocating for it
+	const auto position = file.tellg();
+	const auto remaining = position < 0 ? std::uintmax_t{0} : std::filesystem::file_size(path) - static_cast<std::uintmax_t>(position);
+	if (frames > remaining / 12)
+		throw std::runtime_error("camera path " + path.string() + " is too short for " + std::to_string(frames) + " frames");
+
+	p.m_samples.resize(frames);
+	for (auto& s : p.m_samples)
+		if (!(file >> s.interval >> s.position.x >> s.position.y >> s.position.z >> s.pitch >> s.yaw))
+			throw std::runtime_error("camera path " + path.string() + " ends before frame " + std::to_string(&s - p.m_samples.data()) + " of " + std::to_string(frames));
+	return p;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <cstddef>
+#include <filesystem>
+#include <vector>
+
+#include "Camera.h"
+
+struct CameraSample {
+	double interval; // seconds since the previous frame
+	glm::vec3 position;
+	float pitch;
+	float yaw;
+};
+
+/**
+* The camera of each frame of a session, so the same flight through the world can be replayed, in the window or headless.
+* Replaying sets the camera directly, so it does not depend on input, physics or the frame rate of the replay.
+* Stored as text, one frame per line, with enough digits to restore every float exactly.
+*/
+class CameraPath final {
+public:
+	void record(double interval, const Camera& camera);
+
+	/**
+	* Moves the camera to the given frame and returns the interval recorded for it.
+	*/
+	auto apply(std::size_t frame, Camera& camera) const -> double;
+
+	auto samples() const -> const std::vector<CameraSample>&;
+	auto size() const -> std::size_t;
+	auto empty() const -> bool;
+	auto seconds() const -> double;
+	void clear();
+
+	int chunkRadius = 0; // the render radius while recording, replays should use the same
+
+	/**
+	* Throws std::runtime_error if the file cannot be written or read or is not a camera path.
+	*/
+	void save(const std::filesystem::path& path) const;
+	static auto load(const std::filesystem::path& path) -> CameraPath;
+
+private:
+	std::vector<CameraSample> m_samples;
+};
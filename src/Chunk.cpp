@@ -2,10 +2,14 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <chrono>
 #include <iostream>
 #include <unordered_map>
 
 #include "globals.h"
+#include "Metrics.h"
+#include "Profiler.h"
+#include "simd.h"
 #include "tables.inc"
 
 using namespace std;
@@ -13,6 +17,9 @@ using namespace std;
 namespace {
 	constexpr auto initialTriangleMapSize = 3000;
 
+	auto& uploadSeconds = Metrics::histogram("dpg_chunk_upload_seconds", "Seconds to upload the mesh of a chunk to the GPU");
+	auto& uploadBytes = Metrics::counter("dpg_chunk_upload_bytes_total", "Bytes of chunk meshes uploaded to the GPU");
+
 	void drawBoxEdges(BoundingBox box) {
 		const auto edges = boxEdges(box);
 
@@ -23,23 +30,101 @@ namespace {
 		glEnd();
 	}
 
-	glm::vec3 gradient(Chunk& c, glm::ivec3 v) {
-		glm::vec3 grad;
-		grad.x = c.densityAt(v + glm::ivec3{1, 0, 0}) - c.densityAt(v - glm::ivec3{1, 0, 0});
-		grad.y = c.densityAt(v + glm::ivec3{0, 1, 0}) - c.densityAt(v - glm::ivec3{0, 1, 0});
-		grad.z = c.densityAt(v + glm::ivec3{0, 0, 1}) - c.densityAt(v - glm::ivec3{0, 0, 1});
-		return normalize(grad);
+	// The densities of the chunk decoded into a buffer of the calling thread, for passes reading every sample several times.
+	auto decodeDensities(const DensityGrid& grid) -> const float* {
+		thread_local TrackedVector<float, MemoryTag::MESHER_SCRATCH> values;
+		values.resize(grid.size());
+		grid.decode(0, grid.size(), values.data());
+		return values.data();
+	}
+
+	template <typename DensityAt>
+	auto cubeAt(glm::ivec3 localIndex, DensityAt&& densityAt) -> std::array<Chunk::DensityType, 8> {
+		std::array<Chunk::DensityType, 8> values;
+		values[0] = densityAt(localIndex + glm::ivec3{0, 0, 0});
+		values[1] = densityAt(localIndex + glm::ivec3{0, 0, 1});
+		values[2] = densityAt(localIndex + glm::ivec3{1, 0, 1});
+		values[3] = densityAt(localIndex + glm::ivec3{1, 0, 0});
+		values[4] = densityAt(localIndex + glm::ivec3{0, 1, 0});
+		values[5] = densityAt(localIndex + glm::ivec3{0, 1, 1});
+		values[6] = densityAt(localIndex + glm::ivec3{1, 1, 1});
+		values[7] = densityAt(localIndex + glm::ivec3{1, 1, 0});
+		return values;
+	}
+
+	// The samples 0 to chunkResolution of each axis, the corners of all voxels of the chunk.
+	constexpr auto cornerSamples = chunkResolution + 1;
+
+	/**
+	* The normalized central difference gradients at the corners of all voxels, computed once per chunk into a buffer of the calling thread.
+	* The x, y and z components are stored in three consecutive planes of cornerSamples^3 floats.
+	* Densities clamped by the storage format can leave no gradient, these corners get a zero vector.
+	*/
+	auto gradientGrid(const float* densities) -> const float* {
+		constexpr auto planeSize = cornerSamples * cornerSamples * cornerSamples;
+		thread_local TrackedVector<float, MemoryTag::MESHER_SCRATCH> grid;
+		grid.resize(3 * planeSize);
+		auto* gx = grid.data();
+		auto* gy = gx + planeSize;
+		auto* gz = gy + planeSize;
+
+		for (auto z = 0; z < cornerSamples; z++) {
+			for (auto y = 0; y < cornerSamples; y++) {
+				const auto row = [&](int dy, int dz) { return densities + Chunk::densityIndex({0, y + dy, z + dz}); };
+				const auto* center = row(0, 0);
+				const auto* below = row(-1, 0);
+				const auto* above = row(1, 0);
+				const auto* behind = row(0, -1);
+				const auto* front = row(0, 1);
+				const auto offset = (z * cornerSamples + y) * cornerSamples;
+
+				auto x = 0;
+#ifdef DPG_SSE2
+				const auto zero = _mm_setzero_ps();
+				const auto one = _mm_set1_ps(1.0f);
+				for (; x + 4 <= cornerSamples; x += 4) {
+					const auto dx = _mm_sub_ps(_mm_loadu_ps(center + x + 1), _mm_loadu_ps(center + x - 1));
+					const auto dy = _mm_sub_ps(_mm_loadu_ps(above + x), _mm_loadu_ps(below + x));
+					const auto dz = _mm_sub_ps(_mm_loadu_ps(front + x), _mm_loadu_ps(behind + x));
+					const auto length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+					const auto scale = _mm_and_ps(_mm_div_ps(one, _mm_sqrt_ps(length2)), _mm_cmpgt_ps(length2, zero));
+					_mm_storeu_ps(gx + offset + x, _mm_mul_ps(dx, scale));
+					_mm_storeu_ps(gy + offset + x, _mm_mul_ps(dy, scale));
+					_mm_storeu_ps(gz + offset + x, _mm_mul_ps(dz, scale));
+				}
+#endif
+				for (; x < cornerSamples; x++) {
+					const glm::vec3 grad{center[x + 1] - center[x - 1], above[x] - below[x], front[x] - behind[x]};
+					const auto normalized = grad == glm::vec3{0} ? grad : normalize(grad);
+					gx[offset + x] = normalized.x;
+					gy[offset + x] = normalized.y;
+					gz[offset + x] = normalized.z;
+				}
+			}
+		}
+		return grid.data();
+	}
+
+	auto gradientAt(const float* grid, glm::ivec3 v) -> glm::vec3 {
+		constexpr auto planeSize = cornerSamples * cornerSamples * cornerSamples;
+		const auto i = (v.z * cornerSamples + v.y) * cornerSamples + v.x;
+		return {grid[i], grid[planeSize + i], grid[2 * planeSize + i]};
 	}
 }
 
 IdType ChunkGridCoordinateToId(glm::ivec3 index) {
 	constexpr uint32_t mask = 0x001FFFFF; // 21 bit
+	assert(index.x >= -(1 << 20) && index.x < (1 << 20));
+	assert(index.y >= -(1 << 20) && index.y < (1 << 20));
+	assert(index.z >= -(1 << 20) && index.z < (1 << 20));
 	return (((IdType)(index.x & mask)) << 42) | (((IdType)(index.y & mask)) << 21) | (((IdType)(index.z & mask)) << 0);
 }
 
 glm::ivec3 IdToChunkGridCoordinate(IdType id) {
-	uint32_t mask = 0x001FFFFF; // 21 bit
-	return glm::ivec3((id >> 42) & mask, (id >> 21) & mask, (id >> 0) & mask);
+	constexpr uint32_t mask = 0x001FFFFF; // 21 bit
+	// sign extend the 21 bit coordinates
+	const auto coordinate = [&](int shift) { return static_cast<int32_t>(static_cast<uint32_t>((id >> shift) & mask) << 11) >> 11; };
+	return glm::ivec3(coordinate(42), coordinate(21), coordinate(0));
 }
 
 Chunk::Chunk(IdType id)
@@ -56,9 +141,9 @@ glm::vec3 Chunk::toWorld(glm::vec3 voxel) const {
 
 glm::ivec3 Chunk::toVoxelCoord(const glm::vec3& v) const {
 	glm::vec3 rel = v - lower();
-	assert(rel.x >= 0 && rel.x < 16);
-	assert(rel.y >= 0 && rel.y < 16);
-	assert(rel.z >= 0 && rel.z < 16);
+	assert(rel.x >= 0 && rel.x < chunkResolution);
+	assert(rel.y >= 0 && rel.y < chunkResolution);
+	assert(rel.z >= 0 && rel.z < chunkResolution);
 	return glm::ivec3{rel};
 	}
 
@@ -83,93 +168,308 @@ Chunk::VoxelType Chunk::categorizeVoxel(glm::ivec3 pos) const {
 	assert(pos.y >= 0 && pos.y < chunkResolution);
 	assert(pos.z >= 0 && pos.z < chunkResolution);
 
-	const auto caseIndex = caseIndexFromVoxel(densityCubeAt(pos));
+	const auto caseIndex = caseIndices.empty()
+		? caseIndexFromVoxel(densityCubeAt(pos))
+		: caseIndices[(pos.z * chunkResolution + pos.y) * chunkResolution + pos.x];
 
 	if (caseIndex == 255) return VoxelType::SOLID;
 	if (caseIndex == 0) return VoxelType::AIR;
 	return VoxelType::SURFACE;
 }
 
+void Chunk::mesh(Mesher mesher) {
+	switch (mesher) {
+		case Mesher::MARCHING_CUBES: march(); break;
+		case Mesher::SURFACE_NETS: surfaceNets(); break;
+	}
+}
+
 void Chunk::march() {
+	PROFILE_SCOPE("Chunk::march");
 	vertices.clear();
 	triangles.clear();
-
-	std::unordered_map<glm::vec3, unsigned int> vertexMap(initialTriangleMapSize);
-
-	glm::ivec3 bi;
-	for (bi.x = 0; bi.x < chunkResolution; bi.x++) {
-		for (bi.y = 0; bi.y < chunkResolution; bi.y++) {
-			for (bi.z = 0; bi.z < chunkResolution; bi.z++) {
-				const std::array<Chunk::DensityType, 8> values = densityCubeAt(bi);
-
-				const auto caseIndex = caseIndexFromVoxel(values);
-				if (caseIndex == 255)
-					continue; // solid voxel
-				if (caseIndex == 0)
-					continue; // air voxel
-
-				const int numTriangles = case_to_numpolys[caseIndex];
-
-				// for each triangle of the cube
-				for (int t = 0; t < numTriangles; t++) {
-					glm::ivec3 tri;
-
-					// for each edge of the cube a triangle vertex is on
-					for (int e = 0; e < 3; e++) {
-						const int edgeIndex = edge_connect_list[caseIndex][t][e];
-
-						const auto [value1, value2, vec1, vec2] = [&]() -> std::tuple<Chunk::DensityType, Chunk::DensityType, glm::ivec3, glm::ivec3> {
-							switch (edgeIndex) {
-								case 0: return {values[0], values[1], bi + glm::ivec3(0, 0, 0), bi + glm::ivec3(0, 0, 1)};
-								case 1: return {values[1], values[2], bi + glm::ivec3(0, 0, 1), bi + glm::ivec3(1, 0, 1)};
-								case 2: return {values[2], values[3], bi + glm::ivec3(1, 0, 1), bi + glm::ivec3(1, 0, 0)};
-								case 3: return {values[3], values[0], bi + glm::ivec3(1, 0, 0), bi + glm::ivec3(0, 0, 0)};
-								case 4: return {values[4], values[5], bi + glm::ivec3(0, 1, 0), bi + glm::ivec3(0, 1, 1)};
-								case 5: return {values[5], values[6], bi + glm::ivec3(0, 1, 1), bi + glm::ivec3(1, 1, 1)};
-								case 6: return {values[6], values[7], bi + glm::ivec3(1, 1, 1), bi + glm::ivec3(1, 1, 0)};
-								case 7: return {values[7], values[4], bi + glm::ivec3(1, 1, 0), bi + glm::ivec3(0, 1, 0)};
-								case 8: return {values[0], values[4], bi + glm::ivec3(0, 0, 0), bi + glm::ivec3(0, 1, 0)};
-								case 9: return {values[1], values[5], bi + glm::ivec3(0, 0, 1), bi + glm::ivec3(0, 1, 1)};
-								case 10: return {values[2], values[6], bi + glm::ivec3(1, 0, 1), bi + glm::ivec3(1, 1, 1)};
-								case 11: return {values[3], values[7], bi + glm::ivec3(1, 0, 0), bi + glm::ivec3(1, 1, 0)};
-								default: std::terminate();
-							}
-						}();
-
-						const glm::vec3 vertex = interpolate(value1, value2, glm::vec3(vec1), glm::vec3(vec2));
-
-						// lookup this vertex
-						if (auto it = vertexMap.find(vertex); it != vertexMap.end())
-							tri[e] = it->second;
-						else {
-							// calculate a new one
-							RVertex v;
-							v.position = toWorld(vertex);
-
-							// the gradient points towards higher densities (it points into the solidness), therefore invert the normal
-							const glm::vec3 g1 = gradient(*this, vec1);
-							const glm::vec3 g2 = gradient(*this, vec2);
-							v.normal = -normalize(interpolate(value1, value2, g1, g2));
-
-							tri[e] = (unsigned int)vertices.size();
-							vertices.push_back(v);
-
-							vertexMap[v.position] = tri[e];
-						}
+	mesher = Mesher::MARCHING_CUBES;
+
+	TrackedMap<glm::vec3, unsigned int, MemoryTag::MESHER_SCRATCH> vertexMap(initialTriangleMapSize);
+
+	const auto decoded = decodeDensities(densities);
+	const auto decodedAt = [&](glm::ivec3 i) { return decoded[densityIndex(i)]; };
+	classifyVoxels(decoded);
+	const auto gradients = gradientGrid(decoded);
+
+	for (const auto voxel : surfaceVoxels) {
+		const auto bi = glm::ivec3{voxel % chunkResolution, voxel / chunkResolution % chunkResolution, voxel / (chunkResolution * chunkResolution)};
+		const std::array<Chunk::DensityType, 8> values = cubeAt(bi, decodedAt);
+		const auto caseIndex = caseIndices[voxel];
+
+		const int numTriangles = case_to_numpolys[caseIndex];
+
+		// for each triangle of the cube
+		for (int t = 0; t < numTriangles; t++) {
+			glm::ivec3 tri;
+
+			// for each edge of the cube a triangle vertex is on
+			for (int e = 0; e < 3; e++) {
+				const int edgeIndex = edge_connect_list[caseIndex][t][e];
+
+				const auto [value1, value2, vec1, vec2] = [&]() -> std::tuple<Chunk::DensityType, Chunk::DensityType, glm::ivec3, glm::ivec3> {
+					switch (edgeIndex) {
+						case 0: return {values[0], values[1], bi + glm::ivec3(0, 0, 0), bi + glm::ivec3(0, 0, 1)};
+						case 1: return {values[1], values[2], bi + glm::ivec3(0, 0, 1), bi + glm::ivec3(1, 0, 1)};
+						case 2: return {values[2], values[3], bi + glm::ivec3(1, 0, 1), bi + glm::ivec3(1, 0, 0)};
+						case 3: return {values[3], values[0], bi + glm::ivec3(1, 0, 0), bi + glm::ivec3(0, 0, 0)};
+						case 4: return {values[4], values[5], bi + glm::ivec3(0, 1, 0), bi + glm::ivec3(0, 1, 1)};
+						case 5: return {values[5], values[6], bi + glm::ivec3(0, 1, 1), bi + glm::ivec3(1, 1, 1)};
+						case 6: return {values[6], values[7], bi + glm::ivec3(1, 1, 1), bi + glm::ivec3(1, 1, 0)};
+						case 7: return {values[7], values[4], bi + glm::ivec3(1, 1, 0), bi + glm::ivec3(0, 1, 0)};
+						case 8: return {values[0], values[4], bi + glm::ivec3(0, 0, 0), bi + glm::ivec3(0, 1, 0)};
+						case 9: return {values[1], values[5], bi + glm::ivec3(0, 0, 1), bi + glm::ivec3(0, 1, 1)};
+						case 10: return {values[2], values[6], bi + glm::ivec3(1, 0, 1), bi + glm::ivec3(1, 1, 1)};
+						case 11: return {values[3], values[7], bi + glm::ivec3(1, 0, 0), bi + glm::ivec3(1, 1, 0)};
+						default: std::terminate();
 					}
+				}();
+
+				const glm::vec3 vertex = interpolate(value1, value2, glm::vec3(vec1), glm::vec3(vec2));
+
+				// lookup this vertex
+				if (auto it = vertexMap.find(vertex); it != vertexMap.end())
+					tri[e] = it->second;
+				else {
+					// calculate a new one
+					RVertex v;
+					v.position = toWorld(vertex);
+
+					// the gradient points towards higher densities (it points into the solidness), therefore invert the normal
+					const glm::vec3 g1 = gradientAt(gradients, vec1);
+					const glm::vec3 g2 = gradientAt(gradients, vec2);
+					auto g = interpolate(value1, value2, g1, g2);
+					if (g == glm::vec3{0})
+						g = glm::vec3(vec2 - vec1) * (value2 - value1); // fall back to the gradient along the edge
+					v.normal = -normalize(g);
+
+					tri[e] = (unsigned int)vertices.size();
+					vertices.push_back(v);
+
+					vertexMap[vertex] = tri[e];
+				}
+			}
+
+			// reorient triangles
+			std::swap(tri[1], tri[2]);
+
+			triangles.push_back(tri);
+		}
+	}
+
+	computeConnectivity();
+}
+
+void Chunk::surfaceNets() {
+	PROFILE_SCOPE("Chunk::surfaceNets");
+	vertices.clear();
+	triangles.clear();
+	mesher = Mesher::SURFACE_NETS;
+
+	const auto decoded = decodeDensities(densities);
+	const auto decodedAt = [&](glm::ivec3 i) { return decoded[densityIndex(i)]; };
+
+	// corners in the order of cubeAt and the cube edges between them, as in marching cubes
+	const glm::ivec3 corners[8] = {{0, 0, 0}, {0, 0, 1}, {1, 0, 1}, {1, 0, 0}, {0, 1, 0}, {0, 1, 1}, {1, 1, 1}, {1, 1, 0}};
+	constexpr int edges[12][2] = {{0, 1}, {1, 2}, {2, 3}, {3, 0}, {4, 5}, {5, 6}, {6, 7}, {7, 4}, {0, 4}, {1, 5}, {2, 6}, {3, 7}};
+
+	// the cells from -1 to chunkResolution - 1, which the quads of the edges owned by this chunk connect
+	constexpr auto cells = chunkResolution + 1;
+	thread_local TrackedVector<int, MemoryTag::MESHER_SCRATCH> cellVertex;
+	cellVertex.assign(cells * cells * cells, -1);
+
+	// the vertex of a cell the surface passes through, created on first use
+	const auto vertexOf = [&](glm::ivec3 c) {
+		auto& index = cellVertex[((c.z + 1) * cells + c.y + 1) * cells + c.x + 1];
+		if (index != -1)
+			return static_cast<unsigned int>(index);
+
+		const auto values = cubeAt(c, decodedAt);
+		glm::vec3 sum{0};
+		glm::vec3 grad{0};
+		int crossings = 0;
+		for (const auto& [a, b] : edges) {
+			// the gradient from the differences along the cell's edges, which needs no samples outside the cell
+			const auto axis = corners[a].x != corners[b].x ? 0 : corners[a].y != corners[b].y ? 1 : 2;
+			grad[axis] += corners[b][axis] > corners[a][axis] ? values[b] - values[a] : values[a] - values[b];
+
+			if ((values[a] > 0) != (values[b] > 0)) {
+				sum += interpolate(values[a], values[b], glm::vec3(corners[a]), glm::vec3(corners[b]));
+				crossings++;
+			}
+		}
 
-					// reorient triangles
-					std::swap(tri[1], tri[2]);
+		RVertex v;
+		v.position = toWorld(glm::vec3(c) + sum / static_cast<float>(crossings));
+		// the gradient points towards higher densities (it points into the solidness), therefore invert the normal
+		v.normal = grad == glm::vec3{0} ? glm::vec3{0, 0, 1} : -normalize(grad);
+		index = static_cast<int>(vertices.size());
+		vertices.push_back(v);
+		return static_cast<unsigned int>(index);
+	};
+
+	// each edge belongs to the chunk owning its first sample
+	glm::ivec3 p;
+	for (p.z = 0; p.z < chunkResolution; p.z++) {
+		for (p.y = 0; p.y < chunkResolution; p.y++) {
+			for (p.x = 0; p.x < chunkResolution; p.x++) {
+				const auto solid = decodedAt(p) > 0;
+				for (auto axis = 0; axis < 3; axis++) {
+					glm::ivec3 e{0};
+					e[axis] = 1;
+					if ((decodedAt(p + e) > 0) == solid)
+						continue;
 
-					triangles.push_back(tri);
+					// the four cells around the edge, counter clockwise around the axis
+					glm::ivec3 u{0}, v{0};
+					u[(axis + 1) % 3] = 1;
+					v[(axis + 2) % 3] = 1;
+					auto a = vertexOf(p - u - v);
+					const auto b = vertexOf(p - v);
+					auto c = vertexOf(p);
+					const auto d = vertexOf(p - u);
+
+					// wind like the marching cubes triangles
+					if (!solid)
+						std::swap(a, c);
+					triangles.push_back({a, b, c});
+					triangles.push_back({a, c, d});
 				}
 			}
 		}
 	}
+
+	computeConnectivity();
+}
+
+void Chunk::classifyVoxels() {
+	classifyVoxels(decodeDensities(densities));
+}
+
+void Chunk::classifyVoxels(const float* decoded) {
+	constexpr auto sampleCount = chunkSamples * chunkSamples * chunkSamples;
+
+	// one byte per sample, 1 where solid
+	thread_local TrackedVector<uint8_t, MemoryTag::MESHER_SCRATCH> signs;
+	signs.resize(sampleCount + 16);
+	std::size_t i = 0;
+#ifdef DPG_SSE2
+	const auto zero = _mm_setzero_ps();
+	const auto one = _mm_set1_epi8(1);
+	for (; i + 16 <= sampleCount; i += 16) {
+		const auto a = _mm_castps_si128(_mm_cmpgt_ps(_mm_loadu_ps(decoded + i + 0), zero));
+		const auto b = _mm_castps_si128(_mm_cmpgt_ps(_mm_loadu_ps(decoded + i + 4), zero));
+		const auto c = _mm_castps_si128(_mm_cmpgt_ps(_mm_loadu_ps(decoded + i + 8), zero));
+		const auto d = _mm_castps_si128(_mm_cmpgt_ps(_mm_loadu_ps(decoded + i + 12), zero));
+		const auto bytes = _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(signs.data() + i), _mm_and_si128(bytes, one));
+	}
+#endif
+	for (; i < sampleCount; i++)
+		signs[i] = decoded[i] > 0;
+
+	// The case index of a voxel ORs the signs of its corners, shifted to their bit in the order of cubeAt.
+	// A row of voxels along x reads the rows of signs at its four combinations of y and z, at x and x + 1.
+	caseIndices.resize(chunkResolution * chunkResolution * chunkResolution);
+	for (auto z = 0; z < chunkResolution; z++) {
+		for (auto y = 0; y < chunkResolution; y++) {
+			const auto row = [&](int dy, int dz) { return signs.data() + densityIndex({0, y + dy, z + dz}); };
+			const uint8_t* rows[8] = {row(0, 0), row(0, 1), row(0, 1) + 1, row(0, 0) + 1, row(1, 0), row(1, 1), row(1, 1) + 1, row(1, 0) + 1};
+			auto* cases = caseIndices.data() + (z * chunkResolution + y) * chunkResolution;
+
+			auto x = 0;
+#ifdef DPG_SSE2
+			for (; x + 16 <= chunkResolution; x += 16) {
+				// the signs are 0 or 1, so shifting 16 bit lanes never moves a bit into the neighboring byte
+				auto caseIndex = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[0] + x));
+				caseIndex = _mm_or_si128(caseIndex, _mm_slli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[1] + x)), 1));
+				caseIndex = _mm_or_si128(caseIndex, _mm_slli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[2] + x)), 2));
+				caseIndex = _mm_or_si128(caseIndex, _mm_slli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[3] + x)), 3));
+				caseIndex = _mm_or_si128(caseIndex, _mm_slli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[4] + x)), 4));
+				caseIndex = _mm_or_si128(caseIndex, _mm_slli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[5] + x)), 5));
+				caseIndex = _mm_or_si128(caseIndex, _mm_slli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[6] + x)), 6));
+				caseIndex = _mm_or_si128(caseIndex, _mm_slli_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(rows[7] + x)), 7));
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(cases + x), caseIndex);
+			}
+#endif
+			for (; x < chunkResolution; x++) {
+				uint8_t caseIndex = 0;
+				for (auto corner = 0; corner < 8; corner++)
+					caseIndex |= rows[corner][x] << corner;
+				cases[x] = caseIndex;
+			}
+		}
+	}
+
+	surfaceVoxels.clear();
+	for (uint32_t voxel = 0; voxel < caseIndices.size(); voxel++)
+		if (caseIndices[voxel] != 0 && caseIndices[voxel] != 255)
+			surfaceVoxels.push_back(voxel);
+}
+
+void Chunk::computeConnectivity() {
+	// flood fill over the density samples from 0 to chunkResolution, which span the chunk
+	constexpr auto side = chunkResolution + 1;
+	TrackedVector<bool, MemoryTag::MESHER_SCRATCH> visited(side * side * side);
+	TrackedVector<glm::ivec3, MemoryTag::MESHER_SCRATCH> stack;
+
+	faceConnectivity = {};
+
+	const auto decoded = decodeDensities(densities);
+	const auto solid = [&](glm::ivec3 i) { return decoded[densityIndex(i)] > 0; };
+
+	glm::ivec3 seed;
+	for (seed.z = 0; seed.z < side; seed.z++) {
+		for (seed.y = 0; seed.y < side; seed.y++) {
+			for (seed.x = 0; seed.x < side; seed.x++) {
+				const auto seedIndex = (seed.z * side + seed.y) * side + seed.x;
+				if (visited[seedIndex] || solid(seed))
+					continue;
+
+				// collect the faces touched by this air region
+				uint8_t faces = 0;
+				visited[seedIndex] = true;
+				stack.push_back(seed);
+				while (!stack.empty()) {
+					const auto p = stack.back();
+					stack.pop_back();
+
+					for (auto axis = 0; axis < 3; axis++) {
+						if (p[axis] == 0) faces |= 1 << (axis * 2);
+						if (p[axis] == side - 1) faces |= 1 << (axis * 2 + 1);
+						for (const auto step : {-1, 1}) {
+							auto n = p;
+							n[axis] += step;
+							if (n[axis] < 0 || n[axis] >= side)
+								continue;
+							const auto index = (n.z * side + n.y) * side + n.x;
+							if (visited[index] || solid(n))
+								continue;
+							visited[index] = true;
+							stack.push_back(n);
+						}
+					}
+				}
+
+				for (auto f = 0; f < 6; f++)
+					if (faces & (1 << f))
+						faceConnectivity[f] |= faces;
+			}
+		}
+	}
+}
+
+auto Chunk::facesConnected(int a, int b) const -> bool {
+	return (faceConnectivity[a] >> b) & 1;
 }
 
 void Chunk::render() const {
-	if (global::showTriangles) {
+	if (global::showTriangles && vertexBuffer) {
 		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer.value().id());
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer.value().id());
 
@@ -249,48 +549,58 @@ void Chunk::renderAuxiliary() const {
 }
 
 ChunkMemoryFootprint Chunk::getMemoryFootprint() const {
-	const unsigned int size = chunkResolution + 1 + 2; // + 1 for corners and + 2 for marging
-
-	ChunkMemoryFootprint mem{};
-	mem.densityValues = size * size * size;
-	mem.densityValueSize = sizeof(DensityType);
-	mem.triangles = triangles.size();
-	mem.triangleSize = sizeof(Triangle);
+	ChunkMemoryFootprint mem;
+	mem.densityBytes = densities.heapBytes();
+	mem.vertexBytes = vertices.heapBytes();
+	mem.triangleBytes = triangles.heapBytes();
+	mem.voxelCaseBytes = caseIndices.capacity() * sizeof(caseIndices[0]) + surfaceVoxels.capacity() * sizeof(surfaceVoxels[0]);
+	mem.viewedBytes = densities.viewedBytes() + vertices.viewedBytes() + triangles.viewedBytes();
+	mem.gpuBytes = (vertexBuffer ? vertexBuffer->size() : 0) + (indexBuffer ? indexBuffer->size() : 0);
 	return mem;
 }
 
 void Chunk::createBuffers() {
+	PROFILE_SCOPE("Chunk::upload");
+
+	// chunks without surface, mostly air and solid rock, draw nothing and need no buffers
+	if (triangles.empty()) {
+		vertexBuffer.reset();
+		indexBuffer.reset();
+		return;
+	}
+
+	const auto start = std::chrono::steady_clock::now();
 	vertexBuffer.emplace();
-	glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer.value().id());
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertices[0]), vertices.data(), GL_STATIC_DRAW);
+	vertexBuffer->setData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertices[0]), vertices.data(), GL_STATIC_DRAW);
 
 	indexBuffer.emplace();
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer.value().id());
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, triangles.size() * sizeof(triangles[0]), triangles.data(), GL_STATIC_DRAW);
+	indexBuffer->setData(GL_ELEMENT_ARRAY_BUFFER, triangles.size() * sizeof(triangles[0]), triangles.data(), GL_STATIC_DRAW);
+	uploadSeconds.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+	uploadBytes.add(vertices.size() * sizeof(vertices[0]) + triangles.size() * sizeof(triangles[0]));
 }
 
-float Chunk::densityAt(glm::ivec3 localIndex) const {
+auto Chunk::densityIndex(glm::ivec3 localIndex) -> std::size_t {
 	// -1 and chunkResolution access border densities from neighboring chunks
 	assert(localIndex.x >= -1 && localIndex.x <= chunkResolution + 1);
 	assert(localIndex.y >= -1 && localIndex.y <= chunkResolution + 1);
 	assert(localIndex.z >= -1 && localIndex.z <= chunkResolution + 1);
 	localIndex += 1;
 
-	constexpr auto side = chunkResolution + 1 + 2;
-	return densities[localIndex.z * side * side + localIndex.y * side + localIndex.x];
+	return (localIndex.z * chunkSamples + localIndex.y) * chunkSamples + localIndex.x;
+}
+
+float Chunk::densityAt(glm::ivec3 localIndex) const {
+	return densities.get(densityIndex(localIndex));
+}
+
+void Chunk::setDensityAt(glm::ivec3 localIndex, DensityType value) {
+	densities.set(densityIndex(localIndex), value);
+	caseIndices.clear();
+	surfaceVoxels.clear();
 }
 
 std::array<Chunk::DensityType, 8> Chunk::densityCubeAt(glm::ivec3 localIndex) const {
-	std::array<DensityType, 8> values;
-	values[0] = densityAt(localIndex + glm::ivec3{0, 0, 0});
-	values[1] = densityAt(localIndex + glm::ivec3{0, 0, 1});
-	values[2] = densityAt(localIndex + glm::ivec3{1, 0, 1});
-	values[3] = densityAt(localIndex + glm::ivec3{1, 0, 0});
-	values[4] = densityAt(localIndex + glm::ivec3{0, 1, 0});
-	values[5] = densityAt(localIndex + glm::ivec3{0, 1, 1});
-	values[6] = densityAt(localIndex + glm::ivec3{1, 1, 1});
-	values[7] = densityAt(localIndex + glm::ivec3{1, 1, 0});
-	return values;
+	return cubeAt(localIndex, [&](glm::ivec3 i) { return densityAt(i); });
 }
 
 unsigned int Chunk::caseIndexFromVoxel(std::array<DensityType, 8> values) const {
@@ -5,39 +5,70 @@
 #include <stdint.h>
 #include <vector>
 
+#include "DensityGrid.h"
+#include "MappedVector.h"
+#include "MemoryTracker.h"
 #include "geometry.h"
 #include "mathlib.h"
 #include "opengl/Buffer.h"
 
+/**
+* The memory used by chunks, measured from their containers and buffers. Heap bytes are the capacity allocated by the chunks,
+* viewed bytes are read from mapped files or buffers shared between chunks and counted once per chunk viewing them.
+*/
 struct ChunkMemoryFootprint final {
-	size_t densityValues;
-	size_t densityValueSize;
-	size_t triangles;
-	size_t triangleSize;
-
-	const size_t densityBytes() const {
-		return densityValues * densityValueSize;
-	}
-
-	const size_t triangleBytes() const {
-		return triangles * triangleSize;
+	std::size_t densityBytes = 0;
+	std::size_t vertexBytes = 0;
+	std::size_t triangleBytes = 0;
+	std::size_t voxelCaseBytes = 0;
+	std::size_t viewedBytes = 0;
+	std::size_t gpuBytes = 0;
+
+	auto heapBytes() const -> std::size_t {
+		return densityBytes + vertexBytes + triangleBytes + voxelCaseBytes;
 	}
 
-	const size_t totalBytes() const {
-		return densityBytes() + triangleBytes();
+	auto operator+=(const ChunkMemoryFootprint& other) -> ChunkMemoryFootprint& {
+		densityBytes += other.densityBytes;
+		vertexBytes += other.vertexBytes;
+		triangleBytes += other.triangleBytes;
+		voxelCaseBytes += other.voxelCaseBytes;
+		viewedBytes += other.viewedBytes;
+		gpuBytes += other.gpuBytes;
+		return *this;
 	}
 };
 
-inline constexpr auto chunkResolution = 16;
+#ifndef DPG_CHUNK_RESOLUTION
+#define DPG_CHUNK_RESOLUTION 16
+#endif
+
+/**
+* Voxels along each axis of a chunk, set at build time with the CMake cache variable DPG_CHUNK_RESOLUTION.
+*/
+inline constexpr auto chunkResolution = DPG_CHUNK_RESOLUTION;
+static_assert(chunkResolution >= 4 && chunkResolution % 4 == 0, "chunkResolution must be a multiple of 4");
+
+/**
+* Density samples along each axis of a chunk: + 1 for the corners of the last voxels and + 2 for the margin needed by the normals.
+*/
+inline constexpr auto chunkSamples = chunkResolution + 1 + 2;
 
 using IdType = uint64_t;
 
 IdType ChunkGridCoordinateToId(glm::ivec3 chunkGridCoord);
 glm::ivec3 IdToChunkGridCoordinate(IdType id);
 
+enum class Mesher {
+	MARCHING_CUBES,
+	SURFACE_NETS
+};
+
 class Chunk final {
 public:
 	using DensityType = float;
+	using Vertices = MappedVector<RVertex, TrackingAllocator<RVertex, MemoryTag::VERTICES>>;
+	using Triangles = MappedVector<glm::uvec3, TrackingAllocator<glm::uvec3, MemoryTag::TRIANGLES>>;
 
 	enum class VoxelType {
 		SOLID,
@@ -70,8 +101,29 @@ public:
 	VoxelType categorizeWorldPosition(const glm::vec3& pos) const;
 	VoxelType categorizeVoxel(glm::ivec3 pos) const;
 
+	/**
+	* Builds vertices and triangles from the densities with the given mesher.
+	*/
+	void mesh(Mesher mesher);
 	void march();
 
+	/**
+	* Naive surface nets: one vertex per cell the surface passes through, at the mean of the cell's edge crossings,
+	* and one quad per surface crossing edge, connecting the vertices of the four cells sharing the edge.
+	*/
+	void surfaceNets();
+
+	/**
+	* Computes the caseIndices of all voxels and the list of surface voxels. Called by march().
+	*/
+	void classifyVoxels();
+
+	/**
+	* Flood fills the air of the chunk to find which of its faces are connected. Called by the meshers.
+	*/
+	void computeConnectivity();
+	auto facesConnected(int a, int b) const -> bool;
+
 	/**
 	* Renders the chunk.
 	*/
@@ -89,6 +141,7 @@ public:
 	ChunkMemoryFootprint getMemoryFootprint() const;
 
 	DensityType densityAt(glm::ivec3 localIndex) const;
+	void setDensityAt(glm::ivec3 localIndex, DensityType value);
 	std::array<DensityType, 8> densityCubeAt(glm::ivec3 localIndex) const;
 	unsigned int caseIndexFromVoxel(std::array<DensityType, 8> values) const;
 
@@ -96,11 +149,41 @@ public:
 	auto voxelAabb(glm::ivec3 localIndex) const -> BoundingBox;
 	auto fullTriangles() const -> std::vector<Triangle>;
 
-	std::vector<DensityType> densities;
-	std::vector<glm::uvec3> triangles;
-	std::vector<RVertex> vertices;
+	static auto densityIndex(glm::ivec3 localIndex) -> std::size_t;
+
+	/**
+	* The density samples from -1 to chunkResolution + 1 in each dimension, see densityIndex().
+	*/
+	DensityGrid densities;
+	Triangles triangles;
+	Vertices vertices;
+
+	/**
+	* Bit b of faceConnectivity[a] is set if faces a and b of the chunk are connected through air.
+	* Faces are ordered -x, +x, -y, +y, -z, +z.
+	*/
+	std::array<uint8_t, 6> faceConnectivity{};
+
+	/**
+	* The marching cubes case index of each voxel, x fastest, and the indices of the voxels the surface passes through.
+	* Empty if not computed since the densities last changed, categorizeVoxel then computes the case from the densities.
+	*/
+	TrackedVector<uint8_t, MemoryTag::VOXEL_CASES> caseIndices;
+	TrackedVector<uint32_t, MemoryTag::VOXEL_CASES> surfaceVoxels;
+
+	/**
+	* Set when the densities were changed after generation.
+	*/
+	bool edited = false;
+
+	/**
+	* The mesher which built the vertices and triangles.
+	*/
+	Mesher mesher = Mesher::MARCHING_CUBES;
 
 private:
+	void classifyVoxels(const float* decoded);
+
 	IdType id{};
 	glm::ivec3 index;
 
@@ -1,48 +1,303 @@
-//#include <noise/noise.h>
-
 #define STB_PERLIN_IMPLEMENTATION
 #include <stb_perlin.h>
 
 #include <glm/glm.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <list>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <unordered_map>
 
 #include "ChunkCreator.h"
 #include "globals.h"
+#include "Profiler.h"
 #include "mathlib.h"
+#include "Metrics.h"
+#include "utils.h"
 
-auto ChunkCreator::getChunk(const glm::ivec3& chunkPos) -> Chunk {
-	Chunk c(chunkPos);
+namespace {
+	// edge length of the world aligned bricks of samples which are bounded separately
+	constexpr auto brickSize = 4;
+
+	// samples by which the bricks are extended when bounding them. If the surface stays this far away, the central differences
+	// for the normals of all surface vertices only read evaluated samples.
+	constexpr auto brickMargin = 2;
 
-	//noise::module::Perlin perlin;
-	//perlin.SetOctaveCount(5);
-	//perlin.SetFrequency(0.3);
+	static_assert(chunkResolution % brickSize == 0, "bricks must tile the samples owned by a chunk");
 
-	auto noise = [](glm::vec3 pos) {
-		//pos /= chunkResolution;
+	constexpr auto blockCacheCapacity = std::max<std::size_t>(64, (16 << 20) / (chunkResolution * chunkResolution * chunkResolution * sizeof(float))); // about 16 MiB, 1024 blocks at the default resolution
 
-		return -pos.z + 0.5f + pos.x * 0.1f;
-		// return (Chunk::DensityType)perlin.GetValue(pos.x, pos.y, pos.z);
-		//return stb_perlin_fbm_noise3(pos.x, pos.y, pos.z, 2.0f, 0.5f, global::noise::octaves);
-		//return stb_perlin_turbulence_noise3(pos.x, pos.y, pos.z, 2.0f, 0.5f, global::noise::octaves, 0, 0, 0);
+	/**
+	* The samples owned by a chunk, which may be generated in parts by the chunk and its neighbours.
+	*/
+	struct Block {
+		static constexpr auto samples = chunkResolution * chunkResolution * chunkResolution;
+
+		std::mutex mutex;
+		std::vector<float> densities = std::vector<float>(samples);
+		std::vector<bool> sampled = std::vector<bool>(samples);
 	};
 
-	const unsigned int size = chunkResolution + 1 + 2; // + 1 for corners and + 2 for marging
-	c.densities.resize(size * size * size);
+	std::shared_ptr<const DensityGraph> activeGraph = std::make_shared<const DensityGraph>(DensityGraph::defaultGraph());
+
+	auto& generationSeconds = Metrics::histogram("dpg_chunk_generation_seconds", "Seconds to generate and mesh a chunk");
+	auto& chunksWithoutSurface = Metrics::counter("dpg_chunks_without_surface_total", "Generated chunks entirely solid or air, which were neither sampled nor meshed");
+
+	/**
+	* The blocks of recently generated chunks and their neighbours, so each sample is evaluated only once
+	* while neighbouring chunks fill their margins and the owner generates its block.
+	* Blocks are evicted least recently used first. The cache empties itself when the density graph or the use of density bounds changes.
+	*/
+	class BlockCache {
+	public:
+		auto get(const glm::ivec3& pos, const std::shared_ptr<const DensityGraph>& graph, bool bounds) -> std::shared_ptr<Block> {
+			std::lock_guard lock{mutex};
+			if (graph != blockGraph || bounds != blockBounds) {
+				blocks.clear();
+				lru.clear();
+				blockGraph = graph;
+				blockBounds = bounds;
+			}
+
+			if (const auto it = blocks.find(pos); it != blocks.end()) {
+				lru.splice(lru.begin(), lru, it->second.second);
+				return it->second.first;
+			}
+
+			auto block = std::make_shared<Block>();
+			lru.push_front(pos);
+			blocks[pos] = {block, lru.begin()};
+			if (blocks.size() > blockCacheCapacity) {
+				blocks.erase(lru.back());
+				lru.pop_back();
+			}
+			return block;
+		}
+
+	private:
+		std::mutex mutex;
+		std::shared_ptr<const DensityGraph> blockGraph;
+		bool blockBounds = false;
+		std::list<glm::ivec3> lru;
+		std::unordered_map<glm::ivec3, std::pair<std::shared_ptr<Block>, std::list<glm::ivec3>::iterator>> blocks;
+	} blockCache;
 
-	for (unsigned int x = 0; x < size; x++) {
-		for (unsigned int y = 0; y < size; y++) {
-			for (unsigned int z = 0; z < size; z++) {
-				glm::vec3 world = c.toWorld(glm::vec3{x, y, z} - glm::vec3{1});
-				c.densities[z * size * size + y * size + x] = noise(world);
+	/**
+	* The encoded densities of chunks without surface by format and value. Chunks filled with the same value view one buffer
+	* until they are edited, so pure air and solid rock need no density memory of their own.
+	* Buffers are released with the last chunk viewing them.
+	*/
+	class UniformGrids {
+	public:
+		auto get(DensityFormat format, std::size_t count, float value) -> DensityGrid {
+			uint32_t valueBits;
+			std::memcpy(&valueBits, &value, sizeof(valueBits));
+			const auto key = (uint64_t{static_cast<uint8_t>(format)} << 32) | valueBits;
+
+			std::lock_guard lock{mutex};
+			auto& entry = grids[key];
+			auto bytes = entry.lock();
+			if (!bytes || bytes->size() != count * formatSize(format)) {
+				DensityGrid grid{format};
+				grid.resize(count);
+				grid.fill(value);
+				bytes = std::make_shared<const std::vector<uint8_t>>(grid.bytes(), grid.bytes() + grid.byteSize());
+				entry = bytes;
+				if (grids.size() >= pruneSize) {
+					for (auto it = grids.begin(); it != grids.end();)
+						it = it->second.expired() ? grids.erase(it) : std::next(it);
+					pruneSize = std::max<std::size_t>(64, grids.size() * 2);
+				}
 			}
+			return DensityGrid::fromEncoded(format, {bytes, bytes->data(), bytes->size()});
 		}
+
+	private:
+		std::mutex mutex;
+		std::unordered_map<uint64_t, std::weak_ptr<const std::vector<uint8_t>>> grids;
+		std::size_t pruneSize = 64;
+	} uniformGrids;
+
+	// A value with the sign of all densities between the sample positions from and to, if the surface provably does not pass between them.
+	// The bound closest to zero is used, so edits on the filled region behave close to the real densities.
+	auto uniformValue(const DensityGraph& graph, glm::ivec3 from, glm::ivec3 to) -> std::optional<float> {
+		const auto bounds = graph.bounds({glm::vec3{from}, glm::vec3{to}});
+		if (bounds.lower > 0)
+			return bounds.lower;
+		if (bounds.upper <= 0)
+			return bounds.upper;
+		return {};
 	}
 
-	//cout << "Noise took " << timer.interval << " seconds" << endl;
+	/**
+	* Generates the samples of the block with local indices from (inclusive) to (exclusive) which were not sampled before.
+	* Samples in world aligned bricks which are provably solid or air get a constant per brick.
+	* Every sample therefore has the same value, regardless of which chunk generates it.
+	*/
+	void sampleBlock(const DensityGraph& graph, bool bounds, glm::ivec3 blockLower, glm::ivec3 from, glm::ivec3 to, Block& block, GenerationStats& stats) {
+		thread_local std::vector<float> xs, ys, zs, values;
+		thread_local std::vector<unsigned int> indices;
+		xs.clear();
+		ys.clear();
+		zs.clear();
+		indices.clear();
+
+		const auto index = [](glm::ivec3 l) {
+			return (l.z * chunkResolution + l.y) * chunkResolution + l.x;
+		};
+
+		glm::ivec3 brick;
+		for (brick.z = from.z / brickSize; brick.z * brickSize < to.z; brick.z++) {
+			for (brick.y = from.y / brickSize; brick.y * brickSize < to.y; brick.y++) {
+				for (brick.x = from.x / brickSize; brick.x * brickSize < to.x; brick.x++) {
+					const auto lower = glm::max(brick * brickSize, from);
+					const auto upper = glm::min(brick * brickSize + brickSize, to);
+
+					bool missing = false;
+					glm::ivec3 l;
+					for (l.z = lower.z; l.z < upper.z && !missing; l.z++)
+						for (l.y = lower.y; l.y < upper.y && !missing; l.y++)
+							for (l.x = lower.x; l.x < upper.x && !missing; l.x++)
+								missing = !block.sampled[index(l)];
+					if (!missing) {
+						stats.samplesReused += (upper.x - lower.x) * (upper.y - lower.y) * (upper.z - lower.z);
+						continue;
+					}
 
-	c.march();
+					const auto brickLower = blockLower + brick * brickSize;
+					const auto value = bounds ? uniformValue(graph, brickLower - brickMargin, brickLower + (brickSize - 1 + brickMargin)) : std::nullopt;
+					for (l.z = lower.z; l.z < upper.z; l.z++) {
+						for (l.y = lower.y; l.y < upper.y; l.y++) {
+							for (l.x = lower.x; l.x < upper.x; l.x++) {
+								const auto i = index(l);
+								if (block.sampled[i])
+									stats.samplesReused++;
+								else if (value) {
+									block.densities[i] = *value;
+									block.sampled[i] = true;
+									stats.samplesSkipped++;
+								} else {
+									indices.push_back(i);
+									xs.push_back(static_cast<float>(blockLower.x + l.x));
+									ys.push_back(static_cast<float>(blockLower.y + l.y));
+									zs.push_back(static_cast<float>(blockLower.z + l.z));
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+
+		values.resize(indices.size());
+		graph.evaluate(xs.data(), ys.data(), zs.data(), values.data(), values.size());
+		for (std::size_t i = 0; i < indices.size(); i++) {
+			block.densities[indices[i]] = values[i];
+			block.sampled[indices[i]] = true;
+		}
+		stats.samplesEvaluated += indices.size();
+	}
+}
+
+ChunkCreator::ChunkCreator()
+	: AsyncChunkSource("generator") {}
+
+void ChunkCreator::setDensityGraph(DensityGraph graph) {
+	std::atomic_store(&activeGraph, std::make_shared<const DensityGraph>(std::move(graph)));
+}
+
+auto ChunkCreator::densityGraph() -> std::shared_ptr<const DensityGraph> {
+	return std::atomic_load(&activeGraph);
+}
+
+auto ChunkCreator::baselineHash() -> uint64_t {
+	const uint64_t words[] = {densityGraph()->fingerprint(), static_cast<uint64_t>(global::densityFormat), global::densityBounds, chunkResolution};
+	return hashBytes(words, sizeof(words));
+}
+
+auto ChunkCreator::generateDensities(Chunk& c) -> GenerationStats {
+	PROFILE_SCOPE("ChunkCreator::generateDensities");
+	const int size = chunkSamples;
+	const auto count = static_cast<std::size_t>(size * size * size);
+	c.densities = DensityGrid{static_cast<DensityFormat>(global::densityFormat)};
+	c.densities.resize(count);
+
+	const auto graph = densityGraph();
+	const auto bounds = global::densityBounds;
+	const auto chunkLower = glm::ivec3{c.lower()};
+
+	GenerationStats stats{};
+	stats.chunks = 1;
+
+	if (bounds) {
+		if (const auto value = uniformValue(*graph, chunkLower - 1, chunkLower + (size - 2))) {
+			c.densities = uniformGrids.get(c.densities.format(), count, *value);
+			stats.chunksSkipped = 1;
+			stats.samplesSkipped = count;
+			return stats;
+		}
+	}
+
+	// The chunk owns the samples 0 to chunkResolution - 1 of its grid, the margin at -1, chunkResolution and chunkResolution + 1 belongs to its neighbours.
+	// Each part of the grid is generated into the block of its owner, which keeps it for the owner and the owner's other neighbours.
+	thread_local std::vector<float> grid;
+	grid.resize(count);
+	glm::ivec3 d;
+	for (d.z = -1; d.z <= 1; d.z++) {
+		for (d.y = -1; d.y <= 1; d.y++) {
+			for (d.x = -1; d.x <= 1; d.x++) {
+				// part of the grid in local indices of the owner
+				glm::ivec3 from, to;
+				for (auto axis = 0; axis < 3; axis++) {
+					from[axis] = d[axis] < 0 ? chunkResolution - 1 : 0;
+					to[axis] = d[axis] > 0 ? 2 : chunkResolution;
+				}
+
+				const auto ownerLower = chunkLower + d * chunkResolution;
+				const auto block = blockCache.get(c.chunkIndex() + d, graph, bounds);
+				std::lock_guard lock{block->mutex};
+				sampleBlock(*graph, bounds, ownerLower, from, to, *block, stats);
+
+				const auto gridFrom = ownerLower + from - chunkLower + 1;
+				glm::ivec3 l;
+				for (l.z = from.z; l.z < to.z; l.z++) {
+					for (l.y = from.y; l.y < to.y; l.y++) {
+						const auto src = block->densities.data() + (l.z * chunkResolution + l.y) * chunkResolution + from.x;
+						const auto dst = grid.data() + ((gridFrom.z + l.z - from.z) * size + gridFrom.y + l.y - from.y) * size + gridFrom.x;
+						std::copy_n(src, to.x - from.x, dst);
+					}
+				}
+			}
+		}
+	}
+
+	c.densities.assign(grid.data(), count);
+	return stats;
+}
+
+auto ChunkCreator::createChunk(const glm::ivec3& chunkPos, Mesher mesher, GenerationStats* stats) -> Chunk {
+	PROFILE_SCOPE("ChunkCreator::createChunk");
+	const auto start = std::chrono::steady_clock::now();
+	Chunk c(chunkPos);
+	const auto generation = generateDensities(c);
+	if (stats)
+		*stats = generation;
+
+	if (generation.chunksSkipped > 0) {
+		// no surface, only the visibility through the chunk is needed
+		c.faceConnectivity.fill(c.densities.get(0) > 0 ? 0 : 0x3F);
+		chunksWithoutSurface.add();
+		generationSeconds.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+		return c;
+	}
+
+	c.mesh(mesher);
+	generationSeconds.observe(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
 
 	//cout << "Marching took " << timer.interval << " seconds" << endl;
 
@@ -53,3 +308,25 @@ auto ChunkCreator::getChunk(const glm::ivec3& chunkPos) -> Chunk {
 
 	return c;
 }
+
+void ChunkCreator::setMesher(Mesher mesher) {
+	m_mesher = mesher;
+}
+
+auto ChunkCreator::stats() const -> GenerationStats {
+	std::lock_guard lock{m_mutex};
+	return m_stats;
+}
+
+auto ChunkCreator::getChunk(const glm::ivec3& chunkPos) -> Chunk {
+	GenerationStats generation;
+	auto c = createChunk(chunkPos, m_mesher, &generation);
+
+	std::lock_guard lock{m_mutex};
+	m_stats.chunks += generation.chunks;
+	m_stats.chunksSkipped += generation.chunksSkipped;
+	m_stats.samplesEvaluated += generation.samplesEvaluated;
+	m_stats.samplesSkipped += generation.samplesSkipped;
+	m_stats.samplesReused += generation.samplesReused;
+	return c;
+}
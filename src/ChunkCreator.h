@@ -1,8 +1,62 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
+#include <mutex>
+
 #include "AsyncChunkSource.h"
+#include "DensityGraph.h"
+
+struct GenerationStats {
+	std::size_t chunks = 0;
+	std::size_t chunksSkipped = 0; // entirely above or below the surface, neither sampled nor meshed
+	std::size_t samplesEvaluated = 0;
+	std::size_t samplesSkipped = 0;
+	std::size_t samplesReused = 0; // already generated for a neighbouring chunk
+};
 
 class ChunkCreator final : public AsyncChunkSource {
+public:
+	ChunkCreator();
+
+	/**
+	* Fills the densities of the chunk, including its margin, from the procedural density function.
+	* Regions which the bounds of the density graph prove to be entirely solid or air are filled with a constant of the same sign instead of being sampled.
+	* The samples are generated into the blocks of the chunks owning them, which are kept in a cache shared by all chunks,
+	* so samples in the margin are only evaluated once for all neighbours.
+	*/
+	static auto generateDensities(Chunk& chunk) -> GenerationStats;
+
+	/**
+	* Replaces the density function used for new chunks. Chunks generating concurrently finish with the previous graph.
+	*/
+	static void setDensityGraph(DensityGraph graph);
+	static auto densityGraph() -> std::shared_ptr<const DensityGraph>;
+
+	/**
+	* Identifies the densities generateDensities produces now: the fingerprint of the density graph, the density format,
+	* whether bounds are used and the chunk resolution. Chunk deltas apply only to the densities they were stored against.
+	*/
+	static auto baselineHash() -> uint64_t;
+
+	/**
+	* Generates and meshes the chunk on the calling thread. Chunks without surface are not meshed.
+	*/
+	static auto createChunk(const glm::ivec3& chunkPos, Mesher mesher, GenerationStats* stats = nullptr) -> Chunk;
+
+	void setMesher(Mesher mesher);
+
+	/**
+	* Totals over the chunks generated by this creator.
+	*/
+	auto stats() const -> GenerationStats;
+
 protected:
 	virtual auto getChunk(const glm::ivec3& chunkPos) -> Chunk override;
+
+private:
+	std::atomic<Mesher> m_mesher{Mesher::MARCHING_CUBES};
+
+	mutable std::mutex m_mutex;
+	GenerationStats m_stats;
 };
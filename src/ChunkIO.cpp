@@ -0,0 +1,558 @@
+#include "ChunkIO.h"
+
+#include <algorithm>
+#include <iostream>
+#include <system_error>
+
+#include "Profiler.h"
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define DPG_IO_URING
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+namespace {
+	// the worker threads run the blocking reads of the fallback and all completion callbacks
+	const auto workerCount = std::clamp(std::thread::hardware_concurrency(), 2u, 8u);
+
+	auto ioError(const std::filesystem::path& path, const char* what, int error = errno) {
+		return std::make_exception_ptr(std::system_error(error, std::generic_category(), std::string{what} + " " + path.string()));
+	}
+
+	auto readRange(const std::filesystem::path& path, uint64_t offset, std::size_t size) -> std::vector<uint8_t> {
+#ifdef _WIN32
+		std::ifstream file(path, std::ios::binary);
+		if (!file)
+			std::rethrow_exception(ioError(path, "could not open", ENOENT));
+		const auto fileSize = std::filesystem::file_size(path);
+		if (size == ChunkIO::wholeFile)
+			size = static_cast<std::size_t>(fileSize - std::min<uint64_t>(offset, fileSize));
+		if (offset + size > fileSize)
+			std::rethrow_exception(ioError(path, "unexpected end of", EIO));
+		std::vector<uint8_t> bytes(size);
+		file.seekg(static_cast<std::streamoff>(offset));
+		file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+		if (!file)
+			std::rethrow_exception(ioError(path, "could not read", EIO));
+		return bytes;
+#else
+		const auto fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0)
+			std::rethrow_exception(ioError(path, "could not open"));
+		if (size == ChunkIO::wholeFile) {
+			struct stat st;
+			if (fstat(fd, &st) != 0) {
+				const auto error = errno;
+				::close(fd);
+				std::rethrow_exception(ioError(path, "could not stat", error));
+			}
+			const auto fileSize = static_cast<uint64_t>(st.st_size);
+			size = static_cast<std::size_t>(fileSize - std::min(offset, fileSize));
+		}
+		std::vector<uint8_t> bytes(size);
+		for (std::size_t done = 0; done < bytes.size();) {
+			const auto n = pread(fd, bytes.data() + done, bytes.size() - done, static_cast<off_t>(offset + done));
+			if (n <= 0) {
+				if (n < 0 && errno == EINTR)
+					continue;
+				const auto error = n < 0 ? errno : EIO;
+				::close(fd);
+				std::rethrow_exception(ioError(path, n < 0 ? "could not read" : "unexpected end of", error));
+			}
+			done += static_cast<std::size_t>(n);
+		}
+		::close(fd);
+		return bytes;
+#endif
+	}
+
+	void writeWholeFile(const std::filesystem::path& path, const std::vector<uint8_t>& bytes) {
+#ifdef _WIN32
+		std::ofstream file(path, std::ios::binary);
+		file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+		if (!file)
+			std::rethrow_exception(ioError(path, "could not write", EIO));
+#else
+		const auto fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+		if (fd < 0)
+			std::rethrow_exception(ioError(path, "could not create"));
+		for (std::size_t done = 0; done < bytes.size();) {
+			const auto n = pwrite(fd, bytes.data() + done, bytes.size() - done, static_cast<off_t>(done));
+			if (n < 0) {
+				if (errno == EINTR)
+					continue;
+				const auto error = errno;
+				::close(fd);
+				std::rethrow_exception(ioError(path, "could not write", error));
+			}
+			done += static_cast<std::size_t>(n);
+		}
+		::close(fd);
+#endif
+	}
+}
+
+struct ChunkIO::Request {
+	enum class Kind {
+		READ,
+		WRITE
+	};
+
+	Kind kind;
+	std::filesystem::path path;
+	std::vector<uint8_t> buffer; // the bytes read
+	std::shared_ptr<const std::vector<uint8_t>> source; // the bytes to write
+	uint64_t offset = 0; // of a read
+	std::size_t length = wholeFile; // of a read
+	std::size_t done = 0;
+	int fd = -1;
+	ReadCallback onRead;
+	WriteCallback onWrite;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	auto size() const -> std::size_t {
+		return kind == Kind::READ ? buffer.size() : source->size();
+	}
+};
+
+#ifdef DPG_IO_URING
+/**
+* An io_uring driven by one thread. The thread collects new requests, submits them together with one io_uring_enter call
+* and then sleeps until a request completes. A poll on an eventfd wakes it when new requests arrive.
+*/
+class ChunkIO::Ring {
+public:
+	static auto create(ChunkIO& io) -> std::unique_ptr<Ring> {
+		std::unique_ptr<Ring> ring{new Ring{io}};
+		io_uring_params params{};
+		ring->m_fd = static_cast<int>(syscall(__NR_io_uring_setup, queueEntries, &params));
+		// IORING_OP_READ and IORING_OP_WRITE arrived in Linux 5.6 together with IORING_FEAT_RW_CUR_POS
+		if (ring->m_fd < 0 || !(params.features & IORING_FEAT_RW_CUR_POS))
+			return nullptr;
+
+		ring->m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+		ring->m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+		const auto single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+		if (single)
+			ring->m_sqRingSize = ring->m_cqRingSize = std::max(ring->m_sqRingSize, ring->m_cqRingSize);
+
+		const auto map = [&](std::size_t size, off_t offset) -> uint8_t* {
+			const auto p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->m_fd, offset);
+			return p == MAP_FAILED ? nullptr : static_cast<uint8_t*>(p);
+		};
+		ring->m_sqRing = map(ring->m_sqRingSize, IORING_OFF_SQ_RING);
+		ring->m_cqRing = single ? ring->m_sqRing : map(ring->m_cqRingSize, IORING_OFF_CQ_RING);
+		ring->m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+		ring->m_sqes = reinterpret_cast<io_uring_sqe*>(map(ring->m_sqesSize, IORING_OFF_SQES));
+		ring->m_eventFd = eventfd(0, EFD_CLOEXEC);
+		if (!ring->m_sqRing || !ring->m_cqRing || !ring->m_sqes || ring->m_eventFd < 0)
+			return nullptr;
+
+		ring->m_sqHead = reinterpret_cast<uint32_t*>(ring->m_sqRing + params.sq_off.head);
+		ring->m_sqTail = reinterpret_cast<uint32_t*>(ring->m_sqRing + params.sq_off.tail);
+		ring->m_sqMask = *reinterpret_cast<uint32_t*>(ring->m_sqRing + params.sq_off.ring_mask);
+		ring->m_sqEntries = params.sq_entries;
+		ring->m_sqArray = reinterpret_cast<uint32_t*>(ring->m_sqRing + params.sq_off.array);
+		ring->m_cqHead = reinterpret_cast<uint32_t*>(ring->m_cqRing + params.cq_off.head);
+		ring->m_cqTail = reinterpret_cast<uint32_t*>(ring->m_cqRing + params.cq_off.tail);
+		ring->m_cqMask = *reinterpret_cast<uint32_t*>(ring->m_cqRing + params.cq_off.ring_mask);
+		ring->m_cqEntries = params.cq_entries;
+		ring->m_cqes = reinterpret_cast<io_uring_cqe*>(ring->m_cqRing + params.cq_off.cqes);
+
+		ring->m_thread = std::thread{&Ring::loop, ring.get()};
+		return ring;
+	}
+
+	~Ring() {
+		if (m_thread.joinable()) {
+			{
+				std::lock_guard lock{m_mutex};
+				m_stop = true;
+			}
+			wake();
+			m_thread.join();
+		}
+		if (m_sqes)
+			munmap(m_sqes, m_sqesSize);
+		if (m_cqRing && m_cqRing != m_sqRing)
+			munmap(m_cqRing, m_cqRingSize);
+		if (m_sqRing)
+			munmap(m_sqRing, m_sqRingSize);
+		if (m_eventFd >= 0)
+			::close(m_eventFd);
+		if (m_fd >= 0)
+			::close(m_fd);
+	}
+
+	void submit(std::unique_ptr<Request> request) {
+		{
+			std::lock_guard lock{m_mutex};
+			m_incoming.push_back(std::move(request));
+		}
+		wake();
+	}
+
+private:
+	static constexpr unsigned queueEntries = 64;
+
+	explicit Ring(ChunkIO& io)
+		: m_io(io) {}
+
+	void wake() {
+		const uint64_t one = 1;
+		[[maybe_unused]] const auto written = ::write(m_eventFd, &one, sizeof(one));
+	}
+
+	// Opens the file of a new request, completes requests which fail or have nothing to transfer.
+	auto open(std::unique_ptr<Request>& r) -> bool {
+		if (r->kind == Request::Kind::READ) {
+			r->fd = ::open(r->path.c_str(), O_RDONLY | O_CLOEXEC);
+			struct stat st;
+			if (r->fd < 0 || fstat(r->fd, &st) != 0) {
+				auto error = ioError(r->path, "could not open");
+				finish(std::move(r), error);
+				return false;
+			}
+			const auto fileSize = static_cast<uint64_t>(st.st_size);
+			r->buffer.resize(r->length == wholeFile ? static_cast<std::size_t>(fileSize - std::min(r->offset, fileSize)) : r->length);
+		} else {
+			r->fd = ::open(r->path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+			if (r->fd < 0) {
+				auto error = ioError(r->path, "could not create");
+				finish(std::move(r), error);
+				return false;
+			}
+		}
+		if (r->size() == 0) {
+			finish(std::move(r), nullptr);
+			return false;
+		}
+		return true;
+	}
+
+	void finish(std::unique_ptr<Request> r, std::exception_ptr error) {
+		if (r->fd >= 0)
+			::close(r->fd);
+		r->fd = -1;
+		m_io.complete(std::move(r), error);
+	}
+
+	auto push(const io_uring_sqe& sqe) -> bool {
+		const auto tail = *m_sqTail;
+		if (tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries)
+			return false;
+		const auto index = tail & m_sqMask;
+		m_sqes[index] = sqe;
+		m_sqArray[index] = index;
+		__atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+		return true;
+	}
+
+	auto transfer(Request& r) const -> io_uring_sqe {
+		io_uring_sqe sqe{};
+		const auto remaining = std::min<std::size_t>(r.size() - r.done, 1u << 30);
+		if (r.kind == Request::Kind::READ) {
+			sqe.opcode = IORING_OP_READ;
+			sqe.addr = reinterpret_cast<uint64_t>(r.buffer.data() + r.done);
+		} else {
+			sqe.opcode = IORING_OP_WRITE;
+			sqe.addr = reinterpret_cast<uint64_t>(r.source->data() + r.done);
+		}
+		sqe.fd = r.fd;
+		sqe.len = static_cast<uint32_t>(remaining);
+		sqe.off = r.offset + r.done;
+		sqe.user_data = reinterpret_cast<uint64_t>(&r);
+		return sqe;
+	}
+
+	void loop() {
+		Profiler::setThreadName("io_uring");
+		std::deque<std::unique_ptr<Request>> backlog;
+		std::size_t inFlight = 0;
+		bool pollArmed = false;
+		for (;;) {
+			{
+				std::lock_guard lock{m_mutex};
+				for (auto& r : m_incoming)
+					backlog.push_back(std::move(r));
+				m_incoming.clear();
+				if (m_stop && backlog.empty() && inFlight == 0)
+					return;
+			}
+
+			unsigned toSubmit = 0;
+			if (!pollArmed) {
+				io_uring_sqe sqe{};
+				sqe.opcode = IORING_OP_POLL_ADD;
+				sqe.fd = m_eventFd;
+				sqe.poll_events = POLLIN;
+				sqe.user_data = 0;
+				if (push(sqe)) {
+					pollArmed = true;
+					toSubmit++;
+				}
+			}
+
+			// batch the waiting requests, keeping one completion slot for the poll
+			std::size_t batched = 0;
+			while (!backlog.empty() && inFlight + 1 < m_cqEntries) {
+				auto& r = backlog.front();
+				if (r->fd < 0 && !open(r)) {
+					backlog.pop_front();
+					continue;
+				}
+				if (!push(transfer(*r)))
+					break;
+				r.release();
+				backlog.pop_front();
+				toSubmit++;
+				batched++;
+				inFlight++;
+			}
+			if (batched > 0) {
+				std::lock_guard lock{m_io.m_mutex};
+				m_io.m_stats.batches++;
+			}
+
+			// submit and sleep until at least one request completed or new requests arrived
+			if (syscall(__NR_io_uring_enter, m_fd, toSubmit, 1, IORING_ENTER_GETEVENTS, nullptr, 0) < 0 && errno != EINTR && errno != EBUSY && errno != EAGAIN)
+				std::cerr << "io_uring_enter failed: " << std::generic_category().message(errno) << std::endl;
+
+			auto head = *m_cqHead;
+			const auto tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+			for (; head != tail; head++) {
+				const auto cqe = m_cqes[head & m_cqMask];
+				if (cqe.user_data == 0) {
+					uint64_t count;
+					[[maybe_unused]] const auto read = ::read(m_eventFd, &count, sizeof(count));
+					pollArmed = false;
+					continue;
+				}
+
+				std::unique_ptr<Request> r{reinterpret_cast<Request*>(cqe.user_data)};
+				inFlight--;
+				if (cqe.res <= 0) {
+					auto error = cqe.res < 0 ? ioError(r->path, r->kind == Request::Kind::READ ? "could not read" : "could not write", -cqe.res)
+											 : ioError(r->path, "unexpected end of", EIO);
+					finish(std::move(r), error);
+				} else if (r->done += static_cast<std::size_t>(cqe.res); r->done < r->size())
+					backlog.push_front(std::move(r)); // short transfer, continue where it stopped
+				else
+					finish(std::move(r), nullptr);
+			}
+			__atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+		}
+	}
+
+	ChunkIO& m_io;
+
+	int m_fd = -1;
+	int m_eventFd = -1;
+	uint8_t* m_sqRing = nullptr;
+	uint8_t* m_cqRing = nullptr;
+	io_uring_sqe* m_sqes = nullptr;
+	std::size_t m_sqRingSize = 0;
+	std::size_t m_cqRingSize = 0;
+	std::size_t m_sqesSize = 0;
+	uint32_t* m_sqHead = nullptr;
+	uint32_t* m_sqTail = nullptr;
+	uint32_t* m_sqArray = nullptr;
+	uint32_t m_sqMask = 0;
+	uint32_t m_sqEntries = 0;
+	uint32_t* m_cqHead = nullptr;
+	uint32_t* m_cqTail = nullptr;
+	io_uring_cqe* m_cqes = nullptr;
+	uint32_t m_cqMask = 0;
+	uint32_t m_cqEntries = 0;
+
+	std::mutex m_mutex; // guards m_incoming and m_stop
+	std::vector<std::unique_ptr<Request>> m_incoming;
+	bool m_stop = false;
+	std::thread m_thread;
+};
+#else
+class ChunkIO::Ring {
+public:
+	static auto create(ChunkIO&) -> std::unique_ptr<Ring> { return nullptr; }
+	void submit(std::unique_ptr<Request>) {}
+};
+#endif
+
+ChunkIO::ChunkIO(bool useIoUring) {
+	for (unsigned i = 0; i < workerCount; i++)
+		m_workers.emplace_back(&ChunkIO::workerLoop, this);
+	if (useIoUring)
+		m_ring = Ring::create(*this);
+}
+
+ChunkIO::~ChunkIO() {
+	wait();
+	m_ring.reset();
+	{
+		std::lock_guard lock{m_mutex};
+		m_stop = true;
+	}
+	m_jobAvailable.notify_all();
+	for (auto& t : m_workers)
+		t.join();
+}
+
+void ChunkIO::read(std::filesystem::path path, ReadCallback done) {
+	read(std::move(path), 0, wholeFile, std::move(done));
+}
+
+void ChunkIO::read(std::filesystem::path path, uint64_t offset, std::size_t size, ReadCallback done) {
+	auto r = std::make_unique<Request>();
+	r->kind = Request::Kind::READ;
+	r->path = std::move(path);
+	r->offset = offset;
+	r->length = size;
+	r->onRead = std::move(done);
+	{
+		std::lock_guard lock{m_mutex};
+		m_outstanding++;
+		m_stats.maxQueueDepth = std::max(m_stats.maxQueueDepth, ++m_stats.queueDepth);
+	}
+
+	if (m_ring)
+		m_ring->submit(std::move(r));
+	else
+		post([this, r = std::shared_ptr<Request>(std::move(r))]() mutable {
+			std::exception_ptr error;
+			try {
+				PROFILE_SCOPE("ChunkIO::read");
+				r->buffer = readRange(r->path, r->offset, r->length);
+			} catch (...) {
+				error = std::current_exception();
+			}
+			complete(std::make_unique<Request>(std::move(*r)), error);
+		});
+}
+
+void ChunkIO::write(std::filesystem::path path, std::shared_ptr<const std::vector<uint8_t>> bytes, WriteCallback done) {
+	auto r = std::make_unique<Request>();
+	r->kind = Request::Kind::WRITE;
+	r->path = std::move(path);
+	r->source = std::move(bytes);
+	r->onWrite = std::move(done);
+	{
+		std::lock_guard lock{m_mutex};
+		m_outstanding++;
+		m_stats.maxQueueDepth = std::max(m_stats.maxQueueDepth, ++m_stats.queueDepth);
+	}
+
+	if (m_ring)
+		m_ring->submit(std::move(r));
+	else
+		post([this, r = std::shared_ptr<Request>(std::move(r))]() mutable {
+			std::exception_ptr error;
+			try {
+				PROFILE_SCOPE("ChunkIO::write");
+				writeWholeFile(r->path, *r->source);
+			} catch (...) {
+				error = std::current_exception();
+			}
+			complete(std::make_unique<Request>(std::move(*r)), error);
+		});
+}
+
+void ChunkIO::run(std::function<void()> job) {
+	post(std::move(job));
+}
+
+void ChunkIO::wait() {
+	std::unique_lock lock{m_mutex};
+	m_idle.wait(lock, [&] { return m_outstanding == 0; });
+}
+
+auto ChunkIO::backend() const -> const char* {
+	return m_ring ? "io_uring" : "thread pool";
+}
+
+auto ChunkIO::readNow(const std::filesystem::path& path, uint64_t offset, std::size_t size) -> std::vector<uint8_t> {
+	return readRange(path, offset, size);
+}
+
+auto ChunkIO::stats() const -> IoStats {
+	std::lock_guard lock{m_mutex};
+	auto s = m_stats;
+	s.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_created).count();
+	return s;
+}
+
+void ChunkIO::complete(std::unique_ptr<Request> request, std::exception_ptr error) {
+	const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - request->start).count();
+	const auto bytes = error ? 0 : request->size();
+	{
+		std::lock_guard lock{m_mutex};
+		m_stats.queueDepth--;
+		if (request->kind == Request::Kind::READ) {
+			m_stats.reads++;
+			m_stats.bytesRead += bytes;
+			m_stats.readSeconds += seconds;
+		} else {
+			m_stats.writes++;
+			m_stats.bytesWritten += bytes;
+			m_stats.writeSeconds += seconds;
+		}
+	}
+
+	// the callback is posted before the request stops counting as outstanding, so wait() cannot return in between
+	post([r = std::shared_ptr<Request>(std::move(request)), error] {
+		PROFILE_SCOPE("ChunkIO::callback");
+		if (r->kind == Request::Kind::READ)
+			r->onRead(std::move(r->buffer), error);
+		else
+			r->onWrite(error);
+	});
+
+	std::lock_guard lock{m_mutex};
+	if (--m_outstanding == 0)
+		m_idle.notify_all();
+}
+
+void ChunkIO::post(std::function<void()> job) {
+	{
+		std::lock_guard lock{m_mutex};
+		m_outstanding++;
+		m_jobs.push_back(std::move(job));
+	}
+	m_jobAvailable.notify_one();
+}
+
+void ChunkIO::workerLoop() {
+	Profiler::setThreadName("io");
+	for (;;) {
+		std::function<void()> job;
+		{
+			std::unique_lock lock{m_mutex};
+			m_jobAvailable.wait(lock, [&] { return m_stop || !m_jobs.empty(); });
+			if (m_jobs.empty())
+				return;
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+		}
+
+		try {
+			job();
+		} catch (const std::exception& e) {
+			std::cerr << "Chunk I/O job failed: " << e.what() << std::endl;
+		}
+
+		std::lock_guard lock{m_mutex};
+		if (--m_outstanding == 0)
+			m_idle.notify_all();
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct IoStats {
+	std::size_t reads = 0;
+	std::size_t writes = 0;
+	std::size_t bytesRead = 0;
+	std::size_t bytesWritten = 0;
+	std::size_t batches = 0; // io_uring submissions, each carrying one or more requests
+	std::size_t queueDepth = 0; // requests submitted and not completed yet
+	std::size_t maxQueueDepth = 0;
+	double readSeconds = 0; // summed latency from request to completion
+	double writeSeconds = 0;
+	double seconds = 0; // since the ChunkIO was created
+};
+
+/**
+* Reads and writes files asynchronously, reads may cover only a range of a file. On Linux the requests are submitted in batches to an io_uring,
+* where that is not available a small pool of worker threads runs blocking reads and writes.
+* Completion callbacks and jobs passed to run() execute on the worker threads.
+*/
+class ChunkIO final {
+public:
+	using ReadCallback = std::function<void(std::vector<uint8_t> bytes, std::exception_ptr error)>;
+	using WriteCallback = std::function<void(std::exception_ptr error)>;
+
+	static constexpr auto wholeFile = static_cast<std::size_t>(-1);
+
+	/**
+	* Uses io_uring if requested and supported by the kernel.
+	*/
+	explicit ChunkIO(bool useIoUring = true);
+	ChunkIO(const ChunkIO&) = delete;
+	ChunkIO& operator=(const ChunkIO&) = delete;
+
+	/**
+	* Completes all requests and jobs.
+	*/
+	~ChunkIO();
+
+	void read(std::filesystem::path path, ReadCallback done);
+
+	/**
+	* Reads size bytes starting at offset, or up to the end of the file for wholeFile. Reading beyond the end is an error.
+	*/
+	void read(std::filesystem::path path, uint64_t offset, std::size_t size, ReadCallback done);
+	void write(std::filesystem::path path, std::shared_ptr<const std::vector<uint8_t>> bytes, WriteCallback done);
+	void run(std::function<void()> job);
+
+	/**
+	* Blocks until all requests and jobs are completed.
+	*/
+	void wait();
+
+	auto backend() const -> const char*;
+	auto stats() const -> IoStats;
+
+	/**
+	* Reads a range like read(), but blocks the calling thread and bypasses the queue and stats.
+	*/
+	static auto readNow(const std::filesystem::path& path, uint64_t offset = 0, std::size_t size = wholeFile) -> std::vector<uint8_t>;
+
+private:
+	struct Request;
+	class Ring;
+
+	void complete(std::unique_ptr<Request> request, std::exception_ptr error);
+	void post(std::function<void()> job);
+	void workerLoop();
+
+	const std::chrono::steady_clock::time_point m_created = std::chrono::steady_clock::now();
+
+	mutable std::mutex m_mutex; // guards all members below
+	std::condition_variable m_jobAvailable;
+	std::condition_variable m_idle;
+	std::deque<std::function<void()>> m_jobs;
+	std::size_t m_outstanding = 0; // requests and jobs not finished yet
+	bool m_stop = false;
+	IoStats m_stats;
+
+	std::vector<std::thread> m_workers;
+	std::unique_ptr<Ring> m_ring;
+};
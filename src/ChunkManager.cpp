@@ -1,11 +1,33 @@
 #include "globals.h"
+#include <glm/glm.hpp>
+
 #include <future>
+#include <iostream>
+#include <memory>
 #include <thread>
+#include <unordered_map>
 
 #include "ChunkManager.h"
+#include "Metrics.h"
+#include "Profiler.h"
+
+namespace {
+	auto& residentChunks = Metrics::gauge("dpg_chunks_resident", "Chunks loaded in memory");
+	auto& prefetchingChunks = Metrics::gauge("dpg_chunks_prefetching", "Chunks requested ahead of the camera, not loaded yet");
+	auto& compressedChunks = Metrics::gauge("dpg_chunks_compressed", "Chunks kept in the compressed cache");
+	auto& compressedBytes = Metrics::gauge("dpg_compressed_cache_bytes", "Bytes of the compressed chunk cache");
+	auto& densityBytes = Metrics::gauge("dpg_chunk_density_bytes", "Heap bytes of the densities of the loaded chunks");
+	auto& vertexBytes = Metrics::gauge("dpg_chunk_vertex_bytes", "Heap bytes of the vertices of the loaded chunks");
+	auto& triangleBytes = Metrics::gauge("dpg_chunk_triangle_bytes", "Heap bytes of the triangles of the loaded chunks");
+	auto& viewedBytes = Metrics::gauge("dpg_chunk_viewed_bytes", "Bytes the loaded chunks view in mapped files or shared buffers");
+	auto& gpuBytes = Metrics::gauge("dpg_chunk_gpu_bytes", "Bytes of the vertex and index buffers of the loaded chunks");
+	auto& ioQueueDepth = Metrics::gauge("dpg_io_queue_depth", "Chunk file reads and writes submitted but not completed");
+	auto& evictedChunks = Metrics::counter("dpg_chunks_evicted_total", "Chunks moved from memory to the compressed cache");
+	auto& decompressedChunks = Metrics::counter("dpg_chunks_decompressed_total", "Chunks taken back from the compressed cache");
+}
 
 ChunkManager::ChunkManager()
-	: serializer("chunks") {
+	: serializer("chunks" + std::to_string(chunkResolution)) { // the files depend on the resolution
 }
 
 ChunkManager::~ChunkManager() {
@@ -18,7 +40,20 @@ auto ChunkManager::get(const glm::ivec3& pos) -> Chunk* {
 	if (const auto it = loadedChunks.find(pos); it != loadedChunks.end())
 		return &it->second;
 
-	// chunk was not found, ask the cache on disk
+	m_prefetching.erase(pos);
+	return request(pos);
+}
+
+auto ChunkManager::request(const glm::ivec3& pos) -> Chunk* {
+	// chunks evicted recently are decompressed right away
+	if (auto c = m_compressed.take(pos)) {
+		decompressedChunks.add();
+		if (!global::headless)
+			c->createBuffers();
+		return &(loadedChunks[pos] = std::move(*c));
+	}
+
+	// ask the cache on disk
 	if (global::enableChunkCache && serializer.hasChunk(pos)) {
 		if (auto c = serializer.get(pos))
 			return &(loadedChunks[pos] = std::move(*c));
@@ -37,22 +72,148 @@ auto ChunkManager::get(const glm::ivec3& pos) const -> const Chunk* {
 	return const_cast<ChunkManager&>(*this).get(pos);
 }
 
+auto ChunkManager::find(const glm::ivec3& pos) -> Chunk* {
+	const auto it = loadedChunks.find(pos);
+	return it != loadedChunks.end() ? &it->second : nullptr;
+}
+
+auto ChunkManager::findWithDensities(const glm::ivec3& pos) -> Chunk* {
+	Chunk* chunk = find(pos);
+	if (!chunk)
+		return nullptr;
+	try {
+		chunk->densities.load();
+	} catch (const std::exception& e) {
+		// the chunk is replaced in place, so pointers to it stay valid
+		std::cout << "Warning: " << e.what() << ", generating chunk " << pos << " again" << std::endl;
+		*chunk = ChunkCreator::createChunk(pos, m_mesher);
+	}
+	return chunk;
+}
+
+auto ChunkManager::prefetch(const glm::ivec3& pos) -> bool {
+	if (loadedChunks.count(pos) || !m_prefetching.insert(pos).second)
+		return false;
+	if (request(pos))
+		m_prefetching.erase(pos); // was already loaded on demand
+	return true;
+}
+
+void ChunkManager::collectPrefetched() {
+	for (auto it = m_prefetching.begin(); it != m_prefetching.end();)
+		it = request(*it) ? m_prefetching.erase(it) : std::next(it);
+}
+
+auto ChunkManager::prefetchesInFlight() const -> std::size_t {
+	return m_prefetching.size();
+}
+
+void ChunkManager::evict(const std::function<bool(const glm::ivec3&)>& keep) {
+	PROFILE_SCOPE("ChunkManager::evict");
+	m_compressed.setBudget(static_cast<std::size_t>(global::compressedCacheMiB) << 20);
+	for (auto it = loadedChunks.begin(); it != loadedChunks.end();) {
+		auto& [pos, chunk] = *it;
+		if (keep(pos) || (chunk.edited && !global::enableChunkCache)) {
+			++it;
+			continue;
+		}
+		if (global::enableChunkCache && (chunk.edited || !serializer.hasChunk(pos)))
+			serializer.storeChunk(chunk); // unedited chunks already stored are unchanged
+		m_compressed.insert(std::move(chunk));
+		it = loadedChunks.erase(it);
+		evictedChunks.add();
+	}
+}
+
 void ChunkManager::clear() {
 	loadedChunks.clear();
+	m_prefetching.clear();
+	m_compressed.clear();
 	serializer.clear();
 	creator.clear();
 }
 
-ChunkMemoryFootprint ChunkManager::getMemoryFootprint() const {
-	ChunkMemoryFootprint mem{};
-
-	for (const auto& [i, chunk] : loadedChunks) {
-		const auto& cmem = chunk.getMemoryFootprint();
-		mem.densityValues += cmem.densityValues;
-		mem.densityValueSize = cmem.densityValueSize;
-		mem.triangles += cmem.triangles;
-		mem.triangleSize = cmem.triangleSize;
+auto ChunkManager::exportMeshes(const std::filesystem::path& path, glm::ivec3 fromChunk, glm::ivec3 toChunk, ExportProgress progress) -> std::future<MeshExportStats> {
+	// the loaded chunks change while the export runs, so their meshes are copied now
+	auto loaded = std::make_shared<std::unordered_map<glm::ivec3, Chunk>>();
+	for (const auto& [pos, chunk] : loadedChunks) {
+		if (glm::clamp(pos, fromChunk, toChunk) != pos)
+			continue;
+		Chunk c(pos);
+		c.vertices = chunk.vertices;
+		c.triangles = chunk.triangles;
+		loaded->emplace(pos, std::move(c));
 	}
 
+	return std::async(std::launch::async, [this, path, fromChunk, toChunk, loaded, mesher = m_mesher, progress = std::move(progress)] {
+		return ::exportMeshes(path, fromChunk, toChunk, [&](const glm::ivec3& pos) {
+			// each position is requested once, so the workers move different copies out of the map
+			if (const auto it = loaded->find(pos); it != loaded->end())
+				return std::move(it->second);
+			if (global::enableChunkCache && serializer.hasChunk(pos))
+				return serializer.read(pos);
+			return ChunkCreator::createChunk(pos, mesher);
+		}, progress);
+	});
+}
+
+auto ChunkManager::persistenceStats() const -> PersistenceStats {
+	return serializer.stats();
+}
+
+auto ChunkManager::ioStats() const -> IoStats {
+	return serializer.ioStats();
+}
+
+auto ChunkManager::ioBackend() const -> const char* {
+	return serializer.ioBackend();
+}
+
+auto ChunkManager::generationStats() const -> GenerationStats {
+	return creator.stats();
+}
+
+auto ChunkManager::compressedCacheStats() const -> CompressedCacheStats {
+	return m_compressed.stats();
+}
+
+auto ChunkManager::loadedChunkCount() const -> std::size_t {
+	return loadedChunks.size();
+}
+
+auto ChunkManager::mesher() const -> Mesher {
+	return m_mesher;
+}
+
+void ChunkManager::setMesher(Mesher mesher) {
+	m_mesher = mesher;
+	creator.setMesher(mesher);
+	serializer.setMesher(mesher);
+}
+
+void ChunkManager::updateMetrics() {
+	creator.updateMetrics();
+	serializer.updateMetrics();
+	residentChunks.set(static_cast<int64_t>(loadedChunks.size()));
+	prefetchingChunks.set(static_cast<int64_t>(m_prefetching.size()));
+
+	const auto compressed = m_compressed.stats();
+	compressedChunks.set(static_cast<int64_t>(compressed.chunks));
+	compressedBytes.set(static_cast<int64_t>(compressed.bytes));
+	ioQueueDepth.set(static_cast<int64_t>(serializer.ioStats().queueDepth));
+
+	const auto memory = getMemoryFootprint();
+	densityBytes.set(static_cast<int64_t>(memory.densityBytes));
+	vertexBytes.set(static_cast<int64_t>(memory.vertexBytes));
+	triangleBytes.set(static_cast<int64_t>(memory.triangleBytes));
+	viewedBytes.set(static_cast<int64_t>(memory.viewedBytes));
+	gpuBytes.set(static_cast<int64_t>(memory.gpuBytes));
+	MemoryTracker::updateMetrics();
+}
+
+ChunkMemoryFootprint ChunkManager::getMemoryFootprint() const {
+	ChunkMemoryFootprint mem;
+	for (const auto& [i, chunk] : loadedChunks)
+		mem += chunk.getMemoryFootprint();
 	return mem;
 }
@@ -1,10 +1,14 @@
 #pragma once
 
-#include <unordered_map>
+#include <functional>
+#include <future>
 
 #include "Chunk.h"
 #include "ChunkCreator.h"
+#include "CompressedChunkCache.h"
 #include "ChunkSerializer.h"
+#include "MemoryTracker.h"
+#include "MeshExporter.h"
 #include "mathlib.h"
 
 class ChunkManager final {
@@ -16,13 +20,77 @@ public:
 	auto get(const glm::ivec3& pos) -> Chunk*;
 	auto get(const glm::ivec3& pos) const -> const Chunk*;
 
+	/**
+	* Returns the chunk at pos if it is loaded, without requesting it.
+	*/
+	auto find(const glm::ivec3& pos) -> Chunk*;
+
+	/**
+	* Returns the chunk at pos like find(), with its densities loaded if they were lazy, so they can be read and changed.
+	* If the densities cannot be loaded, e.g. because their file was removed or damaged, the chunk is generated again.
+	*/
+	auto findWithDensities(const glm::ivec3& pos) -> Chunk*;
+
+	/**
+	* Starts loading or generating the chunk before it is needed, unless it is loaded or already prefetching.
+	* Returns whether a prefetch was started. A chunk requested by get() meanwhile continues as a regular load.
+	*/
+	auto prefetch(const glm::ivec3& pos) -> bool;
+
+	/**
+	* Moves the completed prefetches to the loaded chunks.
+	*/
+	void collectPrefetched();
+	auto prefetchesInFlight() const -> std::size_t;
+
+	/**
+	* Moves the loaded chunks for which keep returns false to the compressed cache, storing them to disk first if the chunk cache is enabled.
+	* Without the chunk cache, edited chunks stay loaded, so their edits are not lost when the compressed cache drops them.
+	*/
+	void evict(const std::function<bool(const glm::ivec3&)>& keep);
+
 	void clear();
 
-private:
+	/**
+	* Starts writing the meshes of the chunks from fromChunk to toChunk into a PLY or OBJ file on a separate thread. Loaded chunks are
+	* exported as they are when the export starts, the others are read from the chunk cache or generated without being loaded.
+	* The chunk manager must outlive the returned future.
+	*/
+	auto exportMeshes(const std::filesystem::path& path, glm::ivec3 fromChunk, glm::ivec3 toChunk, ExportProgress progress = {}) -> std::future<MeshExportStats>;
+
+	auto persistenceStats() const -> PersistenceStats;
+	auto ioStats() const -> IoStats;
+	auto ioBackend() const -> const char*;
+	auto generationStats() const -> GenerationStats;
+	auto compressedCacheStats() const -> CompressedCacheStats;
+	auto loadedChunkCount() const -> std::size_t;
+
+	/**
+	* The memory of the loaded chunks, summed over their containers and buffers.
+	*/
 	ChunkMemoryFootprint getMemoryFootprint() const;
 
+	/**
+	* Sets the gauges of the chunk pipeline: chunks pending, ready, resident, prefetching and compressed, the memory of the loaded chunks
+	* and the memory of each MemoryTag.
+	*/
+	void updateMetrics();
+
+	auto mesher() const -> Mesher;
+	void setMesher(Mesher mesher);
+
+private:
+
+	/**
+	* Asks the cache on disk or else the creator for the chunk, returning it once it is loaded.
+	*/
+	auto request(const glm::ivec3& pos) -> Chunk*;
+
+	Mesher m_mesher = Mesher::MARCHING_CUBES;
 	ChunkCreator creator;
 	ChunkSerializer serializer;
+	CompressedChunkCache m_compressed{0};
 
-	std::unordered_map<glm::ivec3, Chunk> loadedChunks;
+	TrackedMap<glm::ivec3, Chunk, MemoryTag::CHUNK_MAPS> loadedChunks;
+	TrackedSet<glm::ivec3, MemoryTag::CHUNK_MAPS> m_prefetching;
 };
\ No newline at end of file
@@ -0,0 +1,320 @@
+#include "ChunkManifest.h"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <optional>
+#include <unordered_set>
+#include <vector>
+
+#include "IO.h"
+#include "MappedFile.h"
+#include "utils.h"
+
+namespace {
+	const auto manifestName = "manifest";
+	const auto journalName = "manifest.journal";
+
+	// the journal is merged into the manifest when it grows beyond this many chunks
+	constexpr std::size_t maxJournalEntries = 1 << 16;
+
+	// chunk ids take 63 bits, the highest bit of an entry marks delta files
+	constexpr uint64_t deltaFlag = uint64_t{1} << 63;
+
+	struct ManifestHeader {
+		std::array<char, 4> magic;
+		uint32_t version;
+		uint64_t count;
+	};
+
+	constexpr std::array<char, 4> manifestMagic{'D', 'P', 'G', 'M'};
+	constexpr uint32_t manifestVersion = 2;
+
+	auto entryId(const ManifestEntry& entry) -> IdType {
+		return entry.key & ~deltaFlag;
+	}
+
+	auto entryFile(const ManifestEntry& entry) -> ChunkFile {
+		return {entry.key & deltaFlag ? ChunkFileKind::DELTA : ChunkFileKind::FULL, entry.payload};
+	}
+
+	auto makeEntry(IdType id, ChunkFile file) -> ManifestEntry {
+		return {file.kind == ChunkFileKind::DELTA ? id | deltaFlag : id, file.payload};
+	}
+
+	/**
+	* The id or payload hash a file is named after
+	*/
+	auto parseName(const std::string& name) -> std::optional<uint64_t> {
+		static_assert(std::is_same<uint64_t, IdType>::value, "Chunk::IdType is assumed to be uint64_t");
+		char* p = nullptr;
+		const uint64_t value = std::strtoull(name.c_str(), &p, 16);
+		if (name.empty() || *p != '\0')
+			return {};
+		return value;
+	}
+
+	auto secondsSince(std::chrono::steady_clock::time_point start) -> double {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	}
+}
+
+ChunkManifest::ChunkManifest(std::filesystem::path chunkDir)
+	: m_chunkDir(std::move(chunkDir)) {
+	const auto start = std::chrono::steady_clock::now();
+	removeTempFiles(); // no store is in flight yet, also after a crash with a valid manifest
+	if (!open() && exists(m_chunkDir))
+		rebuild();
+	m_stats.openSeconds = secondsSince(start);
+}
+
+ChunkManifest::~ChunkManifest() {
+	try {
+		std::lock_guard lock{m_mutex};
+		if (!m_journaled.empty())
+			writeManifest();
+		// no store is in flight anymore, which could still use a payload without listing it
+		if (m_inserted)
+			removeUnusedPayloads();
+	} catch (const std::exception& e) {
+		std::cerr << "Could not compact chunk manifest: " << e.what() << std::endl;
+	}
+}
+
+auto ChunkManifest::find(IdType id) const -> ChunkFile {
+	std::lock_guard lock{m_mutex};
+	if (const auto it = m_journaled.find(id); it != m_journaled.end())
+		return it->second;
+	const auto it = std::lower_bound(m_entries.begin(), m_entries.end(), id, [](const ManifestEntry& entry, IdType id) { return entryId(entry) < id; });
+	return it != m_entries.end() && entryId(*it) == id ? entryFile(*it) : ChunkFile{};
+}
+
+void ChunkManifest::insert(IdType id, ChunkFile file) {
+	std::lock_guard lock{m_mutex};
+	m_journaled[id] = file;
+	m_inserted = true;
+	if (!m_journal.is_open()) {
+		create_directories(m_chunkDir);
+		m_journal.open(m_chunkDir / journalName, std::ios::binary | std::ios::app);
+	}
+	write(m_journal, makeEntry(id, file));
+	m_journal.flush();
+	m_stats.journalEntries = m_journaled.size();
+
+	if (m_journaled.size() >= maxJournalEntries)
+		writeManifest();
+}
+
+auto ChunkManifest::markMissing(IdType id) -> bool {
+	std::lock_guard lock{m_mutex};
+	m_journaled[id] = ChunkFile{};
+	return !std::exchange(m_stale, true);
+}
+
+void ChunkManifest::rebuild() {
+	const auto start = std::chrono::steady_clock::now();
+
+	std::vector<ManifestEntry> entries;
+	std::unordered_set<uint64_t> payloads;
+	if (exists(m_chunkDir)) {
+		for (const auto& e : std::filesystem::directory_iterator{m_chunkDir}) {
+			const auto filename = e.path().filename().string();
+			if (filename == manifestName || filename == journalName || filename == payloadDirectory || filename == tempDirectory || e.path().extension() == tempExtension)
+				continue;
+
+			const auto id = parseName(e.path().stem().string());
+			if (!id || (*id & deltaFlag)) {
+				std::cout << "Warning: " << e.path() << " in chunk cache" << std::endl;
+				continue;
+			}
+			entries.push_back(makeEntry(*id, {e.path().extension() == deltaExtension ? ChunkFileKind::DELTA : ChunkFileKind::FULL}));
+		}
+	}
+	if (const auto payloadDir = m_chunkDir / payloadDirectory; exists(payloadDir)) {
+		for (const auto& e : std::filesystem::directory_iterator{payloadDir}) {
+			if (e.path().extension() == tempExtension)
+				continue;
+			if (const auto payload = parseName(e.path().filename().string()))
+				payloads.insert(*payload);
+			else
+				std::cout << "Warning: " << e.path() << " in chunk cache" << std::endl;
+		}
+	}
+
+	// an interrupted store can leave a full and a delta file of the same chunk, the newer one counts
+	std::sort(entries.begin(), entries.end(), [](const ManifestEntry& a, const ManifestEntry& b) { return entryId(a) < entryId(b); });
+	std::vector<ManifestEntry> unique;
+	unique.reserve(entries.size());
+	for (const auto& entry : entries) {
+		if (!unique.empty() && entryId(unique.back()) == entryId(entry)) {
+			std::error_code ec;
+			const auto id = entryId(entry);
+			if (last_write_time(path(id, entryFile(entry)), ec) > last_write_time(path(id, entryFile(unique.back())), ec))
+				unique.back() = entry;
+			continue;
+		}
+		unique.push_back(entry);
+	}
+
+	std::lock_guard lock{m_mutex};
+
+	// the listing does not show which chunks use a payload, the known mappings to existing payloads replace the files of the same chunks
+	std::vector<ManifestEntry> merged;
+	merged.reserve(unique.size());
+	std::size_t i = 0;
+	for (const auto& entry : m_entries) {
+		if (entry.payload == 0 || !payloads.count(entry.payload))
+			continue;
+		for (; i < unique.size() && entryId(unique[i]) < entryId(entry); i++)
+			merged.push_back(unique[i]);
+		if (i < unique.size() && entryId(unique[i]) == entryId(entry))
+			i++;
+		merged.push_back(entry);
+	}
+	merged.insert(merged.end(), unique.begin() + i, unique.end());
+	m_entries = std::move(merged);
+
+	// chunks stored while listing stay journaled, missing files are settled by the listing
+	for (auto it = m_journaled.begin(); it != m_journaled.end();)
+		it = it->second.kind == ChunkFileKind::NONE ? m_journaled.erase(it) : std::next(it);
+	m_stale = false;
+
+	writeManifest();
+	m_stats.rebuilds++;
+	m_stats.rebuildSeconds += secondsSince(start);
+}
+
+void ChunkManifest::removeTempFiles() {
+	std::error_code ec;
+	std::filesystem::remove_all(m_chunkDir / tempDirectory, ec);
+	auto manifestTemp = m_chunkDir / manifestName;
+	manifestTemp += tempExtension;
+	std::filesystem::remove(manifestTemp, ec);
+}
+
+void ChunkManifest::compact() {
+	std::lock_guard lock{m_mutex};
+	if (!m_journaled.empty())
+		writeManifest();
+}
+
+auto ChunkManifest::path(IdType id, ChunkFile file) const -> std::filesystem::path {
+	if (file.payload != 0)
+		return payloadPath(file.payload);
+	auto p = m_chunkDir / toHexString(id);
+	if (file.kind == ChunkFileKind::DELTA)
+		p += deltaExtension;
+	return p;
+}
+
+auto ChunkManifest::payloadPath(uint64_t payload) const -> std::filesystem::path {
+	return m_chunkDir / payloadDirectory / toHexString(payload);
+}
+
+auto ChunkManifest::tempPath(const std::filesystem::path& file, uint64_t sequence) const -> std::filesystem::path {
+	// chunk and payload files may have the same name, the sequence number differs
+	return m_chunkDir / tempDirectory / (file.filename().string() + "." + std::to_string(sequence) + tempExtension);
+}
+
+auto ChunkManifest::stats() const -> ManifestStats {
+	std::lock_guard lock{m_mutex};
+	return m_stats;
+}
+
+auto ChunkManifest::open() -> bool {
+	const auto manifestPath = m_chunkDir / manifestName;
+	if (!exists(manifestPath))
+		return false;
+
+	try {
+		const auto file = MappedFile::open(manifestPath);
+		ManifestHeader header;
+		if (file->size() < sizeof(header))
+			return false;
+		std::memcpy(&header, file->data(), sizeof(header));
+		if (header.magic != manifestMagic || header.version != manifestVersion || file->size() != sizeof(header) + header.count * sizeof(ManifestEntry))
+			return false;
+		m_entries = MappedVector<ManifestEntry>{file, reinterpret_cast<const ManifestEntry*>(file->data() + sizeof(header)), header.count};
+	} catch (const std::exception&) {
+		return false;
+	}
+
+	// replay the journal, a record torn by an interrupted append is ignored
+	if (std::ifstream journal{m_chunkDir / journalName, std::ios::binary}) {
+		ManifestEntry entry;
+		while (journal.read(reinterpret_cast<char*>(&entry), sizeof(entry)))
+			m_journaled[entryId(entry)] = entryFile(entry);
+	}
+
+	m_stats.manifestEntries = m_entries.size();
+	m_stats.journalEntries = m_journaled.size();
+	return true;
+}
+
+void ChunkManifest::writeManifest() {
+	// merge the sorted journal into the sorted entries, journaled chunks replace their entries
+	std::vector<std::pair<IdType, ChunkFile>> changes(m_journaled.begin(), m_journaled.end());
+	std::sort(changes.begin(), changes.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+	std::vector<ManifestEntry> merged;
+	merged.reserve(m_entries.size() + changes.size());
+	std::size_t i = 0;
+	for (const auto& [id, file] : changes) {
+		for (; i < m_entries.size() && entryId(m_entries[i]) < id; i++)
+			merged.push_back(m_entries[i]);
+		if (i < m_entries.size() && entryId(m_entries[i]) == id)
+			i++;
+		if (file.kind != ChunkFileKind::NONE)
+			merged.push_back(makeEntry(id, file));
+	}
+	merged.insert(merged.end(), m_entries.begin() + i, m_entries.end());
+
+	// replace the manifest before emptying the journal, replaying a journal twice does no harm
+	create_directories(m_chunkDir);
+	const auto manifestPath = m_chunkDir / manifestName;
+	auto tempPath = manifestPath;
+	tempPath += tempExtension;
+	{
+		auto file = openFileOut(tempPath, std::ios::binary);
+		write(file, ManifestHeader{manifestMagic, manifestVersion, merged.size()});
+		writeVector(file, merged);
+		if (!file)
+			throw std::runtime_error("could not write chunk manifest " + tempPath.string());
+	}
+	std::filesystem::rename(tempPath, manifestPath);
+
+	m_journal.close();
+	std::error_code ec;
+	std::filesystem::resize_file(m_chunkDir / journalName, 0, ec);
+	m_journaled.clear();
+
+	// map the new manifest instead of keeping the entries on the heap
+	m_entries = std::move(merged);
+	open();
+
+	m_stats.manifestEntries = m_entries.size();
+	m_stats.journalEntries = 0;
+}
+
+void ChunkManifest::removeUnusedPayloads() {
+	const auto payloadDir = m_chunkDir / payloadDirectory;
+	if (!exists(payloadDir))
+		return;
+
+	std::unordered_set<uint64_t> used;
+	for (const auto& entry : m_entries)
+		if (entry.payload != 0)
+			used.insert(entry.payload);
+
+	std::vector<std::filesystem::path> unused;
+	for (const auto& e : std::filesystem::directory_iterator{payloadDir}) {
+		const auto payload = parseName(e.path().filename().string());
+		if (payload && !used.count(*payload))
+			unused.push_back(e.path());
+	}
+	for (const auto& p : unused) {
+		std::error_code ec;
+		std::filesystem::remove(p, ec);
+	}
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <unordered_map>
+
+#include "Chunk.h"
+#include "MappedVector.h"
+
+enum class ChunkFileKind : uint8_t {
+	NONE,
+	FULL,
+	DELTA
+};
+
+/**
+* Where a chunk is stored. Full chunks with a payload are stored content addressed in the payload file named after the hash of its contents,
+* which all chunks with the same contents share. Other chunks have a file of their own.
+*/
+struct ChunkFile {
+	ChunkFileKind kind = ChunkFileKind::NONE;
+	uint64_t payload = 0; // the hash of the contents, 0 for a file of the chunk
+
+	auto operator==(const ChunkFile& other) const -> bool { return kind == other.kind && payload == other.payload; }
+	auto operator!=(const ChunkFile& other) const -> bool { return !(*this == other); }
+};
+
+/**
+* A chunk id with the delta flag in the highest bit and the payload of its file, the record of the manifest and the journal
+*/
+struct ManifestEntry {
+	uint64_t key;
+	uint64_t payload;
+};
+
+struct ManifestStats {
+	std::size_t manifestEntries = 0;
+	std::size_t journalEntries = 0;
+	std::size_t rebuilds = 0;
+	double openSeconds = 0;
+	double rebuildSeconds = 0;
+};
+
+/**
+* The index of the chunk files in a cache directory, so opening a cache does not list the directory.
+* Files are written to a temporary directory first, which opening removes with the files of writes that did not complete.
+* The manifest file holds the sorted chunk ids with their payload hashes and is memory mapped when opened. Stores append to a journal file,
+* which is replayed on open and merged into the manifest by compact().
+* A stale manifest is only detected when a listed file turns out to be missing, which calls for a rebuild from the directory.
+* The manifest is the only record of which chunks use which payload, a rebuild keeps the mappings it still knows of.
+*/
+class ChunkManifest final {
+public:
+	static constexpr auto deltaExtension = ".delta";
+	static constexpr auto tempExtension = ".tmp";
+	static constexpr auto payloadDirectory = "payloads";
+	static constexpr auto tempDirectory = "temp";
+
+	/**
+	* Removes left over temporary files and opens the manifest of the directory, rebuilding it if it is missing or invalid.
+	*/
+	explicit ChunkManifest(std::filesystem::path chunkDir);
+	ChunkManifest(const ChunkManifest&) = delete;
+	ChunkManifest& operator=(const ChunkManifest&) = delete;
+
+	/**
+	* Compacts the journal into the manifest and removes the payload files no chunk uses anymore.
+	*/
+	~ChunkManifest();
+
+	auto find(IdType id) const -> ChunkFile;
+
+	/**
+	* Records that the file of a chunk is about to be written. Call before writing it, so a crash leaves the manifest stale rather than incomplete.
+	*/
+	void insert(IdType id, ChunkFile file);
+
+	/**
+	* Records that a listed file is missing. Returns true for the first missing file since the last rebuild, whose caller should rebuild().
+	*/
+	auto markMissing(IdType id) -> bool;
+
+	/**
+	* Lists the directory and replaces the manifest, keeping the entries inserted meanwhile.
+	* Temporary files are skipped, not removed, since they may belong to stores still in flight.
+	*/
+	void rebuild();
+
+	/**
+	* Merges the journal into a new manifest file and empties the journal.
+	*/
+	void compact();
+
+	auto path(IdType id, ChunkFile file) const -> std::filesystem::path;
+	auto payloadPath(uint64_t payload) const -> std::filesystem::path;
+
+	/**
+	* Where the write with the given sequence number writes the file before renaming it to its path.
+	*/
+	auto tempPath(const std::filesystem::path& file, uint64_t sequence) const -> std::filesystem::path;
+	auto stats() const -> ManifestStats;
+
+private:
+	auto open() -> bool;
+	void writeManifest();
+	void removeUnusedPayloads();
+
+	/**
+	* Removes the temporary directory and manifest, left over from writes that did not complete. Only safe before this process stores any chunk.
+	*/
+	void removeTempFiles();
+
+	std::filesystem::path m_chunkDir;
+
+	mutable std::mutex m_mutex; // guards all members below
+	MappedVector<ManifestEntry> m_entries; // sorted by id
+	std::unordered_map<IdType, ChunkFile> m_journaled; // changes since the manifest was written, replacing its entries
+	std::ofstream m_journal;
+	bool m_stale = false;
+	bool m_inserted = false; // whether a payload may have been replaced since opening
+	ManifestStats m_stats;
+};
@@ -0,0 +1,100 @@
+#include "ChunkPrefetcher.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#include "Metrics.h"
+
+namespace {
+	// seconds of movement which are extrapolated
+	constexpr auto horizon = 2.0f;
+
+	// the path is sampled every half chunk, up to this many samples
+	constexpr auto maxSteps = 64;
+
+	auto& timeToVisible = Metrics::histogram("dpg_time_to_visible_seconds", "Seconds from a chunk entering the render sphere until it is loaded, zero if it was loaded before");
+}
+
+auto ChunkPrefetcher::predict(glm::vec3 position, glm::vec3 viewDirection, glm::vec3 velocity, int radius) -> const std::vector<glm::ivec3>& {
+	m_predicted.clear();
+	m_seen.clear();
+
+	const auto travel = glm::length(velocity) * horizon;
+	if (travel < 0.5f)
+		return m_predicted;
+
+	const auto cameraChunk = glm::ivec3(glm::floor(position));
+	const auto steps = std::min(maxSteps, static_cast<int>(std::ceil(travel * 2)));
+	auto last = cameraChunk;
+	for (int s = 1; s <= steps; s++) {
+		const auto center = glm::ivec3(glm::floor(position + velocity * (horizon * s / steps)));
+		if (center == last)
+			continue;
+		last = center;
+
+		const auto first = m_predicted.size();
+		for (int x = center.x - radius; x <= center.x + radius; x++)
+			for (int y = center.y - radius; y <= center.y + radius; y++)
+				for (int z = center.z - radius; z <= center.z + radius; z++) {
+					const glm::ivec3 chunkPos(x, y, z);
+					// the same sphere test as World::buildRenderList
+					if (distance(glm::vec3(chunkPos), glm::vec3(center)) > radius || distance(glm::vec3(chunkPos), glm::vec3(cameraChunk)) <= radius)
+						continue;
+					if (m_seen.insert(chunkPos).second)
+						m_predicted.push_back(chunkPos);
+				}
+
+		// chunks entered at the same time are ordered by how directly the camera looks at them
+		const auto alignment = [&](const glm::ivec3& chunkPos) {
+			const auto toChunk = glm::vec3(chunkPos) + 0.5f - position;
+			return glm::dot(toChunk, viewDirection) / glm::length(toChunk);
+		};
+		std::sort(m_predicted.begin() + first, m_predicted.end(), [&](const glm::ivec3& a, const glm::ivec3& b) { return alignment(a) > alignment(b); });
+	}
+	return m_predicted;
+}
+
+auto ChunkPrefetcher::predicted(const glm::ivec3& chunkPos) const -> bool {
+	return m_seen.count(chunkPos) > 0;
+}
+
+void ChunkPrefetcher::entered(const glm::ivec3& chunkPos, bool available) {
+	m_stats.entered++;
+	if (available) {
+		m_stats.hits++;
+		recordTimeToVisible(0);
+	} else
+		m_waiting.emplace(chunkPos, Clock::now());
+}
+
+void ChunkPrefetcher::available(const glm::ivec3& chunkPos) {
+	if (const auto it = m_waiting.find(chunkPos); it != m_waiting.end()) {
+		recordTimeToVisible(std::chrono::duration<double>(Clock::now() - it->second).count());
+		m_waiting.erase(it);
+	}
+}
+
+void ChunkPrefetcher::left(const glm::ivec3& cameraChunkPos, int radius) {
+	for (auto it = m_waiting.begin(); it != m_waiting.end();)
+		it = distance(glm::vec3(it->first), glm::vec3(cameraChunkPos)) > radius ? m_waiting.erase(it) : std::next(it);
+}
+
+void ChunkPrefetcher::requested() {
+	m_stats.requested++;
+}
+
+auto ChunkPrefetcher::stats(std::size_t inFlight) const -> PrefetchStats {
+	auto s = m_stats;
+	s.inFlight = inFlight;
+	return s;
+}
+
+void ChunkPrefetcher::recordTimeToVisible(double seconds) {
+	// averaged over the chunks which became visible, chunks still waiting are not included
+	m_visible++;
+	timeToVisible.observe(seconds);
+	m_stats.averageTimeToVisible += (seconds - m_stats.averageTimeToVisible) / static_cast<double>(m_visible);
+	m_stats.maxTimeToVisible = std::max(m_stats.maxTimeToVisible, seconds);
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <unordered_set>
+#include <vector>
+
+#include "MemoryTracker.h"
+#include "mathtypes.h"
+
+struct PrefetchStats {
+	std::size_t requested = 0; // prefetches started
+	std::size_t inFlight = 0;
+	std::size_t entered = 0; // chunks entering the render sphere because the camera moved
+	std::size_t hits = 0; // of entered, already loaded when they entered
+
+	// seconds from a chunk entering the render sphere until it is in the render list, zero for hits
+	double averageTimeToVisible = 0;
+	double maxTimeToVisible = 0;
+};
+
+/**
+* Predicts the chunks the camera needs next by extrapolating its movement, so they can be loaded before they enter the render sphere.
+* Also keeps the stats of chunks entering the render sphere, which show how well the prediction works.
+*/
+class ChunkPrefetcher final {
+public:
+	/**
+	* The chunks within the radius of the extrapolated camera path which are not within the radius of the camera now.
+	* Position and velocity are in chunks. The chunks entered first come first, among those the chunks closest to the view direction.
+	*/
+	auto predict(glm::vec3 position, glm::vec3 viewDirection, glm::vec3 velocity, int radius) -> const std::vector<glm::ivec3>&;
+
+	/**
+	* Whether the chunk was returned by the last predict().
+	*/
+	auto predicted(const glm::ivec3& chunkPos) const -> bool;
+
+	/**
+	* Records a chunk entering the render sphere, available if it was already loaded.
+	*/
+	void entered(const glm::ivec3& chunkPos, bool available);
+
+	/**
+	* Records a chunk of the render sphere being available, completing the time to visible of chunks which entered before they were loaded.
+	*/
+	void available(const glm::ivec3& chunkPos);
+
+	/**
+	* Forgets the chunks waiting to become available which left the render sphere again.
+	*/
+	void left(const glm::ivec3& cameraChunkPos, int radius);
+
+	void requested();
+	auto stats(std::size_t inFlight) const -> PrefetchStats;
+
+private:
+	using Clock = std::chrono::steady_clock;
+
+	void recordTimeToVisible(double seconds);
+
+	std::vector<glm::ivec3> m_predicted;
+	std::unordered_set<glm::ivec3> m_seen;
+	TrackedMap<glm::ivec3, Clock::time_point, MemoryTag::CHUNK_MAPS> m_waiting; // entered the render sphere, but not loaded yet
+	PrefetchStats m_stats;
+	std::size_t m_visible = 0; // entered chunks which became visible, the distribution of their times is in dpg_time_to_visible_seconds
+};
@@ -1,85 +1,649 @@
 #include "globals.h"
 #include "utils.h"
-#include <fstream>
+#include <array>
+#include <chrono>
+#include <cstring>
 #include <string>
 #include <utility>
 
+#include "ChunkCreator.h"
 #include "ChunkSerializer.h"
+#include "MappedFile.h"
+#include "Metrics.h"
+#include "Profiler.h"
 
-ChunkSerializer::ChunkSerializer(std::filesystem::path chunkDir)
-	: m_chunkDir(std::move(chunkDir)) {
-	if (!exists(chunkDir))
-		return;
-	for (auto& e : std::filesystem::directory_iterator{m_chunkDir}) {
-		const auto filename = e.path().string();
-
-		static_assert(is_same<uint64_t, IdType>::value, "Chunk::IdType is assumed to be uint64_t");
-		char* p = nullptr;
-		IdType id = std::strtoll(filename.c_str(), &p, 16);
-		if (*p != filename.size()) {
-			cout << "Warning: " << filename << " in chunk cache" << endl;
-			continue;
+namespace {
+	// edited chunks whose delta takes more than this fraction of the full density grid are stored as full snapshot
+	constexpr auto maxDeltaFraction = 0.25;
+
+	struct DeltaEntry {
+		uint32_t index;
+		Chunk::DensityType value;
+	};
+
+	/**
+	* Delta files start with this header, followed by count DeltaEntries. The baseline is ChunkCreator::baselineHash() of the densities
+	* the delta was taken against, a delta applied to densities generated otherwise would corrupt the edits.
+	*/
+	struct DeltaHeader {
+		std::array<char, 4> magic;
+		uint32_t version;
+		uint64_t baseline;
+		uint32_t count;
+		uint32_t reserved;
+	};
+
+	constexpr std::array<char, 4> deltaMagic{'D', 'P', 'G', 'D'};
+	constexpr uint32_t deltaVersion = 1;
+
+	struct FileSection {
+		uint64_t offset;
+		uint64_t size;
+
+		auto end() const -> uint64_t { return offset + size; }
+	};
+
+	/**
+	* Full chunk files start with this header, followed by the sections it lists: the vertices, the triangles and the encoded densities.
+	* The mesh sections come first, so loading only the mesh reads one contiguous range.
+	* Each section starts at a multiple of sectionAlignment, so the file can be used in place when memory mapped.
+	* The mesher of the stored mesh is recorded, a chunk loaded while another mesher is active is remeshed to match its neighbours.
+	*/
+	struct FileHeader {
+		std::array<char, 4> magic;
+		uint32_t version;
+		uint32_t densityFormat;
+		uint32_t densityCount;
+		std::array<uint8_t, 6> faceConnectivity; // stored, so loading does not need the densities
+		uint8_t mesher;
+		uint8_t reserved;
+		uint64_t vertexCount;
+		uint64_t triangleCount;
+		FileSection vertices;
+		FileSection triangles;
+		FileSection densities;
+	};
+
+	constexpr std::array<char, 4> fileMagic{'D', 'P', 'G', 'C'};
+	constexpr uint32_t fileVersion = 3;
+	constexpr std::size_t sectionAlignment = 16;
+
+	const auto storedHelp = "Chunks stored to disk, or found to be stored already";
+	auto& fullChunksStored = Metrics::counter("dpg_chunks_stored_total{kind=\"full\"}", storedHelp);
+	auto& deltaChunksStored = Metrics::counter("dpg_chunks_stored_total{kind=\"delta\"}", storedHelp);
+	auto& dedupedChunksStored = Metrics::counter("dpg_chunks_stored_total{kind=\"deduplicated\"}", storedHelp);
+	auto& unchangedChunksStored = Metrics::counter("dpg_chunks_stored_total{kind=\"unchanged\"}", storedHelp);
+	auto& bytesStored = Metrics::counter("dpg_chunk_bytes_stored_total", "Bytes of chunk files written");
+	auto& buildSeconds = Metrics::histogram("dpg_chunk_build_seconds", "Seconds to build a chunk from its file contents after reading them");
+
+	auto align(uint64_t offset) -> uint64_t {
+		return (offset + sectionAlignment - 1) / sectionAlignment * sectionAlignment;
+	}
+
+	auto makeHeader(const Chunk& chunk) -> FileHeader {
+		FileHeader h{};
+		h.magic = fileMagic;
+		h.version = fileVersion;
+		h.densityFormat = static_cast<uint32_t>(chunk.densities.format());
+		h.densityCount = static_cast<uint32_t>(chunk.densities.size());
+		h.faceConnectivity = chunk.faceConnectivity;
+		h.mesher = static_cast<uint8_t>(chunk.mesher);
+		h.vertexCount = chunk.vertices.size();
+		h.triangleCount = chunk.triangles.size();
+		h.vertices = {align(sizeof(FileHeader)), h.vertexCount * sizeof(RVertex)};
+		h.triangles = {align(h.vertices.end()), h.triangleCount * sizeof(glm::uvec3)};
+		h.densities = {align(h.triangles.end()), chunk.densities.byteSize()};
+		return h;
+	}
+
+	/**
+	* Validates a header on its own, the caller checks that the sections it uses were read.
+	*/
+	void checkHeader(const FileHeader& h, const std::filesystem::path& path) {
+		if (h.magic != fileMagic || h.version != fileVersion)
+			throw runtime_error("unsupported chunk file " + path.string());
+		const auto aligned = [](const FileSection& s) { return s.offset % sectionAlignment == 0; };
+		if (h.densityFormat > static_cast<uint32_t>(DensityFormat::INT8) || h.mesher > static_cast<uint8_t>(Mesher::SURFACE_NETS) || h.densityCount != chunkSamples * chunkSamples * chunkSamples ||
+			h.vertices.size != h.vertexCount * sizeof(RVertex) || h.triangles.size != h.triangleCount * sizeof(glm::uvec3) ||
+			h.densities.size != h.densityCount * formatSize(static_cast<DensityFormat>(h.densityFormat)) ||
+			!aligned(h.vertices) || !aligned(h.triangles) || !aligned(h.densities) ||
+			h.vertices.offset < sizeof(FileHeader) || h.triangles.offset < h.vertices.end() || h.densities.offset < h.triangles.end())
+			throw runtime_error("corrupt chunk file " + path.string());
+	}
+
+	/**
+	* Sets the mesh of a chunk from the mesh sections, which start at mesh. If owner is set, the chunk views the memory it keeps alive.
+	*/
+	void readMesh(Chunk& c, const FileHeader& h, const uint8_t* mesh, const std::shared_ptr<const void>& owner) {
+		const auto* vertices = reinterpret_cast<const RVertex*>(mesh);
+		const auto* triangles = reinterpret_cast<const glm::uvec3*>(mesh + (h.triangles.offset - h.vertices.offset));
+		if (owner) {
+			c.vertices = Chunk::Vertices{owner, vertices, h.vertexCount};
+			c.triangles = Chunk::Triangles{owner, triangles, h.triangleCount};
+		} else {
+			c.vertices = Chunk::Vertices::Vector(vertices, vertices + h.vertexCount);
+			c.triangles = Chunk::Triangles::Vector(triangles, triangles + h.triangleCount);
 		}
-		availableChunks.insert(id);
+		c.faceConnectivity = h.faceConnectivity;
+		c.mesher = static_cast<Mesher>(h.mesher);
+	}
+
+	/**
+	* The payload of a full chunk file, 0 is reserved for files which are not content addressed
+	*/
+	auto payloadHash(const std::vector<uint8_t>& bytes) -> uint64_t {
+		const auto hash = hashBytes(bytes.data(), bytes.size());
+		return hash != 0 ? hash : 1;
+	}
+
+	auto sharedBuffer(std::vector<uint8_t> bytes) -> std::shared_ptr<const std::vector<uint8_t>> {
+		return std::make_shared<const std::vector<uint8_t>>(std::move(bytes));
 	}
 }
 
+ChunkSerializer::ChunkSerializer(std::filesystem::path chunkDir)
+	: AsyncChunkSource("disk"), m_chunkDir(chunkDir), m_manifest(std::move(chunkDir)), m_io(global::ioUring) {}
+
 ChunkSerializer::~ChunkSerializer() = default;
 
 bool ChunkSerializer::hasChunk(const glm::ivec3& chunkPos) {
-	return availableChunks.find(ChunkGridCoordinateToId(chunkPos)) != availableChunks.end();
+	return m_manifest.find(ChunkGridCoordinateToId(chunkPos)).kind != ChunkFileKind::NONE;
 }
 
 void ChunkSerializer::storeChunk(const Chunk& chunk) {
+	PROFILE_SCOPE("ChunkSerializer::storeChunk");
 	if (!global::enableChunkCache)
 		return;
 
-	const unsigned int size = chunkResolution + 1 + 2; // + 1 for corners and + 2 for marging
+	const auto fullDensityBytes = chunkSamples * chunkSamples * chunkSamples * sizeof(Chunk::DensityType);
+	const auto id = chunk.getId();
 
-	// write chunk to disk
 	create_directory(m_chunkDir);
-	std::ofstream file(m_chunkDir / toHexString(chunk.getId()), ios::binary);
-	file.write(reinterpret_cast<const char*>(chunk.densities.data()), size * size * size * sizeof(Chunk::DensityType));
-	file << static_cast<size_t>(chunk.vertices.size());
-	file.write((char*)chunk.vertices.data(), chunk.vertices.size() * sizeof(RVertex));
-	file << static_cast<size_t>(chunk.triangles.size());
-	file.write((char*)chunk.triangles.data(), chunk.triangles.size() * sizeof(glm::uvec3));
-	file.close();
 
+	if (chunk.edited) {
+		// compare against the densities we would generate for this chunk
+		const auto baseline = ChunkCreator::baselineHash();
+		Chunk generated(chunk.chunkIndex());
+		ChunkCreator::generateDensities(generated);
+
+		std::vector<DeltaEntry> delta;
+		const auto densities = chunk.densities.decoded();
+		const auto generatedDensities = generated.densities.decoded();
+		for (uint32_t i = 0; i < densities.size(); i++)
+			if (densities[i] != generatedDensities[i])
+				delta.push_back({i, densities[i]});
+
+		const auto deltaBytes = sizeof(DeltaHeader) + delta.size() * sizeof(DeltaEntry);
+		if (deltaBytes <= fullDensityBytes * maxDeltaFraction) {
+			auto bytes = std::make_shared<std::vector<uint8_t>>(deltaBytes);
+			const DeltaHeader header{deltaMagic, deltaVersion, baseline, static_cast<uint32_t>(delta.size()), 0};
+			std::memcpy(bytes->data(), &header, sizeof(header));
+			std::memcpy(bytes->data() + sizeof(header), delta.data(), delta.size() * sizeof(DeltaEntry));
+			writeFile(id, {ChunkFileKind::DELTA}, std::move(bytes));
+
+			{
+				std::lock_guard lock{m_mutex};
+				m_stats.deltaChunksStored++;
+				m_stats.deltaBytesStored += deltaBytes;
+				m_stats.deltaBytesAsFull += sizeof(FileHeader) + chunk.densities.byteSize() + chunk.vertices.size() * sizeof(RVertex) + chunk.triangles.size() * sizeof(glm::uvec3);
+			}
+			deltaChunksStored.add();
+			bytesStored.add(deltaBytes);
+			cout << "Wrote chunk delta:     " << chunk.chunkIndex() << " " << delta.size() << " densities" << endl;
+			return;
+		}
+	}
+
+	// a chunk still viewing its file is unchanged since it was loaded, as is one whose densities were never loaded, which meshing and edits need
+	if (!chunk.densities.loaded() || (chunk.densities.mapped() && chunk.vertices.mapped() && chunk.triangles.mapped()))
+		return;
+
+	// write chunk to disk, densities are stored in the format of the chunk
+	const auto header = makeHeader(chunk);
+	auto bytes = std::make_shared<std::vector<uint8_t>>(header.densities.end());
+	std::memcpy(bytes->data(), &header, sizeof(header));
+	std::memcpy(bytes->data() + header.vertices.offset, chunk.vertices.data(), header.vertices.size);
+	std::memcpy(bytes->data() + header.triangles.offset, chunk.triangles.data(), header.triangles.size);
+	std::memcpy(bytes->data() + header.densities.offset, chunk.densities.bytes(), header.densities.size);
+
+	// the edits of a chunk must survive losing the manifest, which alone knows the payloads of chunks
+	ChunkFile file{ChunkFileKind::FULL};
+	if (!chunk.edited) {
+		file.payload = payloadHash(*bytes);
+		const auto stored = storedPayload(file.payload);
+		const auto same = stored.owner && stored.size == bytes->size() && std::memcmp(stored.data, bytes->data(), stored.size) == 0;
+		if (stored.owner && !same)
+			file.payload = 0; // the hash collides with another payload, the chunk gets a file of its own
+		else if (same && m_manifest.find(id) == file) {
+			unchangedChunksStored.add();
+			std::lock_guard lock{m_mutex};
+			m_stats.unchangedChunks++;
+			return;
+		} else if (same) {
+			sharePayload(id, file);
+			dedupedChunksStored.add();
+			std::lock_guard lock{m_mutex};
+			m_stats.dedupedChunks++;
+			m_stats.dedupedBytes += bytes->size();
+			return;
+		}
+	}
+	writeFile(id, file, std::move(bytes));
+
+	{
+		std::lock_guard lock{m_mutex};
+		m_stats.fullChunksStored++;
+		m_stats.fullBytesStored += header.densities.end();
+	}
+	fullChunksStored.add();
+	bytesStored.add(header.densities.end());
 	cout << "Wrote chunk from disk: " << chunk.chunkIndex() << endl;
 }
 
+void ChunkSerializer::flush() {
+	m_io.wait();
+}
+
+auto ChunkSerializer::read(const glm::ivec3& chunkPos) -> Chunk {
+	return load(chunkPos).get();
+}
+
+void ChunkSerializer::writeFile(IdType id, ChunkFile file, std::shared_ptr<const std::vector<uint8_t>> bytes) {
+	const auto path = m_manifest.path(id, file);
+	const auto replaced = replacedFiles(id, file);
+	const auto shared = file.payload != 0;
+	if (shared)
+		create_directories(path.parent_path());
+
+	// the chunk is available from memory until its file is written
+	m_manifest.insert(id, file);
+	uint64_t sequence = 0;
+	{
+		std::lock_guard lock{m_mutex};
+		sequence = ++m_writeSequence;
+		m_pendingWrites[id] = {sequence, bytes};
+		if (shared)
+			m_pendingPayloads[file.payload] = bytes;
+	}
+
+	// write a new file and replace the old one, which may still be mapped by a loaded chunk
+	const auto tempFile = m_manifest.tempPath(path, sequence);
+	create_directories(tempFile.parent_path());
+	m_io.write(tempFile, std::move(bytes), [=](std::exception_ptr error) {
+		// whether this is the latest write and its rename must not be overtaken by a later write of the chunk
+		std::lock_guard fileLock{m_fileMutex};
+		const auto isLatest = [&] {
+			const auto it = m_pendingWrites.find(id);
+			return it != m_pendingWrites.end() && it->second.sequence == sequence;
+		};
+		bool latest = false;
+		{
+			std::lock_guard lock{m_mutex};
+			latest = isLatest();
+		}
+		std::error_code ec;
+		if (error || (!latest && !shared)) {
+			// a later write of the chunk replaces this one, a failed latest write stays available from memory
+			std::filesystem::remove(tempFile, ec);
+			if (error) {
+				try {
+					std::rethrow_exception(error);
+				} catch (const std::exception& e) {
+					cerr << "Could not write chunk: " << e.what() << endl;
+				}
+			}
+			return;
+		}
+		std::filesystem::rename(tempFile, path, ec);
+		if (ec) {
+			cerr << "Could not write chunk " << path << ": " << ec.message() << endl;
+			std::filesystem::remove(tempFile, ec);
+			return;
+		}
+		{
+			std::lock_guard lock{m_mutex};
+			if (shared)
+				m_pendingPayloads.erase(file.payload);
+			// sharePayload may have discarded the write meanwhile
+			latest = isLatest();
+			if (latest)
+				m_pendingWrites.erase(id);
+		}
+		if (latest)
+			for (const auto& r : replaced)
+				std::filesystem::remove(r, ec);
+	});
+}
+
+void ChunkSerializer::sharePayload(IdType id, ChunkFile file) {
+	m_manifest.insert(id, file);
+	{
+		// a write of the chunk still in flight is outdated now and discards its file
+		std::lock_guard lock{m_mutex};
+		m_pendingWrites.erase(id);
+	}
+	std::lock_guard fileLock{m_fileMutex};
+	for (const auto& r : replacedFiles(id, file)) {
+		std::error_code ec;
+		std::filesystem::remove(r, ec);
+	}
+}
+
+auto ChunkSerializer::storedPayload(uint64_t payload) const -> SharedBytes {
+	{
+		std::lock_guard lock{m_mutex};
+		if (const auto p = m_pendingPayloads.find(payload); p != m_pendingPayloads.end())
+			return {p->second, p->second->data(), p->second->size()};
+	}
+	if (auto loaded = m_payloads->find(payload, PayloadPart::FILE); loaded.owner)
+		return loaded;
+
+	// a payload is renamed to its path before it stops being pending
+	const auto path = m_manifest.payloadPath(payload);
+	if (std::error_code ec; !exists(path, ec))
+		return {};
+	try {
+		const auto b = sharedBuffer(ChunkIO::readNow(path));
+		return {b, b->data(), b->size()};
+	} catch (const std::exception& e) {
+		cerr << "Could not read chunk payload " << path << ": " << e.what() << endl;
+		return {};
+	}
+}
+
+auto ChunkSerializer::replacedFiles(IdType id, ChunkFile file) const -> std::vector<std::filesystem::path> {
+	std::vector<std::filesystem::path> replaced;
+	for (const auto kind : {ChunkFileKind::FULL, ChunkFileKind::DELTA})
+		if (const ChunkFile own{kind}; own != file)
+			replaced.push_back(m_manifest.path(id, own));
+	return replaced;
+}
+
+void ChunkSerializer::setMesher(Mesher mesher) {
+	m_mesher = mesher;
+}
+
+auto ChunkSerializer::stats() const -> PersistenceStats {
+	std::lock_guard lock{m_mutex};
+	auto s = m_stats;
+	s.densityLoads = m_densityLoads->loads;
+	s.densityBytesLoaded = m_densityLoads->bytes;
+	s.sharedLoads = m_payloads->hits();
+	return s;
+}
+
+auto ChunkSerializer::manifestStats() const -> ManifestStats {
+	return m_manifest.stats();
+}
+
+auto ChunkSerializer::ioStats() const -> IoStats {
+	return m_io.stats();
+}
+
+auto ChunkSerializer::ioBackend() const -> const char* {
+	return m_io.backend();
+}
+
 auto ChunkSerializer::getChunk(const glm::ivec3& chunkPos) -> Chunk {
-	IdType chunkId = ChunkGridCoordinateToId(chunkPos);
+	return load(chunkPos).get();
+}
 
-	if (availableChunks.find(chunkId) == availableChunks.end())
-		throw std::runtime_error("chunk requested from serializer, but not available");
+auto ChunkSerializer::load(const glm::ivec3& chunkPos) -> std::future<Chunk> {
+	const auto promise = std::make_shared<std::promise<Chunk>>(std::allocator_arg, TrackingAllocator<Chunk, MemoryTag::FUTURES>{});
+	auto future = promise->get_future();
 
-	// read chunk from disk
-	Chunk c(chunkId);
-	const unsigned int size = chunkResolution + 1 + 2; // + 1 for corners and + 2 for marging
+	const IdType chunkId = ChunkGridCoordinateToId(chunkPos);
+	const auto file = m_manifest.find(chunkId);
+	if (file.kind == ChunkFileKind::NONE) {
+		promise->set_exception(std::make_exception_ptr(std::runtime_error("chunk requested from serializer, but not available")));
+		return future;
+	}
+	const auto isDelta = file.kind == ChunkFileKind::DELTA;
+	const auto path = m_manifest.path(chunkId, file);
 
-	const auto chunkFile = m_chunkDir / toHexString(chunkId);
-	std::ifstream file(chunkFile, ios::binary);
-	if (!file)
-		throw runtime_error("could not open chunk file " + chunkFile.string());
-	c.densities.resize(size * size * size);
-	file.read(reinterpret_cast<char*>(c.densities.data()), size * size * size * sizeof(Chunk::DensityType));
-	size_t verticesCount = 0;
-	file >> verticesCount;
-	if (verticesCount > 0) {
-		c.vertices.resize(verticesCount);
-		file.read(reinterpret_cast<char*>(c.vertices.data()), verticesCount * sizeof(RVertex));
+	std::shared_ptr<const std::vector<uint8_t>> pending;
+	{
+		std::lock_guard lock{m_mutex};
+		if (const auto it = m_pendingWrites.find(chunkId); it != m_pendingWrites.end())
+			pending = it->second.bytes;
+		else if (const auto p = m_pendingPayloads.find(file.payload); p != m_pendingPayloads.end())
+			pending = p->second;
 	}
-	size_t trianglesCount = 0;
-	file >> trianglesCount;
-	if (trianglesCount > 0) {
-		c.triangles.resize(trianglesCount);
-		file.read(reinterpret_cast<char*>(c.triangles.data()), trianglesCount * sizeof(RVertex));
+
+	// builds the chunk on a worker thread of the I/O backend, the load stats measure the building and I/O stats the reading
+	const auto finish = [this, promise, chunkPos, chunkId, isDelta, path](const std::function<Chunk()>& makeChunk) {
+		try {
+			const auto start = std::chrono::steady_clock::now();
+			auto c = makeChunk();
+			const auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			buildSeconds.observe(seconds);
+			{
+				std::lock_guard lock{m_mutex};
+				if (isDelta) {
+					m_stats.deltaChunksLoaded++;
+					m_stats.deltaLoadSeconds += seconds;
+				} else {
+					m_stats.fullChunksLoaded++;
+					m_stats.fullLoadSeconds += seconds;
+				}
+			}
+			cout << "Read chunk from disk:  " << chunkPos << endl;
+			promise->set_value(std::move(c));
+		} catch (const std::exception& e) {
+			// a file listed in the manifest but missing means the manifest is stale, the chunk is generated instead
+			if (std::error_code ec; !exists(path, ec) && !ec) {
+				if (m_manifest.markMissing(chunkId))
+					m_io.run([this] { m_manifest.rebuild(); });
+			} else
+				cout << "Warning: " << e.what() << ", generating the chunk instead" << endl; // e.g. from an older version, overwritten when stored
+			try {
+				promise->set_value(ChunkCreator::createChunk(chunkPos, m_mesher));
+			} catch (...) {
+				promise->set_exception(std::current_exception());
+			}
+		}
+	};
+	const auto parse = [this, chunkPos, isDelta, path](const uint8_t* data, std::size_t size) {
+		return isDelta ? deltaChunk(chunkPos, data, size, path) : fullChunk(chunkPos, data, size, nullptr, path);
+	};
+
+	const auto inMemory = isDelta ? SharedBytes{} : m_payloads->find(file.payload, PayloadPart::FILE);
+	if (pending && file.payload != 0) {
+		// not written yet, chunks with the same payload view the contents being written
+		m_io.run([=] { finish([&] { return fullChunk(chunkPos, pending->data(), pending->size(), pending, path); }); });
+	} else if (pending) {
+		m_io.run([=] { finish([&] { return parse(pending->data(), pending->size()); }); });
+	} else if (inMemory.owner) {
+		m_io.run([=] { finish([&] { return fullChunk(chunkPos, inMemory.data, inMemory.size, inMemory.owner, path); }); });
+	} else if (!isDelta && global::mapChunkFiles) {
+		// mapping reads nothing yet, the pages of lazy densities are only read when accessed
+		m_io.run([=] {
+			finish([&] {
+				const auto mapped = m_payloads->get(file.payload, PayloadPart::FILE, [&] {
+					const auto f = MappedFile::open(path);
+					return SharedBytes{f, f->data(), f->size()};
+				});
+				return fullChunk(chunkPos, mapped.data, mapped.size, mapped.owner, path);
+			});
+		});
+	} else if (!isDelta && global::lazyDensities) {
+		readMeshOnly(chunkPos, path, file.payload, finish);
+	} else {
+		m_io.read(path, [=](std::vector<uint8_t> bytes, std::exception_ptr error) {
+			finish([&] {
+				if (error)
+					std::rethrow_exception(error);
+				if (isDelta || file.payload == 0)
+					return parse(bytes.data(), bytes.size());
+				const auto shared = m_payloads->get(file.payload, PayloadPart::FILE, [&] {
+					const auto b = sharedBuffer(std::move(bytes));
+					return SharedBytes{b, b->data(), b->size()};
+				});
+				return fullChunk(chunkPos, shared.data, shared.size, shared.owner, path);
+			});
+		});
+	}
+	return future;
+}
+
+void ChunkSerializer::readMeshOnly(const glm::ivec3& chunkPos, const std::filesystem::path& path, uint64_t payload, std::function<void(std::function<Chunk()>)> finish) {
+	if (const auto mesh = m_payloads->find(payload, PayloadPart::MESH); mesh.owner) {
+		m_io.run([=] { finish([&] { return meshOnlyChunk(chunkPos, mesh, path, payload); }); });
+		return;
 	}
-	file.close();
 
-	cout << "Read chunk from disk:  " << chunkPos << endl;
+	m_io.read(path, 0, sizeof(FileHeader), [=](std::vector<uint8_t> bytes, std::exception_ptr error) {
+		FileHeader header;
+		try {
+			if (error)
+				std::rethrow_exception(error);
+			std::memcpy(&header, bytes.data(), sizeof(header));
+			checkHeader(header, path);
+		} catch (...) {
+			finish([e = std::current_exception()]() -> Chunk { std::rethrow_exception(e); });
+			return;
+		}
+
+		// the header is read again with the mesh, so the shared part is complete by itself
+		m_io.read(path, 0, header.triangles.end(), [=](std::vector<uint8_t> mesh, std::exception_ptr error) {
+			finish([&] {
+				if (error)
+					std::rethrow_exception(error);
+				const auto shared = m_payloads->get(payload, PayloadPart::MESH, [&] {
+					const auto b = sharedBuffer(std::move(mesh));
+					return SharedBytes{b, b->data(), b->size()};
+				});
+				return meshOnlyChunk(chunkPos, shared, path, payload);
+			});
+		});
+	});
+}
+
+auto ChunkSerializer::meshOnlyChunk(const glm::ivec3& chunkPos, const SharedBytes& mesh, const std::filesystem::path& path, uint64_t payload) -> Chunk {
+	FileHeader header;
+	if (mesh.size < sizeof(header))
+		throw runtime_error("corrupt chunk file " + path.string());
+	std::memcpy(&header, mesh.data, sizeof(header));
+	checkHeader(header, path);
+	if (header.triangles.end() > mesh.size)
+		throw runtime_error("corrupt chunk file " + path.string());
+
+	Chunk c(chunkPos);
+	readMesh(c, header, mesh.data + header.vertices.offset, mesh.owner);
+	const auto format = static_cast<DensityFormat>(header.densityFormat);
+	c.densities = DensityGrid::lazy(format, header.densityCount, [path, payload, section = header.densities, counters = m_densityLoads, payloads = m_payloads]() -> DensityGrid::Bytes {
+		const auto densities = payloads->get(payload, PayloadPart::DENSITIES, [&] {
+			counters->loads++;
+			counters->bytes += section.size;
+			const auto b = sharedBuffer(ChunkIO::readNow(path, section.offset, section.size));
+			return SharedBytes{b, b->data(), b->size()};
+		});
+		return {densities.owner, densities.data, densities.size};
+	});
+	c.densities.convert(static_cast<DensityFormat>(global::densityFormat));
+	if (const Mesher mesher = m_mesher; c.mesher != mesher)
+		c.mesh(mesher); // loads the densities
+	return c;
+}
+
+auto ChunkSerializer::fullChunk(const glm::ivec3& chunkPos, const uint8_t* data, std::size_t size, std::shared_ptr<const void> owner, const std::filesystem::path& path) -> Chunk {
+	FileHeader header;
+	if (size < sizeof(header))
+		throw runtime_error("corrupt chunk file " + path.string());
+	std::memcpy(&header, data, sizeof(header));
+	checkHeader(header, path);
+	if (header.densities.end() > size)
+		throw runtime_error("corrupt chunk file " + path.string());
+	const auto format = static_cast<DensityFormat>(header.densityFormat);
+	const auto* densities = data + header.densities.offset;
+
+	Chunk c(chunkPos);
+	readMesh(c, header, data + header.vertices.offset, owner);
+	if (owner && global::lazyDensities) {
+		// viewing the densities reads no pages, counting their first access shows how many chunks needed them
+		c.densities = DensityGrid::lazy(format, header.densityCount, [owner, densities, size = header.densities.size, counters = m_densityLoads]() -> DensityGrid::Bytes {
+			counters->loads++;
+			counters->bytes += size;
+			return {owner, densities, size};
+		});
+	} else if (owner)
+		c.densities = DensityGrid::fromEncoded(format, {owner, densities, header.densities.size});
+	else
+		c.densities = DensityGrid::fromEncoded(format, DensityGrid::Bytes::Vector(densities, densities + header.densities.size));
+
+	// chunks stored in another format are converted once their densities are loaded, which copies them to the heap
+	c.densities.convert(static_cast<DensityFormat>(global::densityFormat));
+
+	// a mesh of another mesher would not meet the meshes of the neighbours at the borders
+	if (const Mesher mesher = m_mesher; c.mesher != mesher)
+		c.mesh(mesher);
+
+	return c;
+}
+
+auto ChunkSerializer::deltaChunk(const glm::ivec3& chunkPos, const uint8_t* data, std::size_t size, const std::filesystem::path& path) -> Chunk {
+	DeltaHeader header{};
+	if (size >= sizeof(header))
+		std::memcpy(&header, data, sizeof(header));
+	if (size < sizeof(header) || header.magic != deltaMagic || header.version != deltaVersion
+		|| size < sizeof(header) + static_cast<std::size_t>(header.count) * sizeof(DeltaEntry))
+		throw runtime_error("could not read chunk delta " + path.string());
+	if (header.baseline != ChunkCreator::baselineHash())
+		throw runtime_error("chunk delta " + path.string() + " was stored against another density graph or generation settings");
+	std::vector<DeltaEntry> delta(header.count);
+	std::memcpy(delta.data(), data + sizeof(header), header.count * sizeof(DeltaEntry));
+
+	// regenerate the chunk and reapply the edits
+	Chunk c(chunkPos);
+	ChunkCreator::generateDensities(c);
+	for (const auto& [index, value] : delta) {
+		if (index >= c.densities.size())
+			throw runtime_error("invalid density index in chunk delta " + path.string());
+		c.densities.set(index, value);
+	}
+	c.edited = true;
+	c.mesh(m_mesher);
 
 	return c;
 }
+
+auto ChunkSerializer::SharedPayloads::find(uint64_t payload, PayloadPart part) -> SharedBytes {
+	if (payload == 0)
+		return {};
+	std::lock_guard lock{m_mutex};
+	if (const auto it = m_entries.find({payload, part}); it != m_entries.end()) {
+		if (auto owner = it->second.owner.lock()) {
+			m_hits++;
+			return {std::move(owner), it->second.data, it->second.size};
+		}
+	}
+	return {};
+}
+
+auto ChunkSerializer::SharedPayloads::get(uint64_t payload, PayloadPart part, const std::function<SharedBytes()>& load) -> SharedBytes {
+	if (payload == 0)
+		return load();
+	if (auto bytes = find(payload, part); bytes.owner)
+		return bytes;
+
+	// loaded without holding the lock, of concurrent loads of the same part the first one is kept
+	auto bytes = load();
+	std::lock_guard lock{m_mutex};
+	auto& entry = m_entries[{payload, part}];
+	if (auto owner = entry.owner.lock()) {
+		m_hits++;
+		return {std::move(owner), entry.data, entry.size};
+	}
+	entry = {bytes.owner, bytes.data, bytes.size};
+	if (m_entries.size() >= m_pruneSize) {
+		for (auto it = m_entries.begin(); it != m_entries.end();)
+			it = it->second.owner.expired() ? m_entries.erase(it) : std::next(it);
+		m_pruneSize = std::max<std::size_t>(64, m_entries.size() * 2);
+	}
+	return bytes;
+}
+
+auto ChunkSerializer::SharedPayloads::hits() const -> size_t {
+	std::lock_guard lock{m_mutex};
+	return m_hits;
+}
@@ -1,28 +1,206 @@
 #pragma once
 
+#include <atomic>
 #include <filesystem>
-#include <unordered_set>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 
 #include "AsyncChunkSource.h"
+#include "ChunkIO.h"
+#include "ChunkManifest.h"
+#include "MappedFile.h"
 
 using namespace std;
 
+struct PersistenceStats {
+	size_t fullChunksStored = 0;
+	size_t fullBytesStored = 0;
+	size_t deltaChunksStored = 0;
+	size_t deltaBytesStored = 0;
+	size_t deltaBytesAsFull = 0; // what the delta chunks would have taken as full snapshots
+
+	size_t fullChunksLoaded = 0;
+	double fullLoadSeconds = 0;
+	size_t deltaChunksLoaded = 0;
+	double deltaLoadSeconds = 0;
+
+	size_t densityLoads = 0; // lazy density grids of full chunks loaded on first access
+	size_t densityBytesLoaded = 0; // read from the file, or viewed in the mapped file
+
+	size_t dedupedChunks = 0; // full chunks whose payload was already stored, so no file was written
+	size_t dedupedBytes = 0; // what their files would have taken
+	size_t unchangedChunks = 0; // full chunks not written again, since their file holds the same payload
+	size_t sharedLoads = 0; // payloads and payload sections which were already in memory for another chunk
+};
+
 class ChunkSerializer final : public AsyncChunkSource {
 public:
 	ChunkSerializer(std::filesystem::path chunkDir);
 	virtual ~ChunkSerializer();
 
 	bool hasChunk(const glm::ivec3& chunkPos);
+
+	/**
+	* Stores an edited chunk as the sparse difference to its procedurally generated densities,
+	* unless that difference is too large. All other chunks are stored as full snapshots.
+	* Unedited chunks are stored content addressed, chunks with identical contents share one payload file.
+	* Edited chunks keep files of their own, which a rebuild of the manifest finds again.
+	*/
 	void storeChunk(const Chunk& chunk);
 
+	/**
+	* Blocks until all stored chunks are written and all started loads are completed.
+	*/
+	void flush();
+
+	/**
+	* Loads a stored chunk and blocks until it is built. Unlike get(), it can be called from any thread and creates no GL buffers.
+	*/
+	auto read(const glm::ivec3& chunkPos) -> Chunk;
+
+	auto stats() const -> PersistenceStats;
+
+	/**
+	* The mesher of the loaded chunks. Chunks stored as delta are always remeshed, full snapshots only if stored by another mesher.
+	*/
+	void setMesher(Mesher mesher);
+
+	auto manifestStats() const -> ManifestStats;
+	auto ioStats() const -> IoStats;
+	auto ioBackend() const -> const char*;
+
 protected:
 	virtual auto getChunk(const glm::ivec3& chunkPos) -> Chunk override;
 
+	/**
+	* Reads the chunk file through the I/O backend, or maps it, and builds the chunk on a worker thread of the backend.
+	* With global::lazyDensities only the header and the mesh of a full chunk file are read, the densities when first accessed.
+	* Chunks loaded from the same payload view one copy of it in memory, until they are edited.
+	*/
+	virtual auto load(const glm::ivec3& chunkPos) -> std::future<Chunk> override;
+
 private:
+	struct PendingWrite {
+		uint64_t sequence;
+		std::shared_ptr<const std::vector<uint8_t>> bytes;
+	};
+
+	/**
+	* Counts the lazy density loads, which can happen after the serializer is destroyed
+	*/
+	struct DensityLoadCounters {
+		std::atomic<size_t> loads{0};
+		std::atomic<size_t> bytes{0};
+	};
+
+	/**
+	* Bytes in memory which stay valid as long as their owner
+	*/
+	struct SharedBytes {
+		std::shared_ptr<const void> owner;
+		const uint8_t* data = nullptr;
+		std::size_t size = 0;
+	};
+
+	enum class PayloadPart {
+		FILE,
+		MESH, // the header and the mesh sections
+		DENSITIES
+	};
+
+	/**
+	* Parts of payload files in memory by payload and part, which the chunks loaded from them view.
+	* An entry expires when the last chunk viewing it is released or edited. Used by lazy density loaders, which can outlive the serializer.
+	*/
+	class SharedPayloads {
+	public:
+		/**
+		* The part if a chunk still views it, otherwise an owner of nullptr. Payload 0 is never shared.
+		*/
+		auto find(uint64_t payload, PayloadPart part) -> SharedBytes;
+
+		/**
+		* The part in memory, loaded if no chunk views it anymore
+		*/
+		auto get(uint64_t payload, PayloadPart part, const std::function<SharedBytes()>& load) -> SharedBytes;
+		auto hits() const -> size_t;
+
+	private:
+		struct Entry {
+			std::weak_ptr<const void> owner;
+			const uint8_t* data;
+			std::size_t size;
+		};
+
+		mutable std::mutex m_mutex;
+		std::map<std::pair<uint64_t, PayloadPart>, Entry> m_entries;
+		std::size_t m_pruneSize = 64;
+		size_t m_hits = 0;
+	};
+
+	/**
+	* Writes the file of a chunk asynchronously and removes the files it replaces once written.
+	* A payload file is completed even if the chunk is stored again meanwhile, since other chunks may use it.
+	*/
+	void writeFile(IdType id, ChunkFile file, std::shared_ptr<const std::vector<uint8_t>> bytes);
+
+	/**
+	* Maps a chunk to a payload which is already stored or being written and removes the files of the chunk it replaces.
+	*/
+	void sharePayload(IdType id, ChunkFile file);
+
+	/**
+	* The bytes of a payload being written, loaded or stored, without owner if there is none. Different bytes may have the same payload hash.
+	* Reads the payload file only if its bytes are not in memory.
+	*/
+	auto storedPayload(uint64_t payload) const -> SharedBytes;
+
+	/**
+	* The files of a chunk which become obsolete when it is stored in file
+	*/
+	auto replacedFiles(IdType id, ChunkFile file) const -> std::vector<std::filesystem::path>;
+
+	/**
+	* Builds a chunk from the contents of a full chunk file. If owner is set, data is kept alive by it and the chunk views it.
+	*/
+	auto fullChunk(const glm::ivec3& chunkPos, const uint8_t* data, std::size_t size, std::shared_ptr<const void> owner, const std::filesystem::path& path) -> Chunk;
+
+	/**
+	* Reads the header and then the mesh sections of a full chunk file, the densities are read from the file when first accessed.
+	* The parts of a payload file are shared with other chunks in memory.
+	*/
+	void readMeshOnly(const glm::ivec3& chunkPos, const std::filesystem::path& path, uint64_t payload, std::function<void(std::function<Chunk()>)> finish);
+	auto meshOnlyChunk(const glm::ivec3& chunkPos, const SharedBytes& mesh, const std::filesystem::path& path, uint64_t payload) -> Chunk;
+	auto deltaChunk(const glm::ivec3& chunkPos, const uint8_t* data, std::size_t size, const std::filesystem::path& path) -> Chunk;
+
 	std::filesystem::path m_chunkDir;
 
 	/**
-	* All available chunks in the chunk directory
+	* All available chunks in the chunk directory and whether they are stored as delta to the generated densities
+	*/
+	ChunkManifest m_manifest;
+
+	std::atomic<Mesher> m_mesher{Mesher::MARCHING_CUBES};
+
+	mutable std::mutex m_mutex; // guards the pending writes and stats, which are used by the I/O threads
+	std::mutex m_fileMutex;		// orders the renames and removals of chunk files by concurrent writes, without blocking m_mutex
+	PersistenceStats m_stats;
+
+	/**
+	* The latest contents of chunks whose files are being written
+	*/
+	std::unordered_map<IdType, PendingWrite> m_pendingWrites;
+	uint64_t m_writeSequence = 0;
+
+	/**
+	* The contents of payload files being written, which chunks storing the same contents share
 	*/
-	std::unordered_set<IdType> availableChunks;
+	std::unordered_map<uint64_t, std::shared_ptr<const std::vector<uint8_t>>> m_pendingPayloads;
+
+	std::shared_ptr<DensityLoadCounters> m_densityLoads = std::make_shared<DensityLoadCounters>();
+	std::shared_ptr<SharedPayloads> m_payloads = std::make_shared<SharedPayloads>();
+
+	ChunkIO m_io; // last, so its destructor completes all requests before the members they use are destroyed
 };
@@ -0,0 +1,140 @@
+#include "CompressedChunkCache.h"
+
+#include <chrono>
+#include <type_traits>
+
+#include "Compression.h"
+#include "Profiler.h"
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	auto secondsSince(Clock::time_point start) -> double {
+		return std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	// vertices and triangles consist of 4 byte floats and integers
+	constexpr std::size_t meshElementSize = 4;
+}
+
+CompressedChunkCache::CompressedChunkCache(std::size_t budget)
+	: m_budget(budget) {}
+
+void CompressedChunkCache::insert(Chunk chunk) {
+	PROFILE_SCOPE("CompressedChunkCache::insert");
+	const auto start = Clock::now();
+	const auto chunkPos = chunk.chunkIndex();
+	if (const auto it = m_index.find(chunkPos); it != m_index.end()) {
+		m_stats.bytes -= it->second->bytes();
+		m_stats.uncompressedBytes -= it->second->uncompressedBytes;
+		m_entries.erase(it->second);
+	}
+
+	Entry e;
+	e.chunkPos = chunkPos;
+	e.faceConnectivity = chunk.faceConnectivity;
+	e.edited = chunk.edited;
+	e.uncompressedBytes = chunk.densities.byteSize() + chunk.vertices.size() * sizeof(RVertex) + chunk.triangles.size() * sizeof(glm::uvec3);
+	if (!chunk.densities.loaded() || chunk.densities.mapped())
+		e.densities = std::move(chunk.densities);
+	else {
+		e.densities = DensityGrid{chunk.densities.format()};
+		e.densityBytes = chunk.densities.byteSize();
+		e.compressedDensities = compress(chunk.densities.bytes(), e.densityBytes, formatSize(chunk.densities.format()));
+	}
+
+	const auto compressArray = [](auto& array, auto& source) {
+		array.count = source.size();
+		if (source.mapped())
+			array.mapped = std::move(source);
+		else
+			array.compressed = compress(source.data(), source.size() * sizeof(source[0]), meshElementSize);
+	};
+	compressArray(e.vertices, chunk.vertices);
+	compressArray(e.triangles, chunk.triangles);
+
+	m_entries.push_front(std::move(e));
+	m_index[chunkPos] = m_entries.begin();
+	m_stats.chunks = m_index.size();
+	m_stats.bytes += m_entries.front().bytes();
+	m_stats.uncompressedBytes += m_entries.front().uncompressedBytes;
+	m_stats.inserted++;
+	m_stats.compressSeconds += secondsSince(start);
+
+	evictOverBudget();
+}
+
+auto CompressedChunkCache::take(const glm::ivec3& chunkPos) -> std::optional<Chunk> {
+	const auto it = m_index.find(chunkPos);
+	if (it == m_index.end())
+		return {};
+
+	PROFILE_SCOPE("CompressedChunkCache::take");
+	const auto start = Clock::now();
+	auto& e = *it->second;
+	Chunk c(chunkPos);
+	if (e.densityBytes == 0)
+		c.densities = std::move(e.densities);
+	else {
+		DensityGrid::Bytes::Vector bytes(e.densityBytes);
+		decompress(e.compressedDensities.data(), e.compressedDensities.size(), bytes.data(), bytes.size(), formatSize(e.densities.format()));
+		c.densities = DensityGrid::fromEncoded(e.densities.format(), std::move(bytes));
+	}
+
+	const auto decompressArray = [](auto& array, auto& target) {
+		if (array.mapped.mapped() || array.compressed.empty()) {
+			target = std::move(array.mapped);
+			return;
+		}
+		typename std::decay_t<decltype(target)>::Vector elements(array.count);
+		decompress(array.compressed.data(), array.compressed.size(), elements.data(), elements.size() * sizeof(elements[0]), meshElementSize);
+		target = std::move(elements);
+	};
+	decompressArray(e.vertices, c.vertices);
+	decompressArray(e.triangles, c.triangles);
+	c.faceConnectivity = e.faceConnectivity;
+	c.edited = e.edited;
+
+	m_stats.bytes -= e.bytes();
+	m_stats.uncompressedBytes -= e.uncompressedBytes;
+	m_entries.erase(it->second);
+	m_index.erase(it);
+	m_stats.chunks = m_index.size();
+	m_stats.hits++;
+	m_stats.decompressSeconds += secondsSince(start);
+	return c;
+}
+
+void CompressedChunkCache::setBudget(std::size_t budget) {
+	m_budget = budget;
+	evictOverBudget();
+}
+
+void CompressedChunkCache::clear() {
+	m_entries.clear();
+	m_index.clear();
+	m_stats.chunks = 0;
+	m_stats.bytes = 0;
+	m_stats.uncompressedBytes = 0;
+}
+
+auto CompressedChunkCache::stats() const -> CompressedCacheStats {
+	return m_stats;
+}
+
+auto CompressedChunkCache::Entry::bytes() const -> std::size_t {
+	// the entry itself counts as well, so chunks kept entirely in mapped files are limited too
+	return sizeof(Entry) + compressedDensities.size() + vertices.compressed.size() + triangles.compressed.size();
+}
+
+void CompressedChunkCache::evictOverBudget() {
+	while (m_stats.bytes > m_budget && !m_entries.empty()) {
+		const auto& e = m_entries.back();
+		m_stats.bytes -= e.bytes();
+		m_stats.uncompressedBytes -= e.uncompressedBytes;
+		m_index.erase(e.chunkPos);
+		m_entries.pop_back();
+		m_stats.evicted++;
+	}
+	m_stats.chunks = m_index.size();
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+
+#include "Chunk.h"
+
+struct CompressedCacheStats {
+	std::size_t chunks = 0;
+	std::size_t bytes = 0; // compressed, which the budget limits
+	std::size_t uncompressedBytes = 0; // of the same chunks
+	std::size_t inserted = 0;
+	std::size_t hits = 0; // chunks taken back
+	std::size_t evicted = 0; // dropped to stay within the budget
+	double compressSeconds = 0; // summed over all inserted chunks
+	double decompressSeconds = 0; // summed over all hits
+};
+
+/**
+* Keeps chunks which left the loaded chunks in memory, compressed, so returning to them does not read the disk or generate them again.
+* Parts of a chunk which are still viewed in a mapped file or were never loaded take no heap and are kept as they are.
+* Beyond the byte budget, the chunks inserted longest ago are dropped.
+*/
+class CompressedChunkCache final {
+public:
+	explicit CompressedChunkCache(std::size_t budget);
+
+	void insert(Chunk chunk);
+
+	/**
+	* Removes the chunk from the cache and decompresses it.
+	*/
+	auto take(const glm::ivec3& chunkPos) -> std::optional<Chunk>;
+
+	void setBudget(std::size_t budget);
+	void clear();
+	auto stats() const -> CompressedCacheStats;
+
+private:
+	template <typename Array>
+	struct CompressedArray {
+		Array mapped;
+		std::vector<uint8_t> compressed;
+		std::size_t count = 0;
+	};
+
+	struct Entry {
+		glm::ivec3 chunkPos;
+		DensityGrid densities; // kept if mapped or not loaded yet, otherwise empty in the format of the compressed densities
+		std::vector<uint8_t> compressedDensities;
+		std::size_t densityBytes = 0;
+		CompressedArray<Chunk::Vertices> vertices;
+		CompressedArray<Chunk::Triangles> triangles;
+		std::array<uint8_t, 6> faceConnectivity;
+		bool edited;
+		std::size_t uncompressedBytes;
+
+		auto bytes() const -> std::size_t;
+	};
+
+	void evictOverBudget();
+
+	std::size_t m_budget;
+	TrackedList<Entry, MemoryTag::CHUNK_MAPS> m_entries; // most recently inserted first
+	TrackedMap<glm::ivec3, TrackedList<Entry, MemoryTag::CHUNK_MAPS>::iterator, MemoryTag::CHUNK_MAPS> m_index;
+	CompressedCacheStats m_stats;
+};
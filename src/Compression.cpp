@@ -0,0 +1,146 @@
+#include "Compression.h"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+namespace {
+	constexpr std::size_t minMatch = 4;
+	constexpr std::size_t maxOffset = 0xFFFF;
+	constexpr auto hashBits = 12;
+
+	auto load32(const uint8_t* p) -> uint32_t {
+		uint32_t v;
+		std::memcpy(&v, p, sizeof(v));
+		return v;
+	}
+
+	auto hash(uint32_t v) -> uint32_t {
+		return (v * 2654435761u) >> (32 - hashBits);
+	}
+
+	// lengths beyond 15 continue in bytes of 255, ended by a smaller byte
+	void writeLength(std::vector<uint8_t>& out, std::size_t length) {
+		for (; length >= 255; length -= 255)
+			out.push_back(255);
+		out.push_back(static_cast<uint8_t>(length));
+	}
+
+	void writeSequence(std::vector<uint8_t>& out, const uint8_t* literals, std::size_t literalCount, std::size_t offset, std::size_t matchLength) {
+		const auto matchCode = matchLength >= minMatch ? matchLength - minMatch : 0;
+		out.push_back(static_cast<uint8_t>((std::min<std::size_t>(literalCount, 15) << 4) | std::min<std::size_t>(matchCode, 15)));
+		if (literalCount >= 15)
+			writeLength(out, literalCount - 15);
+		out.insert(out.end(), literals, literals + literalCount);
+		if (matchLength == 0)
+			return; // the last sequence has literals only
+		out.push_back(static_cast<uint8_t>(offset));
+		out.push_back(static_cast<uint8_t>(offset >> 8));
+		if (matchCode >= 15)
+			writeLength(out, matchCode - 15);
+	}
+
+	auto compressBytes(const uint8_t* in, std::size_t size) -> std::vector<uint8_t> {
+		std::vector<uint8_t> out;
+		out.reserve(size + size / 255 + 16);
+		std::array<uint32_t, 1 << hashBits> table{}; // position + 1 of the last occurrence of each hash, 0 if none
+
+		std::size_t anchor = 0;
+		std::size_t i = 0;
+		while (i + minMatch <= size) {
+			const auto sequence = load32(in + i);
+			auto& slot = table[hash(sequence)];
+			const auto candidate = static_cast<std::size_t>(slot);
+			slot = static_cast<uint32_t>(i + 1);
+			if (candidate == 0 || i - (candidate - 1) > maxOffset || load32(in + candidate - 1) != sequence) {
+				i += 1 + ((i - anchor) >> 6); // skip faster through incompressible data
+				continue;
+			}
+
+			const auto match = candidate - 1;
+			auto length = minMatch;
+			while (i + length < size && in[match + length] == in[i + length])
+				length++;
+			writeSequence(out, in + anchor, i - anchor, i - match, length);
+			i += length;
+			anchor = i;
+		}
+		writeSequence(out, in + anchor, size - anchor, 0, 0);
+		return out;
+	}
+
+	void decompressBytes(const uint8_t* in, std::size_t inSize, uint8_t* out, std::size_t size) {
+		const auto corrupt = [] { throw std::runtime_error("corrupt compressed data"); };
+		const auto* end = in + inSize;
+		const auto readLength = [&](std::size_t length) {
+			if (length < 15)
+				return length;
+			for (uint8_t b = 255; b == 255; length += b) {
+				if (in == end)
+					corrupt();
+				b = *in++;
+			}
+			return length;
+		};
+
+		std::size_t o = 0;
+		while (in < end) {
+			const auto token = *in++;
+			const auto literals = readLength(token >> 4);
+			if (literals > static_cast<std::size_t>(end - in) || literals > size - o)
+				corrupt();
+			std::memcpy(out + o, in, literals);
+			in += literals;
+			o += literals;
+			if (in == end)
+				break;
+
+			if (end - in < 2)
+				corrupt();
+			const std::size_t offset = in[0] | (in[1] << 8);
+			in += 2;
+			const auto length = readLength(token & 15) + minMatch;
+			if (offset == 0 || offset > o || length > size - o)
+				corrupt();
+			// byte by byte, matches may overlap the bytes they produce
+			const auto* from = out + o - offset;
+			for (std::size_t k = 0; k < length; k++)
+				out[o + k] = from[k];
+			o += length;
+		}
+		if (o != size)
+			corrupt();
+	}
+}
+
+auto compress(const void* data, std::size_t size, std::size_t elementSize) -> std::vector<uint8_t> {
+	const auto* bytes = static_cast<const uint8_t*>(data);
+	if (elementSize <= 1)
+		return compressBytes(bytes, size);
+
+	// byte k of element i goes to k * count + i, trailing bytes of an incomplete element stay at the end
+	const auto count = size / elementSize;
+	std::vector<uint8_t> shuffled(size);
+	for (std::size_t i = 0; i < count; i++)
+		for (std::size_t k = 0; k < elementSize; k++)
+			shuffled[k * count + i] = bytes[i * elementSize + k];
+	std::memcpy(shuffled.data() + count * elementSize, bytes + count * elementSize, size - count * elementSize);
+	return compressBytes(shuffled.data(), size);
+}
+
+void decompress(const uint8_t* compressed, std::size_t compressedSize, void* out, std::size_t size, std::size_t elementSize) {
+	auto* bytes = static_cast<uint8_t*>(out);
+	if (elementSize <= 1) {
+		decompressBytes(compressed, compressedSize, bytes, size);
+		return;
+	}
+
+	std::vector<uint8_t> shuffled(size);
+	decompressBytes(compressed, compressedSize, shuffled.data(), size);
+	const auto count = size / elementSize;
+	for (std::size_t i = 0; i < count; i++)
+		for (std::size_t k = 0; k < elementSize; k++)
+			bytes[i * elementSize + k] = shuffled[k * count + i];
+	std::memcpy(bytes + count * elementSize, shuffled.data() + count * elementSize, size - count * elementSize);
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+* A byte oriented LZ77 codec in the style of LZ4: literal runs and back references of at least 4 bytes within 64 KiB,
+* found through a small hash table. It trades ratio for speed, decompression runs at memory speed.
+* With an elementSize above 1, the bytes of each significance are grouped first (byte shuffling),
+* so arrays of floats and integers expose their repetitive high bytes to the matcher.
+*/
+auto compress(const void* data, std::size_t size, std::size_t elementSize = 1) -> std::vector<uint8_t>;
+
+/**
+* Restores exactly size bytes compressed with the same elementSize. Throws std::runtime_error on corrupt input.
+*/
+void decompress(const uint8_t* compressed, std::size_t compressedSize, void* out, std::size_t size, std::size_t elementSize = 1);
@@ -0,0 +1,378 @@
+#include "DensityGraph.h"
+
+#include <stb_perlin.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+#include "IO.h"
+#include "utils.h"
+
+namespace {
+	const auto defaultSource = R"(# the inclined plane used before density graphs existed: 0.5 - z + 0.1 x
+slope = mul x 0.1
+height = add slope 0.5
+density = sub height z
+)";
+
+	// Every gradient of stb_perlin has two components of magnitude 1 and the offsets to the cell corners are at most 1 per axis,
+	// so each corner term, and thus their interpolation, lies within this bound.
+	constexpr auto noiseBound = 2.0f;
+
+	// A bound on the gradient length of stb_perlin_noise3. The interpolated corner gradients contribute at most sqrt(2).
+	// The derivatives of the fade weights sum to at most 2 * 1.875 per axis, times corner terms of at most 2, contributing sqrt(3) * 7.5.
+	constexpr auto noiseLipschitz = 14.5f;
+
+	using Interval = DensityGraph::Interval;
+
+	auto operator+(Interval a, Interval b) -> Interval {
+		return {a.lower + b.lower, a.upper + b.upper};
+	}
+
+	auto operator-(Interval a, Interval b) -> Interval {
+		return {a.lower - b.upper, a.upper - b.lower};
+	}
+
+	auto operator*(Interval a, Interval b) -> Interval {
+		const auto p = {a.lower * b.lower, a.lower * b.upper, a.upper * b.lower, a.upper * b.upper};
+		return {std::min(p), std::max(p)};
+	}
+
+	auto center(Interval a) {
+		return (a.lower + a.upper) / 2;
+	}
+
+	auto radius(Interval a) {
+		return (a.upper - a.lower) / 2;
+	}
+
+	// Bounds single octave noise at coordinates within x, y and z by its range and by its value in the center and the Lipschitz bound.
+	auto noiseBounds(Interval x, Interval y, Interval z, float frequency) -> Interval {
+		const auto value = stb_perlin_noise3(center(x) * frequency, center(y) * frequency, center(z) * frequency, 0, 0, 0);
+		const auto halfDiagonal = std::sqrt(radius(x) * radius(x) + radius(y) * radius(y) + radius(z) * radius(z)) * std::abs(frequency);
+		const auto deviation = noiseLipschitz * halfDiagonal;
+		return {std::max(-noiseBound, value - deviation), std::min(noiseBound, value + deviation)};
+	}
+
+	// The sum of the octave amplitudes of stb_perlin's fbm and turbulence noise.
+	auto octaveAmplitude(float octaves, float gain) {
+		auto sum = 0.0f;
+		auto amplitude = 1.0f;
+		for (auto i = 0; i < static_cast<int>(octaves); i++) {
+			sum += std::abs(amplitude);
+			amplitude *= gain;
+		}
+		return sum;
+	}
+
+	enum : uint16_t {
+		xRegister,
+		yRegister,
+		zRegister,
+		firstFreeRegister
+	};
+}
+
+auto DensityGraph::parse(const std::string& source) -> DensityGraph {
+	struct OpInfo {
+		Op op;
+		int inputs;
+		int params;
+		std::array<float, 4> defaults;
+	};
+	static const std::map<std::string, OpInfo> ops = {
+		{"add", {Op::ADD, 2, 0, {}}},
+		{"sub", {Op::SUB, 2, 0, {}}},
+		{"mul", {Op::MUL, 2, 0, {}}},
+		{"min", {Op::MIN, 2, 0, {}}},
+		{"max", {Op::MAX, 2, 0, {}}},
+		{"abs", {Op::ABS, 1, 0, {}}},
+		{"clamp", {Op::CLAMP, 3, 0, {}}},
+		{"blend", {Op::BLEND, 3, 0, {}}},
+		{"perlin", {Op::PERLIN, 3, 1, {1}}},
+		{"fbm", {Op::FBM, 3, 4, {1, 6, 2, 0.5f}}},
+		{"turbulence", {Op::TURBULENCE, 3, 4, {1, 6, 2, 0.5f}}},
+		{"warp", {Op::WARP, 4, 3, {1, 1, 0}}},
+	};
+
+	DensityGraph g;
+	g.registerCount = firstFreeRegister;
+
+	std::unordered_map<std::string, uint16_t> nodes = {{"x", xRegister}, {"y", yRegister}, {"z", zRegister}};
+	std::unordered_map<uint16_t, float> constantValues;
+	std::map<float, uint16_t> constantRegisters;
+
+	const auto constantRegister = [&](float value) {
+		if (const auto it = constantRegisters.find(value); it != constantRegisters.end())
+			return it->second;
+		const auto r = static_cast<uint16_t>(g.registerCount++);
+		g.constants.push_back({Op::CONSTANT, r, {}, {value}, std::to_string(value)});
+		constantRegisters[value] = r;
+		constantValues[r] = value;
+		return r;
+	};
+
+	std::istringstream lines{source};
+	std::string line;
+	std::optional<uint16_t> outputNode;
+	for (int lineNumber = 1; std::getline(lines, line); lineNumber++) {
+		const auto fail = [&](const std::string& message) {
+			throw std::runtime_error("density graph line " + std::to_string(lineNumber) + ": " + message);
+		};
+
+		line = line.substr(0, line.find('#'));
+		std::istringstream tokenStream{line};
+		std::vector<std::string> tokens{std::istream_iterator<std::string>{tokenStream}, std::istream_iterator<std::string>{}};
+		if (tokens.empty())
+			continue;
+		if (tokens.size() < 3 || tokens[1] != "=")
+			fail("expected: name = op arguments...");
+
+		const auto& name = tokens[0];
+		if (nodes.count(name))
+			fail("node " + name + " is already defined");
+		const auto opIt = ops.find(tokens[2]);
+		if (opIt == ops.end())
+			fail("unknown op " + tokens[2]);
+		const auto& info = opIt->second;
+
+		const auto args = std::vector<std::string>(tokens.begin() + 3, tokens.end());
+		if (args.size() < static_cast<std::size_t>(info.inputs) || args.size() > static_cast<std::size_t>(info.inputs + info.params))
+			fail(tokens[2] + " takes " + std::to_string(info.inputs) + " inputs and up to " + std::to_string(info.params) + " parameters");
+
+		Instruction in{info.op, 0, {}, info.defaults, name};
+		bool allConstant = true;
+		for (std::size_t i = 0; i < args.size(); i++) {
+			char* end = nullptr;
+			const auto number = std::strtof(args[i].c_str(), &end);
+			const auto isNumber = *end == '\0';
+			if (i < static_cast<std::size_t>(info.inputs)) {
+				if (isNumber)
+					in.src[i] = constantRegister(number);
+				else if (const auto it = nodes.find(args[i]); it != nodes.end())
+					in.src[i] = it->second;
+				else
+					fail("unknown node " + args[i]);
+				allConstant &= constantValues.count(in.src[i]) > 0;
+			} else {
+				if (!isNumber)
+					fail("parameter " + args[i] + " is not a number");
+				in.params[i - info.inputs] = number;
+			}
+		}
+
+		if (allConstant) {
+			// fold nodes with only constant inputs
+			std::vector<float> registers(g.registerCount * batchSize + batchSize);
+			for (const auto& [r, value] : constantValues)
+				registers[r * batchSize] = value;
+			in.dst = static_cast<uint16_t>(g.registerCount);
+			run(in, registers.data(), 1);
+			nodes[name] = constantRegister(registers[in.dst * batchSize]);
+		} else {
+			in.dst = static_cast<uint16_t>(g.registerCount++);
+			nodes[name] = in.dst;
+			g.program.push_back(in);
+		}
+		outputNode = nodes[name];
+		if (name == "density")
+			break;
+	}
+
+	if (!outputNode)
+		throw std::runtime_error("density graph has no nodes");
+	g.output = *outputNode;
+
+	// remove the nodes the output does not depend on
+	std::vector<bool> needed(g.registerCount);
+	needed[g.output] = true;
+	for (auto it = g.program.rbegin(); it != g.program.rend(); ++it)
+		if (needed[it->dst])
+			for (const auto src : it->src)
+				needed[src] = true;
+	const auto unneeded = [&](const Instruction& in) { return !needed[in.dst]; };
+	g.program.erase(std::remove_if(g.program.begin(), g.program.end(), unneeded), g.program.end());
+	g.constants.erase(std::remove_if(g.constants.begin(), g.constants.end(), unneeded), g.constants.end());
+
+	return g;
+}
+
+auto DensityGraph::load(const std::filesystem::path& file) -> DensityGraph {
+	try {
+		return parse(readTextFile(file));
+	} catch (const std::exception& e) {
+		throw std::runtime_error(file.string() + ": " + e.what());
+	}
+}
+
+auto DensityGraph::defaultGraph() -> DensityGraph {
+	return parse(defaultSource);
+}
+
+void DensityGraph::run(const Instruction& in, float* registers, std::size_t count) {
+	float* d = registers + in.dst * batchSize;
+	const float* a = registers + in.src[0] * batchSize;
+	const float* b = registers + in.src[1] * batchSize;
+	const float* c = registers + in.src[2] * batchSize;
+	const float* e = registers + in.src[3] * batchSize;
+	const auto& p = in.params;
+
+	switch (in.op) {
+		case Op::CONSTANT: std::fill_n(d, count, p[0]); break;
+		case Op::ADD: for (std::size_t i = 0; i < count; i++) d[i] = a[i] + b[i]; break;
+		case Op::SUB: for (std::size_t i = 0; i < count; i++) d[i] = a[i] - b[i]; break;
+		case Op::MUL: for (std::size_t i = 0; i < count; i++) d[i] = a[i] * b[i]; break;
+		case Op::MIN: for (std::size_t i = 0; i < count; i++) d[i] = std::min(a[i], b[i]); break;
+		case Op::MAX: for (std::size_t i = 0; i < count; i++) d[i] = std::max(a[i], b[i]); break;
+		case Op::ABS: for (std::size_t i = 0; i < count; i++) d[i] = std::abs(a[i]); break;
+		case Op::CLAMP: for (std::size_t i = 0; i < count; i++) d[i] = std::min(std::max(a[i], b[i]), c[i]); break;
+		case Op::BLEND: for (std::size_t i = 0; i < count; i++) d[i] = a[i] + (b[i] - a[i]) * c[i]; break;
+		case Op::PERLIN:
+			for (std::size_t i = 0; i < count; i++)
+				d[i] = stb_perlin_noise3(a[i] * p[0], b[i] * p[0], c[i] * p[0], 0, 0, 0);
+			break;
+		case Op::FBM:
+			for (std::size_t i = 0; i < count; i++)
+				d[i] = stb_perlin_fbm_noise3(a[i] * p[0], b[i] * p[0], c[i] * p[0], p[2], p[3], static_cast<int>(p[1]));
+			break;
+		case Op::TURBULENCE:
+			for (std::size_t i = 0; i < count; i++)
+				d[i] = stb_perlin_turbulence_noise3(a[i] * p[0], b[i] * p[0], c[i] * p[0], p[2], p[3], static_cast<int>(p[1]));
+			break;
+		case Op::WARP: // displaces a, which is a coordinate for domain warps
+			for (std::size_t i = 0; i < count; i++)
+				d[i] = a[i] + p[0] * stb_perlin_noise3((b[i] + p[2]) * p[1], (c[i] + p[2]) * p[1], (e[i] + p[2]) * p[1], 0, 0, 0);
+			break;
+	}
+}
+
+void DensityGraph::evaluate(const float* x, const float* y, const float* z, float* out, std::size_t count) const {
+	thread_local std::vector<float> registers;
+	registers.resize(registerCount * batchSize);
+
+	for (const auto& in : constants)
+		run(in, registers.data(), batchSize);
+
+	for (std::size_t first = 0; first < count; first += batchSize) {
+		const auto n = std::min(batchSize, count - first);
+		std::copy_n(x + first, n, registers.data() + xRegister * batchSize);
+		std::copy_n(y + first, n, registers.data() + yRegister * batchSize);
+		std::copy_n(z + first, n, registers.data() + zRegister * batchSize);
+		for (const auto& in : program)
+			run(in, registers.data(), n);
+		std::copy_n(registers.data() + output * batchSize, n, out + first);
+	}
+}
+
+auto DensityGraph::evaluate(glm::vec3 pos) const -> float {
+	float result;
+	evaluate(&pos.x, &pos.y, &pos.z, &result, 1);
+	return result;
+}
+
+auto DensityGraph::profile(std::size_t samples) const -> std::vector<NodeCost> {
+	using Clock = std::chrono::high_resolution_clock;
+
+	std::vector<float> registers(registerCount * batchSize);
+	for (const auto& in : constants)
+		run(in, registers.data(), batchSize);
+
+	std::mt19937 rng(42);
+	std::uniform_real_distribution<float> coord(-100, 100);
+	std::vector<Clock::duration> durations(program.size());
+	for (std::size_t done = 0; done < samples; done += batchSize) {
+		std::generate_n(registers.begin(), 3 * batchSize, [&] { return coord(rng); });
+		for (std::size_t i = 0; i < program.size(); i++) {
+			const auto start = Clock::now();
+			run(program[i], registers.data(), batchSize);
+			durations[i] += Clock::now() - start;
+		}
+	}
+
+	static const char* opNames[] = {"constant", "add", "sub", "mul", "min", "max", "abs", "clamp", "blend", "perlin", "fbm", "turbulence", "warp"};
+	std::vector<NodeCost> costs;
+	for (std::size_t i = 0; i < program.size(); i++)
+		costs.push_back({program[i].node, opNames[static_cast<int>(program[i].op)], std::chrono::duration<double, std::nano>(durations[i]).count() / samples});
+	return costs;
+}
+
+auto DensityGraph::bound(const Instruction& in, const Interval* registers) -> Interval {
+	const auto a = registers[in.src[0]];
+	const auto b = registers[in.src[1]];
+	const auto c = registers[in.src[2]];
+	const auto e = registers[in.src[3]];
+	const auto& p = in.params;
+
+	switch (in.op) {
+		case Op::CONSTANT: return {p[0], p[0]};
+		case Op::ADD: return a + b;
+		case Op::SUB: return a - b;
+		case Op::MUL: return a * b;
+		case Op::MIN: return {std::min(a.lower, b.lower), std::min(a.upper, b.upper)};
+		case Op::MAX: return {std::max(a.lower, b.lower), std::max(a.upper, b.upper)};
+		case Op::ABS:
+			if (a.lower >= 0) return a;
+			if (a.upper <= 0) return {-a.upper, -a.lower};
+			return {0, std::max(-a.lower, a.upper)};
+		case Op::CLAMP: return {std::min(std::max(a.lower, b.lower), c.lower), std::min(std::max(a.upper, b.upper), c.upper)};
+		case Op::BLEND: return a + (b - a) * c;
+		case Op::PERLIN: return noiseBounds(a, b, c, p[0]);
+		case Op::FBM: {
+			const auto amplitude = noiseBound * octaveAmplitude(p[1], p[3]);
+			return {-amplitude, amplitude};
+		}
+		case Op::TURBULENCE: return {0, noiseBound * octaveAmplitude(p[1], p[3])};
+		case Op::WARP: {
+			const auto offset = Interval{p[2], p[2]};
+			return a + Interval{p[0], p[0]} * noiseBounds(b + offset, c + offset, e + offset, p[1]);
+		}
+	}
+	return {-std::numeric_limits<float>::infinity(), std::numeric_limits<float>::infinity()};
+}
+
+auto DensityGraph::bounds(const BoundingBox& box) const -> Interval {
+	thread_local std::vector<Interval> registers;
+	registers.resize(registerCount);
+
+	registers[xRegister] = {box.lower.x, box.upper.x};
+	registers[yRegister] = {box.lower.y, box.upper.y};
+	registers[zRegister] = {box.lower.z, box.upper.z};
+	for (const auto& in : constants)
+		registers[in.dst] = bound(in, registers.data());
+	for (const auto& in : program)
+		registers[in.dst] = bound(in, registers.data());
+	return registers[output];
+}
+
+auto DensityGraph::instructionCount() const -> std::size_t {
+	return program.size();
+}
+
+auto DensityGraph::fingerprint() const -> uint64_t {
+	std::vector<uint32_t> words;
+	for (const auto* instructions : {&constants, &program}) {
+		for (const auto& in : *instructions) {
+			words.push_back(static_cast<uint32_t>(in.op));
+			words.push_back(in.dst);
+			words.insert(words.end(), in.src.begin(), in.src.end());
+			for (const auto param : in.params) {
+				uint32_t bits;
+				std::memcpy(&bits, &param, sizeof(bits));
+				words.push_back(bits);
+			}
+		}
+		words.push_back(~0u); // separates the constants from the program
+	}
+	words.push_back(output);
+	return hashBytes(words.data(), words.size() * sizeof(words[0]));
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "geometry.h"
+
+/**
+* A density function composed of nodes (coordinates, noise primitives, domain warp, blend, clamp, arithmetic),
+* compiled into a small bytecode program. Each instruction processes a whole batch of samples at once,
+* so its inner loop runs over contiguous lanes and the dispatch cost is amortized over the batch.
+*
+* The source has one node per line: name = op arg... Arguments are previously defined node names, x, y, z or numbers.
+* Trailing numbers of noise and warp nodes are parameters. The node called density, or else the last node, is the output.
+*
+*     # rolling hills
+*     hills = fbm x y 0 0.02 4
+*     height = mul hills 8
+*     density = sub height z
+*
+* Ops: add a b, sub a b, mul a b, min a b, max a b, abs a, clamp v lo hi, blend a b t (a + (b - a) * t),
+* perlin x y z [frequency], fbm/turbulence x y z [frequency octaves lacunarity gain],
+* warp c x y z [amount frequency offset] (the coordinate c displaced by amount * perlin noise at the offset position).
+*
+* A domain warp displaces each coordinate, with different offsets so the displacements differ, and feeds the warped coordinates
+* to the nodes using them instead of x, y and z:
+*
+*     wx = warp x x y z 4 0.05 0
+*     wy = warp y x y z 4 0.05 37
+*     wz = warp z x y z 4 0.05 71
+*     hills = fbm wx wy 0 0.02 4
+*/
+class DensityGraph final {
+public:
+	static constexpr std::size_t batchSize = 64;
+
+	/**
+	* Compiles the source. Throws std::runtime_error naming the line on errors.
+	*/
+	static auto parse(const std::string& source) -> DensityGraph;
+	static auto load(const std::filesystem::path& file) -> DensityGraph;
+	static auto defaultGraph() -> DensityGraph;
+
+	/**
+	* Evaluates the density at count positions given as separate coordinate arrays.
+	*/
+	void evaluate(const float* x, const float* y, const float* z, float* out, std::size_t count) const;
+	auto evaluate(glm::vec3 pos) const -> float;
+
+	struct NodeCost {
+		std::string node;
+		std::string op;
+		double nanosecondsPerSample;
+	};
+
+	/**
+	* Measures the time spent in each instruction over the given number of random samples.
+	*/
+	auto profile(std::size_t samples) const -> std::vector<NodeCost>;
+
+	auto instructionCount() const -> std::size_t;
+
+	/**
+	* A hash of the compiled instructions, equal for graphs computing the same densities the same way. Node names are ignored.
+	*/
+	auto fingerprint() const -> uint64_t;
+
+	struct Interval {
+		float lower;
+		float upper;
+	};
+
+	/**
+	* Conservative bounds of the density over the box, computed by interval arithmetic over the nodes.
+	* If both bounds have the same sign, the surface does not pass through the box.
+	*/
+	auto bounds(const BoundingBox& box) const -> Interval;
+
+private:
+	enum class Op : uint8_t {
+		CONSTANT,
+		ADD,
+		SUB,
+		MUL,
+		MIN,
+		MAX,
+		ABS,
+		CLAMP,
+		BLEND,
+		PERLIN,
+		FBM,
+		TURBULENCE,
+		WARP
+	};
+
+	struct Instruction {
+		Op op;
+		uint16_t dst;
+		std::array<uint16_t, 4> src;
+		std::array<float, 4> params;
+		std::string node;
+	};
+
+	static void run(const Instruction& in, float* registers, std::size_t count);
+	static auto bound(const Instruction& in, const Interval* registers) -> Interval;
+
+	std::vector<Instruction> constants; // run once per evaluate call
+	std::vector<Instruction> program;   // run once per batch
+	std::size_t registerCount = 0;
+	uint16_t output = 0;
+};
@@ -0,0 +1,305 @@
+#include "DensityGrid.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "simd.h"
+
+namespace {
+	template <typename T>
+	auto bitCast(const void* p) {
+		T t;
+		std::memcpy(&t, p, sizeof(T));
+		return t;
+	}
+
+	auto floatToHalf(float f) -> uint16_t {
+		const auto x = bitCast<uint32_t>(&f);
+		const auto sign = static_cast<uint16_t>((x >> 16) & 0x8000);
+		const auto floatExponent = static_cast<int>((x >> 23) & 0xFF);
+		const auto exponent = floatExponent - 127 + 15;
+		uint32_t mantissa = x & 0x7FFFFF;
+
+		if (floatExponent == 0xFF)
+			return sign | 0x7C00 | (mantissa ? 0x200 : 0); // inf or nan
+		if (exponent >= 31)
+			return sign | 0x7C00; // overflow to inf
+		if (exponent <= 0) {
+			// subnormal half
+			if (exponent < -10)
+				return sign;
+			mantissa |= 0x800000;
+			const auto shift = 14 - exponent;
+			uint32_t h = mantissa >> shift;
+			const auto rest = mantissa & ((1u << shift) - 1);
+			const auto halfway = 1u << (shift - 1);
+			if (rest > halfway || (rest == halfway && (h & 1)))
+				h++;
+			return static_cast<uint16_t>(sign | h);
+		}
+
+		uint32_t h = (static_cast<uint32_t>(exponent) << 10) | (mantissa >> 13);
+		const auto rest = mantissa & 0x1FFF;
+		if (rest > 0x1000 || (rest == 0x1000 && (h & 1)))
+			h++; // a carry into the exponent rounds correctly, up to inf
+		return static_cast<uint16_t>(sign | h);
+	}
+
+	auto halfToFloat(uint16_t h) -> float {
+		constexpr uint32_t shiftedExponent = 0x7C00 << 13;
+		uint32_t o = (h & 0x7FFFu) << 13;
+		const auto exponent = o & shiftedExponent;
+		o += (127 - 15) << 23;
+		if (exponent == shiftedExponent)
+			o += (128 - 16) << 23; // inf or nan
+		else if (exponent == 0) {
+			// subnormal, renormalize
+			o += 1 << 23;
+			constexpr uint32_t magic = 113 << 23;
+			const auto f = bitCast<float>(&o) - bitCast<float>(&magic);
+			o = bitCast<uint32_t>(&f);
+		}
+		o |= (h & 0x8000u) << 16;
+		return bitCast<float>(&o);
+	}
+
+	template <typename T>
+	constexpr auto normalizedMax() {
+		return static_cast<float>((1 << (8 * sizeof(T) - 1)) - 1);
+	}
+
+	template <typename T>
+	auto encodeNormalized(float f) -> T {
+		constexpr auto max = normalizedMax<T>();
+		const auto q = std::round(std::clamp(f / DensityGrid::normalizedRange, -1.0f, 1.0f) * max);
+		if (f > 0 && q == 0)
+			return 1; // keep small positive densities solid
+		return static_cast<T>(q);
+	}
+
+	template <typename T>
+	auto decodeNormalized(T t) -> float {
+		return t * (DensityGrid::normalizedRange / normalizedMax<T>());
+	}
+
+	auto encode(DensityFormat format, float f, uint8_t* p) {
+		switch (format) {
+			case DensityFormat::FLOAT: std::memcpy(p, &f, sizeof(f)); break;
+			case DensityFormat::HALF: {
+				auto h = floatToHalf(f);
+				if (f > 0 && (h & 0x7FFF) == 0)
+					h = 1; // keep small positive densities solid
+				std::memcpy(p, &h, sizeof(h));
+				break;
+			}
+			case DensityFormat::INT16: {
+				const auto i = encodeNormalized<int16_t>(f);
+				std::memcpy(p, &i, sizeof(i));
+				break;
+			}
+			case DensityFormat::INT8: *p = static_cast<uint8_t>(encodeNormalized<int8_t>(f)); break;
+		}
+	}
+
+	auto decode(DensityFormat format, const uint8_t* p) -> float {
+		switch (format) {
+			case DensityFormat::FLOAT: return bitCast<float>(p);
+			case DensityFormat::HALF: return halfToFloat(bitCast<uint16_t>(p));
+			case DensityFormat::INT16: return decodeNormalized(bitCast<int16_t>(p));
+			case DensityFormat::INT8: return decodeNormalized(static_cast<int8_t>(*p));
+		}
+		return 0;
+	}
+
+#ifdef DPG_SSE2
+	void decode4(DensityFormat format, const uint8_t* p, float* out) {
+		switch (format) {
+			case DensityFormat::FLOAT:
+				_mm_storeu_ps(out, _mm_loadu_ps(reinterpret_cast<const float*>(p)));
+				break;
+			case DensityFormat::HALF: {
+				// half to float by rescaling the exponent with a multiplication, which also handles subnormals
+				const auto h = _mm_unpacklo_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p)), _mm_setzero_si128());
+				const auto exponentMantissa = _mm_and_si128(h, _mm_set1_epi32(0x7FFF));
+				const auto sign = _mm_slli_epi32(_mm_xor_si128(h, exponentMantissa), 16);
+				const auto scaled = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(exponentMantissa, 13)), _mm_castsi128_ps(_mm_set1_epi32((254 - 15) << 23)));
+				const auto infNan = _mm_and_si128(_mm_cmpgt_epi32(exponentMantissa, _mm_set1_epi32(0x7BFF)), _mm_set1_epi32(255 << 23));
+				_mm_storeu_ps(out, _mm_or_ps(scaled, _mm_castsi128_ps(_mm_or_si128(sign, infNan))));
+				break;
+			}
+			case DensityFormat::INT16: {
+				const auto i = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+				const auto i32 = _mm_srai_epi32(_mm_unpacklo_epi16(i, i), 16);
+				_mm_storeu_ps(out, _mm_mul_ps(_mm_cvtepi32_ps(i32), _mm_set1_ps(DensityGrid::normalizedRange / normalizedMax<int16_t>())));
+				break;
+			}
+			case DensityFormat::INT8: {
+				auto i = _mm_cvtsi32_si128(bitCast<int>(p));
+				i = _mm_unpacklo_epi8(i, i);
+				const auto i32 = _mm_srai_epi32(_mm_unpacklo_epi16(i, i), 24);
+				_mm_storeu_ps(out, _mm_mul_ps(_mm_cvtepi32_ps(i32), _mm_set1_ps(DensityGrid::normalizedRange / normalizedMax<int8_t>())));
+				break;
+			}
+		}
+	}
+#endif
+}
+
+auto formatName(DensityFormat format) -> const char* {
+	switch (format) {
+		case DensityFormat::FLOAT: return "float";
+		case DensityFormat::HALF: return "half";
+		case DensityFormat::INT16: return "int16";
+		case DensityFormat::INT8: return "int8";
+	}
+	return "unknown";
+}
+
+auto formatSize(DensityFormat format) -> std::size_t {
+	switch (format) {
+		case DensityFormat::FLOAT: return 4;
+		case DensityFormat::HALF: return 2;
+		case DensityFormat::INT16: return 2;
+		case DensityFormat::INT8: return 1;
+	}
+	return 0;
+}
+
+DensityGrid::DensityGrid(DensityFormat format)
+	: m_format(format) {}
+
+auto DensityGrid::fromEncoded(DensityFormat format, Bytes bytes) -> DensityGrid {
+	DensityGrid grid{format};
+	grid.m_size = bytes.size() / formatSize(format);
+	grid.m_bytes = std::move(bytes);
+	return grid;
+}
+
+auto DensityGrid::lazy(DensityFormat format, std::size_t count, Loader loader) -> DensityGrid {
+	DensityGrid grid{format};
+	grid.m_size = count;
+	grid.m_loader = std::make_shared<const Loader>(std::move(loader));
+	return grid;
+}
+
+auto DensityGrid::format() const -> DensityFormat {
+	return m_format;
+}
+
+auto DensityGrid::size() const -> std::size_t {
+	return m_size;
+}
+
+auto DensityGrid::empty() const -> bool {
+	return m_size == 0;
+}
+
+auto DensityGrid::byteSize() const -> std::size_t {
+	return m_size * formatSize(m_format);
+}
+
+auto DensityGrid::bytes() const -> const uint8_t* {
+	load();
+	return m_bytes.data();
+}
+
+auto DensityGrid::mapped() const -> bool {
+	return m_bytes.mapped();
+}
+
+auto DensityGrid::heapBytes() const -> std::size_t {
+	return m_bytes.heapBytes();
+}
+
+auto DensityGrid::viewedBytes() const -> std::size_t {
+	return m_bytes.viewedBytes();
+}
+
+auto DensityGrid::loaded() const -> bool {
+	return !m_loader;
+}
+
+void DensityGrid::resize(std::size_t count) {
+	// zero is encoded as all zero bytes in every format
+	load();
+	m_size = count;
+	m_bytes.resize(count * formatSize(m_format));
+}
+
+void DensityGrid::assign(const float* values, std::size_t count) {
+	// all values are replaced, so a lazy grid is not loaded
+	m_loader.reset();
+	m_bytes.clear();
+	resize(count);
+	const auto stride = formatSize(m_format);
+	auto* bytes = m_bytes.owned().data();
+	for (std::size_t i = 0; i < count; i++)
+		encode(m_format, values[i], bytes + i * stride);
+}
+
+void DensityGrid::fill(float value) {
+	load();
+	const auto stride = formatSize(m_format);
+	auto* bytes = m_bytes.owned().data();
+	for (std::size_t i = 0; i < m_size; i++)
+		encode(m_format, value, bytes + i * stride);
+}
+
+auto DensityGrid::get(std::size_t i) const -> float {
+	load();
+	return ::decode(m_format, m_bytes.data() + i * formatSize(m_format));
+}
+
+void DensityGrid::set(std::size_t i, float value) {
+	load();
+	encode(m_format, value, m_bytes.owned().data() + i * formatSize(m_format));
+}
+
+void DensityGrid::decode(std::size_t first, std::size_t count, float* out) const {
+	load();
+	const auto stride = formatSize(m_format);
+	const auto* p = m_bytes.data() + first * stride;
+	std::size_t i = 0;
+#ifdef DPG_SSE2
+	for (; i + 4 <= count; i += 4)
+		decode4(m_format, p + i * stride, out + i);
+#endif
+	for (; i < count; i++)
+		out[i] = ::decode(m_format, p + i * stride);
+}
+
+auto DensityGrid::decoded() const -> std::vector<float> {
+	std::vector<float> values(m_size);
+	decode(0, m_size, values.data());
+	return values;
+}
+
+void DensityGrid::convert(DensityFormat format) {
+	if (format == m_format)
+		return;
+	if (m_loader) {
+		m_loader = std::make_shared<const Loader>([loader = m_loader, from = m_format, to = format] {
+			auto grid = fromEncoded(from, (*loader)());
+			grid.convert(to);
+			return std::move(grid.m_bytes);
+		});
+		m_format = format;
+		return;
+	}
+	const auto values = decoded();
+	m_format = format;
+	assign(values.data(), values.size());
+}
+
+void DensityGrid::load() const {
+	if (!m_loader)
+		return;
+	auto bytes = (*m_loader)();
+	if (bytes.size() != byteSize())
+		throw std::runtime_error("loaded " + std::to_string(bytes.size()) + " density bytes, expected " + std::to_string(byteSize()));
+	m_bytes = std::move(bytes);
+	m_loader.reset();
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+#include "MappedVector.h"
+#include "MemoryTracker.h"
+
+/**
+* Representations of density values. The integer formats store densities normalized to DensityGrid::normalizedRange,
+* values beyond are clamped. All formats preserve the sign of a density, so the surface topology does not change.
+*/
+enum class DensityFormat : uint8_t {
+	FLOAT,
+	HALF,
+	INT16,
+	INT8
+};
+
+auto formatName(DensityFormat format) -> const char*;
+auto formatSize(DensityFormat format) -> std::size_t;
+
+/**
+* A dense array of densities stored in one of the DensityFormats.
+* Values are converted on access, bulk decoding converts several values per instruction where SIMD is available.
+* The encoded values can be viewed in a mapped file or a buffer shared with other grids, they are copied to the heap when first modified.
+* A lazy grid knows only its format and size until its values are first accessed, which calls the loader.
+* Loading is not synchronized, like the rest of a Chunk a grid is used by one thread at a time. Threads reading a grid together must load it first.
+*/
+class DensityGrid final {
+public:
+	using Bytes = MappedVector<uint8_t, TrackingAllocator<uint8_t, MemoryTag::DENSITIES>>;
+	using Loader = std::function<Bytes()>;
+
+	static constexpr float normalizedRange = 8.0f;
+
+	DensityGrid() = default;
+	explicit DensityGrid(DensityFormat format);
+
+	/**
+	* A grid of values already encoded in the given format, either owned or viewed.
+	*/
+	static auto fromEncoded(DensityFormat format, Bytes bytes) -> DensityGrid;
+
+	/**
+	* A grid of count values in the given format, which are encoded by the loader on first access.
+	*/
+	static auto lazy(DensityFormat format, std::size_t count, Loader loader) -> DensityGrid;
+
+	auto format() const -> DensityFormat;
+	auto size() const -> std::size_t;
+	auto empty() const -> bool;
+	auto byteSize() const -> std::size_t;
+	auto bytes() const -> const uint8_t*;
+	auto mapped() const -> bool;
+
+	/**
+	* The encoded bytes owned by the grid and those viewed in shared memory, without loading a lazy grid.
+	*/
+	auto heapBytes() const -> std::size_t;
+	auto viewedBytes() const -> std::size_t;
+
+	/**
+	* Whether the values were loaded, which is false for a lazy grid not accessed yet.
+	*/
+	auto loaded() const -> bool;
+
+	/**
+	* Resizes the grid, new values are zero.
+	*/
+	void resize(std::size_t count);
+	void assign(const float* values, std::size_t count);
+	void fill(float value);
+
+	auto get(std::size_t i) const -> float;
+	void set(std::size_t i, float value);
+
+	/**
+	* Decodes count values starting at first into out.
+	*/
+	void decode(std::size_t first, std::size_t count, float* out) const;
+	auto decoded() const -> std::vector<float>;
+
+	/**
+	* Re-encodes all values in another format. A lazy grid stays lazy and converts when it is loaded.
+	*/
+	void convert(DensityFormat format);
+
+	/**
+	* Loads the values of a lazy grid now, so the grid may be read by several threads. Throws if the loader does.
+	*/
+	void load() const;
+
+private:
+	DensityFormat m_format = DensityFormat::FLOAT;
+	std::size_t m_size = 0;
+	mutable Bytes m_bytes;
+	mutable std::shared_ptr<const Loader> m_loader; // set until a lazy grid is loaded, shared by its copies
+};
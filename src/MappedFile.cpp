@@ -0,0 +1,82 @@
+#include "MappedFile.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+auto MappedFile::open(const std::filesystem::path& path) -> std::shared_ptr<const MappedFile> {
+	std::shared_ptr<MappedFile> f{new MappedFile};
+	const auto fail = [&](const char* what) { throw std::runtime_error(std::string{what} + " " + path.string()); };
+
+#ifdef _WIN32
+	f->m_file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (f->m_file == INVALID_HANDLE_VALUE) {
+		f->m_file = nullptr;
+		fail("could not open");
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(f->m_file, &size))
+		fail("could not stat");
+	f->m_size = static_cast<std::size_t>(size.QuadPart);
+	if (f->m_size == 0)
+		return f;
+	f->m_mapping = CreateFileMappingW(f->m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!f->m_mapping)
+		fail("could not map");
+	f->m_data = static_cast<const uint8_t*>(MapViewOfFile(f->m_mapping, FILE_MAP_READ, 0, 0, 0));
+	if (!f->m_data)
+		fail("could not map");
+#else
+	const auto fd = ::open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		fail("could not open");
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		::close(fd);
+		fail("could not stat");
+	}
+	f->m_size = static_cast<std::size_t>(st.st_size);
+	if (f->m_size > 0) {
+		// the mapping stays valid after closing the descriptor
+		const auto p = mmap(nullptr, f->m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (p == MAP_FAILED) {
+			f->m_size = 0;
+			fail("could not map");
+		}
+		f->m_data = static_cast<const uint8_t*>(p);
+	} else
+		::close(fd);
+#endif
+	return f;
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+	if (m_data)
+		UnmapViewOfFile(m_data);
+	if (m_mapping)
+		CloseHandle(m_mapping);
+	if (m_file)
+		CloseHandle(m_file);
+#else
+	if (m_data)
+		munmap(const_cast<uint8_t*>(m_data), m_size);
+#endif
+}
+
+auto MappedFile::data() const -> const uint8_t* {
+	return m_data;
+}
+
+auto MappedFile::size() const -> std::size_t {
+	return m_size;
+}
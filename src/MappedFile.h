@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+
+/**
+* A file mapped read only into memory. The pages are loaded by the operating system on first access and
+* shared with its file cache, so they do not count towards the heap of the process.
+*/
+class MappedFile final {
+public:
+	/**
+	* Maps the whole file, throws std::runtime_error if it cannot be opened or mapped.
+	*/
+	static auto open(const std::filesystem::path& path) -> std::shared_ptr<const MappedFile>;
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile();
+
+	auto data() const -> const uint8_t*;
+	auto size() const -> std::size_t;
+
+private:
+	MappedFile() = default;
+
+	const uint8_t* m_data = nullptr;
+	std::size_t m_size = 0;
+#ifdef _WIN32
+	void* m_file = nullptr;
+	void* m_mapping = nullptr;
+#endif
+};
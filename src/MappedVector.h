@@ -0,0 +1,87 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "MappedFile.h"
+
+/**
+* An array that either owns its elements or views elements kept alive by a shared owner, such as a MappedFile or a buffer shared by several chunks.
+* Reading a view never copies. The first modification copies the viewed elements into owned storage (copy on write),
+* so only chunks that change pay for heap memory. The owned elements are allocated with Allocator.
+*/
+template <typename T, typename Allocator = std::allocator<T>>
+class MappedVector final {
+public:
+	using Vector = std::vector<T, Allocator>;
+
+	MappedVector() = default;
+	MappedVector(Vector elements)
+		: m_owned(std::move(elements)) {}
+
+	/**
+	* Views count elements at data, which must point into memory kept alive by owner.
+	*/
+	MappedVector(std::shared_ptr<const void> owner, const T* data, std::size_t count)
+		: m_owner(std::move(owner)), m_view(data), m_viewSize(count) {}
+
+	MappedVector(const MappedVector&) = default;
+	MappedVector& operator=(const MappedVector&) = default;
+	MappedVector(MappedVector&& other) noexcept
+		: m_owned(std::move(other.m_owned)), m_owner(std::move(other.m_owner)), m_view(std::exchange(other.m_view, nullptr)), m_viewSize(std::exchange(other.m_viewSize, 0)) {}
+	MappedVector& operator=(MappedVector&& other) noexcept {
+		m_owned = std::move(other.m_owned);
+		m_owner = std::move(other.m_owner);
+		m_view = std::exchange(other.m_view, nullptr);
+		m_viewSize = std::exchange(other.m_viewSize, 0);
+		return *this;
+	}
+
+	/**
+	* Whether the elements are still viewed, in a mapped file or a shared buffer.
+	*/
+	auto mapped() const -> bool { return m_view != nullptr; }
+
+	auto size() const -> std::size_t { return m_view ? m_viewSize : m_owned.size(); }
+	auto empty() const -> bool { return size() == 0; }
+	auto data() const -> const T* { return m_view ? m_view : m_owned.data(); }
+	auto begin() const -> const T* { return data(); }
+	auto end() const -> const T* { return data() + size(); }
+	auto operator[](std::size_t i) const -> const T& { return data()[i]; }
+
+	/**
+	* The bytes allocated for owned elements, and the bytes viewed in memory kept alive by the owner.
+	*/
+	auto heapBytes() const -> std::size_t { return m_owned.capacity() * sizeof(T); }
+	auto viewedBytes() const -> std::size_t { return m_view ? m_viewSize * sizeof(T) : 0; }
+
+	/**
+	* The elements for modification, copied out of the viewed memory first if necessary.
+	*/
+	auto owned() -> Vector& {
+		if (m_view) {
+			m_owned.assign(m_view, m_view + m_viewSize);
+			m_owner.reset();
+			m_view = nullptr;
+			m_viewSize = 0;
+		}
+		return m_owned;
+	}
+
+	void clear() {
+		m_owner.reset();
+		m_view = nullptr;
+		m_viewSize = 0;
+		m_owned.clear();
+	}
+
+	void resize(std::size_t count) { owned().resize(count); }
+	void push_back(const T& t) { owned().push_back(t); }
+
+private:
+	Vector m_owned;
+	std::shared_ptr<const void> m_owner;
+	const T* m_view = nullptr;
+	std::size_t m_viewSize = 0;
+};
@@ -0,0 +1,64 @@
+#include "MemoryTracker.h"
+
+#include <string>
+
+#include "Metrics.h"
+
+namespace {
+	constexpr MemoryTag allTags[] = {MemoryTag::DENSITIES, MemoryTag::VERTICES, MemoryTag::TRIANGLES, MemoryTag::VOXEL_CASES,
+									 MemoryTag::CHUNK_MAPS, MemoryTag::FUTURES, MemoryTag::MESHER_SCRATCH, MemoryTag::GPU_BUFFERS};
+	static_assert(std::size(allTags) == memoryTagCount);
+
+	struct TagGauges {
+		Gauge* live;
+		Gauge* peak;
+	};
+
+	auto gauges() -> const std::array<TagGauges, memoryTagCount>& {
+		static const auto g = [] {
+			std::array<TagGauges, memoryTagCount> result;
+			for (const auto tag : allTags) {
+				const auto label = std::string{"{tag=\""} + tagName(tag) + "\"}";
+				result[static_cast<std::size_t>(tag)] = {&Metrics::gauge("dpg_memory_live_bytes" + label, "Bytes allocated by a subsystem and not released yet"),
+														 &Metrics::gauge("dpg_memory_peak_bytes" + label, "Most bytes a subsystem had allocated at once")};
+			}
+			return result;
+		}();
+		return g;
+	}
+}
+
+std::array<MemoryTracker::Counters, memoryTagCount> MemoryTracker::s_counters{};
+
+auto tagName(MemoryTag tag) -> const char* {
+	switch (tag) {
+		case MemoryTag::DENSITIES: return "densities";
+		case MemoryTag::VERTICES: return "vertices";
+		case MemoryTag::TRIANGLES: return "triangles";
+		case MemoryTag::VOXEL_CASES: return "voxel cases";
+		case MemoryTag::CHUNK_MAPS: return "chunk maps";
+		case MemoryTag::FUTURES: return "futures";
+		case MemoryTag::MESHER_SCRATCH: return "mesher scratch";
+		case MemoryTag::GPU_BUFFERS: return "GPU buffers";
+	}
+	return "";
+}
+
+auto MemoryTracker::stats(MemoryTag tag) -> MemoryTagStats {
+	const auto& c = s_counters[static_cast<std::size_t>(tag)];
+	return {c.live.load(std::memory_order_relaxed), c.peak.load(std::memory_order_relaxed), c.allocations.load(std::memory_order_relaxed)};
+}
+
+void MemoryTracker::resetPeaks() {
+	for (auto& c : s_counters)
+		c.peak.store(c.live.load(std::memory_order_relaxed), std::memory_order_relaxed);
+}
+
+void MemoryTracker::updateMetrics() {
+	const auto& g = gauges();
+	for (const auto tag : allTags) {
+		const auto s = stats(tag);
+		g[static_cast<std::size_t>(tag)].live->set(s.liveBytes);
+		g[static_cast<std::size_t>(tag)].peak->set(s.peakBytes);
+	}
+}
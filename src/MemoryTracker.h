@@ -0,0 +1,130 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+/**
+* The subsystems whose heap and GPU memory is counted by the MemoryTracker.
+*/
+enum class MemoryTag : uint8_t {
+	DENSITIES, // encoded density samples owned by chunks
+	VERTICES,
+	TRIANGLES,
+	VOXEL_CASES, // marching cubes case indices and surface voxel lists of chunks
+	CHUNK_MAPS, // nodes and buckets of the maps and sets keyed by chunk position, including the chunks stored in them
+	FUTURES, // shared states of chunks loaded from disk, the states made by std::async take no allocator and are not counted
+	MESHER_SCRATCH, // per thread buffers and maps of the meshers
+	GPU_BUFFERS // vertex and index buffers, counted when uploaded
+};
+
+inline constexpr std::size_t memoryTagCount = 8;
+
+auto tagName(MemoryTag tag) -> const char*;
+
+struct MemoryTagStats {
+	int64_t liveBytes;
+	int64_t peakBytes; // since the start or the last resetPeaks
+	uint64_t allocations;
+};
+
+/**
+* Counts the live and peak bytes of each MemoryTag, from TrackingAllocator and explicit calls for memory not allocated on the heap.
+* Counting is a few relaxed atomic operations per allocation, from any thread. The counters are never destroyed,
+* so containers with static or thread storage duration may release their memory at exit.
+*/
+class MemoryTracker final {
+public:
+	static void allocated(MemoryTag tag, std::size_t bytes) {
+		auto& c = s_counters[static_cast<std::size_t>(tag)];
+		const auto live = c.live.fetch_add(static_cast<int64_t>(bytes), std::memory_order_relaxed) + static_cast<int64_t>(bytes);
+		auto peak = c.peak.load(std::memory_order_relaxed);
+		while (live > peak && !c.peak.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {}
+		c.allocations.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	static void released(MemoryTag tag, std::size_t bytes) {
+		s_counters[static_cast<std::size_t>(tag)].live.fetch_sub(static_cast<int64_t>(bytes), std::memory_order_relaxed);
+	}
+
+	static auto stats(MemoryTag tag) -> MemoryTagStats;
+
+	/**
+	* Sets the peaks to the live bytes, to find the peak of a later phase.
+	*/
+	static void resetPeaks();
+
+	/**
+	* Sets the gauges dpg_memory_live_bytes{tag="..."} and dpg_memory_peak_bytes{tag="..."}.
+	*/
+	static void updateMetrics();
+
+private:
+	struct alignas(64) Counters {
+		std::atomic<int64_t> live{0};
+		std::atomic<int64_t> peak{0};
+		std::atomic<uint64_t> allocations{0};
+	};
+
+	static std::array<Counters, memoryTagCount> s_counters; // constant initialized, so usable before any dynamic initialization
+};
+
+/**
+* A stateless allocator counting its memory for Tag, otherwise like std::allocator.
+*/
+template <typename T, MemoryTag Tag>
+class TrackingAllocator {
+public:
+	using value_type = T;
+
+	template <typename U>
+	struct rebind {
+		using other = TrackingAllocator<U, Tag>;
+	};
+
+	TrackingAllocator() = default;
+
+	template <typename U>
+	TrackingAllocator(const TrackingAllocator<U, Tag>&) noexcept {}
+
+	auto allocate(std::size_t n) -> T* {
+		auto* p = std::allocator<T>{}.allocate(n);
+		MemoryTracker::allocated(Tag, n * sizeof(T));
+		return p;
+	}
+
+	void deallocate(T* p, std::size_t n) noexcept {
+		MemoryTracker::released(Tag, n * sizeof(T));
+		std::allocator<T>{}.deallocate(p, n);
+	}
+
+	template <typename U>
+	auto operator==(const TrackingAllocator<U, Tag>&) const noexcept -> bool {
+		return true;
+	}
+
+	template <typename U>
+	auto operator!=(const TrackingAllocator<U, Tag>&) const noexcept -> bool {
+		return false;
+	}
+};
+
+template <typename T, MemoryTag Tag>
+using TrackedVector = std::vector<T, TrackingAllocator<T, Tag>>;
+
+template <typename T, MemoryTag Tag>
+using TrackedList = std::list<T, TrackingAllocator<T, Tag>>;
+
+template <typename Key, typename Value, MemoryTag Tag>
+using TrackedMap = std::unordered_map<Key, Value, std::hash<Key>, std::equal_to<Key>, TrackingAllocator<std::pair<const Key, Value>, Tag>>;
+
+template <typename Key, MemoryTag Tag>
+using TrackedSet = std::unordered_set<Key, std::hash<Key>, std::equal_to<Key>, TrackingAllocator<Key, Tag>>;
@@ -0,0 +1,288 @@
+#include "MeshExporter.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <iomanip>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "IO.h"
+
+namespace {
+	enum class FileFormat {
+		PLY,
+		OBJ
+	};
+
+	// chunks each worker thread may mesh ahead of the writer
+	constexpr std::size_t chunksPerThread = 2;
+
+	// the counts in a PLY header are written with a fixed number of digits, so they can be patched in place
+	constexpr auto countDigits = 10;
+
+	const auto faceExtension = ".faces.tmp";
+
+	struct MeshedChunk {
+		std::vector<char> vertices; // encoded for the file
+		std::size_t vertexCount = 0;
+		Chunk::Triangles triangles; // encoded by the writer, which knows the offset of the chunk's indices
+		std::exception_ptr error;
+		bool ready = false;
+	};
+
+	auto formatOf(const std::filesystem::path& path) -> FileFormat {
+		const auto extension = path.extension();
+		if (extension == ".ply")
+			return FileFormat::PLY;
+		if (extension == ".obj")
+			return FileFormat::OBJ;
+		throw std::runtime_error("unsupported mesh file " + path.string() + ", expected .ply or .obj");
+	}
+
+	auto plyHeader(uint64_t vertices, uint64_t faces) -> std::string {
+		std::stringstream ss;
+		ss << "ply\n"
+		   << "format binary_little_endian 1.0\n"
+		   << "element vertex " << std::setw(countDigits) << std::setfill('0') << vertices << "\n"
+		   << "property float x\n"
+		   << "property float y\n"
+		   << "property float z\n"
+		   << "property float nx\n"
+		   << "property float ny\n"
+		   << "property float nz\n"
+		   << "element face " << std::setw(countDigits) << std::setfill('0') << faces << "\n"
+		   << "property list uchar uint vertex_indices\n"
+		   << "end_header\n";
+		return ss.str();
+	}
+
+	template <typename T>
+	void appendNumber(std::vector<char>& out, T value) {
+		char buffer[32];
+		const auto end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+		out.insert(out.end(), buffer, end);
+	}
+
+	void appendText(std::vector<char>& out, const char* text) {
+		out.insert(out.end(), text, text + std::strlen(text));
+	}
+
+	void appendVector(std::vector<char>& out, const char* prefix, const glm::vec3& v) {
+		appendText(out, prefix);
+		for (int i = 0; i < 3; i++) {
+			appendNumber(out, v[i]);
+			out.push_back(i < 2 ? ' ' : '\n');
+		}
+	}
+
+	auto encodeVertices(const Chunk::Vertices& vertices, FileFormat format) -> std::vector<char> {
+		std::vector<char> out;
+		if (format == FileFormat::PLY) {
+			// the properties declared in the header are the layout of RVertex
+			static_assert(sizeof(RVertex) == 6 * sizeof(float), "RVertex is written as is");
+			const auto* bytes = reinterpret_cast<const char*>(vertices.data());
+			out.assign(bytes, bytes + vertices.size() * sizeof(RVertex));
+			return out;
+		}
+
+		out.reserve(vertices.size() * 64);
+		for (const auto& v : vertices) {
+			appendVector(out, "v ", v.position);
+			appendVector(out, "vn ", v.normal);
+		}
+		return out;
+	}
+
+	void encodeFaces(std::vector<char>& out, const Chunk::Triangles& triangles, uint64_t offset, FileFormat format) {
+		if (format == FileFormat::PLY) {
+			constexpr auto faceSize = 1 + 3 * sizeof(uint32_t);
+			out.resize(triangles.size() * faceSize);
+			auto* p = out.data();
+			for (const auto& t : triangles) {
+				*p++ = 3;
+				for (int i = 0; i < 3; i++) {
+					const auto index = static_cast<uint32_t>(t[i] + offset);
+					std::memcpy(p, &index, sizeof(index));
+					p += sizeof(index);
+				}
+			}
+			return;
+		}
+
+		// OBJ indices start at 1, the normal of a vertex has the same index
+		out.clear();
+		for (const auto& t : triangles) {
+			out.push_back('f');
+			for (int i = 0; i < 3; i++) {
+				const auto index = t[i] + offset + 1;
+				out.push_back(' ');
+				appendNumber(out, index);
+				appendText(out, "//");
+				appendNumber(out, index);
+			}
+			out.push_back('\n');
+		}
+	}
+
+	void writeBytes(std::ofstream& file, const std::vector<char>& bytes, const std::filesystem::path& path) {
+		file.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+		if (!file)
+			throw std::runtime_error("could not write " + path.string());
+	}
+}
+
+auto exportMeshes(const std::filesystem::path& path, glm::ivec3 fromChunk, glm::ivec3 toChunk, const ChunkMeshSource& source, const ExportProgress& progress) -> MeshExportStats {
+	const auto start = std::chrono::steady_clock::now();
+	const auto format = formatOf(path);
+	const auto lower = glm::min(fromChunk, toChunk);
+	const auto extent = glm::max(fromChunk, toChunk) - lower + 1;
+	const auto count = static_cast<std::size_t>(extent.x) * extent.y * extent.z;
+	const auto position = [&](std::size_t i) {
+		const auto layer = static_cast<std::size_t>(extent.x) * extent.y;
+		return lower + glm::ivec3(static_cast<int>(i % extent.x), static_cast<int>(i % layer / extent.x), static_cast<int>(i / layer));
+	};
+
+	// PLY declares all vertices before the faces, so the faces wait in a second file until the vertices are complete
+	auto facePath = path;
+	facePath += faceExtension;
+	auto file = openFileOut(path, std::ios::binary);
+	std::ofstream faceFile;
+	if (format == FileFormat::PLY) {
+		faceFile = openFileOut(facePath, std::ios::binary);
+		file << plyHeader(0, 0);
+	}
+
+	const auto threadCount = std::max(1u, std::thread::hardware_concurrency());
+	const auto depth = threadCount * chunksPerThread;
+	std::vector<MeshedChunk> slots(depth);
+	std::mutex mutex;
+	std::condition_variable produced, consumed;
+	std::size_t next = 0;     // the next chunk to mesh
+	std::size_t written = 0;  // chunks written, the chunk at index i may be meshed once i < written + depth
+	std::size_t buffered = 0; // meshed but not written
+	bool stop = false;
+	MeshExportStats stats;
+
+	const auto work = [&] {
+		while (true) {
+			std::size_t i = 0;
+			{
+				std::unique_lock lock{mutex};
+				consumed.wait(lock, [&] { return stop || next >= count || next < written + depth; });
+				if (stop || next >= count)
+					return;
+				i = next++;
+			}
+
+			MeshedChunk meshed;
+			try {
+				auto c = source(position(i));
+				meshed.vertices = encodeVertices(c.vertices, format);
+				meshed.vertexCount = c.vertices.size();
+				meshed.triangles = std::move(c.triangles);
+			} catch (...) {
+				meshed.error = std::current_exception();
+			}
+			meshed.ready = true;
+
+			{
+				std::lock_guard lock{mutex};
+				slots[i % depth] = std::move(meshed);
+				stats.maxChunksBuffered = std::max(stats.maxChunksBuffered, ++buffered);
+			}
+			produced.notify_all();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	for (unsigned int t = 0; t < threadCount; t++)
+		workers.emplace_back(work);
+	const auto joinWorkers = [&] {
+		{
+			std::lock_guard lock{mutex};
+			stop = true;
+		}
+		consumed.notify_all();
+		for (auto& w : workers)
+			w.join();
+		workers.clear();
+	};
+
+	try {
+		std::vector<char> faces;
+		uint64_t vertexOffset = 0;
+		for (std::size_t i = 0; i < count; i++) {
+			MeshedChunk meshed;
+			{
+				std::unique_lock lock{mutex};
+				auto& slot = slots[i % depth];
+				produced.wait(lock, [&] { return slot.ready; });
+				meshed = std::move(slot);
+				slot = {};
+				written = i + 1;
+				buffered--;
+			}
+			consumed.notify_all();
+
+			if (meshed.error)
+				std::rethrow_exception(meshed.error);
+			if (format == FileFormat::PLY && vertexOffset + meshed.vertexCount > std::numeric_limits<uint32_t>::max())
+				throw std::runtime_error("too many vertices for the 32 bit indices of " + path.string());
+
+			encodeFaces(faces, meshed.triangles, vertexOffset, format);
+			writeBytes(file, meshed.vertices, path);
+			writeBytes(format == FileFormat::PLY ? faceFile : file, faces, path);
+			vertexOffset += meshed.vertexCount;
+			stats.triangles += meshed.triangles.size();
+			if (progress)
+				progress(i + 1, count);
+		}
+		joinWorkers();
+		stats.chunks = count;
+		stats.vertices = vertexOffset;
+
+		if (format == FileFormat::PLY) {
+			faceFile.close();
+			auto faceInput = openFileIn(facePath, std::ios::binary);
+			std::vector<char> block(1 << 20);
+			while (faceInput.read(block.data(), static_cast<std::streamsize>(block.size())) || faceInput.gcount() > 0) {
+				block.resize(static_cast<std::size_t>(faceInput.gcount()));
+				writeBytes(file, block, path);
+				block.resize(1 << 20);
+			}
+			faceInput.close();
+			std::filesystem::remove(facePath);
+
+			stats.bytes = static_cast<std::size_t>(file.tellp());
+			file.seekp(0);
+			file << plyHeader(stats.vertices, stats.triangles);
+		} else
+			stats.bytes = static_cast<std::size_t>(file.tellp());
+
+		file.close();
+		if (!file)
+			throw std::runtime_error("could not write " + path.string());
+	} catch (...) {
+		if (!workers.empty())
+			joinWorkers();
+		file.close();
+		faceFile.close();
+		std::error_code ec;
+		std::filesystem::remove(facePath, ec);
+		std::filesystem::remove(path, ec);
+		throw;
+	}
+
+	stats.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return stats;
+}
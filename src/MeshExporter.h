@@ -0,0 +1,37 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <cstddef>
+#include <filesystem>
+#include <functional>
+
+#include "Chunk.h"
+
+struct MeshExportStats {
+	std::size_t chunks = 0;
+	std::size_t vertices = 0;
+	std::size_t triangles = 0;
+	std::size_t bytes = 0; // written to the file
+	std::size_t maxChunksBuffered = 0; // meshed but not written yet, bounded by the pipeline depth
+	double seconds = 0;
+};
+
+/**
+* Provides the chunk at a chunk position, only its mesh is exported. Called concurrently from the worker threads of the export.
+*/
+using ChunkMeshSource = std::function<Chunk(const glm::ivec3&)>;
+
+/**
+* Called by the writing thread after each chunk with the number of chunks written so far and the number of chunks in the region.
+*/
+using ExportProgress = std::function<void(std::size_t written, std::size_t total)>;
+
+/**
+* Writes the indexed meshes of all chunks from fromChunk to toChunk (inclusive) into one file, binary PLY for .ply and text OBJ for .obj.
+* Chunks are taken from the source on worker threads and written in order by the calling thread. At most a few chunks per thread
+* are kept ahead of the writer, so the memory used does not depend on the size of the region.
+* The vertex and face counts of a PLY file are patched into its header when all chunks are written.
+* Throws std::runtime_error if the file cannot be written, and rethrows exceptions of the source.
+*/
+auto exportMeshes(const std::filesystem::path& path, glm::ivec3 fromChunk, glm::ivec3 toChunk, const ChunkMeshSource& source, const ExportProgress& progress = {}) -> MeshExportStats;
@@ -0,0 +1,172 @@
+#include "Metrics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <iomanip>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+#include "IO.h"
+
+namespace {
+	// metrics are registered while static variables are initialized, so the registry is created on first use
+	struct Registry {
+		std::mutex mutex;
+		std::map<std::string, std::pair<const char*, std::variant<Counter*, Gauge*, Histogram*>>> metrics;
+		std::deque<Counter> counters;
+		std::deque<Gauge> gauges;
+		std::deque<Histogram> histograms;
+	};
+
+	auto registry() -> Registry& {
+		static Registry r;
+		return r;
+	}
+
+	template <typename T>
+	auto find(const std::string& name, const char* help, std::deque<T>& storage) -> T& {
+		auto& r = registry();
+		std::lock_guard lock{r.mutex};
+		if (const auto it = r.metrics.find(name); it != r.metrics.end()) {
+			if (const auto metric = std::get_if<T*>(&it->second.second))
+				return **metric;
+			throw std::runtime_error("metric " + name + " is already registered as another kind");
+		}
+		auto& metric = storage.emplace_back();
+		r.metrics.emplace(name, std::pair{help, &metric});
+		return metric;
+	}
+
+	// splits dpg_name{label="value"} into dpg_name and label="value"
+	auto splitLabels(const std::string& name) -> std::pair<std::string, std::string> {
+		const auto brace = name.find('{');
+		if (brace == std::string::npos)
+			return {name, {}};
+		return {name.substr(0, brace), name.substr(brace + 1, name.size() - brace - 2)};
+	}
+
+	auto withLabels(const std::string& base, const std::string& labels, const std::string& extra = {}) -> std::string {
+		if (labels.empty() && extra.empty())
+			return base;
+		return base + "{" + labels + (labels.empty() || extra.empty() ? "" : ",") + extra + "}";
+	}
+}
+
+void Histogram::observe(double seconds) {
+	if (std::isnan(seconds))
+		return;
+	// converting out of range values to integers is undefined, durations beyond a few seconds are counted in the last bucket anyway
+	seconds = std::clamp(seconds, 0.0, 1e9);
+	const auto microseconds = seconds * 1e6;
+	const auto i = microseconds <= 1 ? 0 : std::min(bucketCount, static_cast<std::size_t>(std::ceil(std::log2(microseconds))));
+	m_buckets[i].fetch_add(1, std::memory_order_relaxed);
+	m_count.fetch_add(1, std::memory_order_relaxed);
+	m_sumNanoseconds.fetch_add(static_cast<uint64_t>(seconds * 1e9), std::memory_order_relaxed);
+}
+
+auto Histogram::bound(std::size_t i) -> double {
+	return i < bucketCount ? std::ldexp(1e-6, static_cast<int>(i)) : std::numeric_limits<double>::infinity();
+}
+
+auto Histogram::bucket(std::size_t i) const -> uint64_t {
+	return m_buckets[i].load(std::memory_order_relaxed);
+}
+
+auto Histogram::count() const -> uint64_t {
+	return m_count.load(std::memory_order_relaxed);
+}
+
+auto Histogram::sum() const -> double {
+	return m_sumNanoseconds.load(std::memory_order_relaxed) / 1e9;
+}
+
+auto Histogram::quantile(double fraction) const -> double {
+	// the buckets and the count are read one after another, so the count is taken from the buckets
+	std::array<uint64_t, bucketCount + 1> counts;
+	uint64_t total = 0;
+	for (std::size_t i = 0; i <= bucketCount; i++)
+		total += counts[i] = bucket(i);
+	if (total == 0)
+		return 0;
+
+	uint64_t cumulative = 0;
+	for (std::size_t i = 0; i <= bucketCount; i++) {
+		cumulative += counts[i];
+		if (cumulative >= fraction * total)
+			return bound(i);
+	}
+	return bound(bucketCount);
+}
+
+auto Metrics::counter(const std::string& name, const char* help) -> Counter& {
+	return find(name, help, registry().counters);
+}
+
+auto Metrics::gauge(const std::string& name, const char* help) -> Gauge& {
+	return find(name, help, registry().gauges);
+}
+
+auto Metrics::histogram(const std::string& name, const char* help) -> Histogram& {
+	return find(name, help, registry().histograms);
+}
+
+void Metrics::write(std::ostream& os) {
+	std::string lastBase;
+	for (const auto& e : entries()) {
+		const auto [base, labels] = splitLabels(e.name);
+		if (base != lastBase) {
+			const auto type = std::holds_alternative<Counter*>(e.metric) ? "counter" : std::holds_alternative<Gauge*>(e.metric) ? "gauge" : "histogram";
+			os << "# HELP " << base << ' ' << e.help << '\n'
+			   << "# TYPE " << base << ' ' << type << '\n';
+			lastBase = base;
+		}
+
+		if (const auto counter = std::get_if<Counter*>(&e.metric))
+			os << e.name << ' ' << (*counter)->value() << '\n';
+		else if (const auto gauge = std::get_if<Gauge*>(&e.metric))
+			os << e.name << ' ' << (*gauge)->value() << '\n';
+		else {
+			const auto& h = *std::get<Histogram*>(e.metric);
+			uint64_t cumulative = 0;
+			for (std::size_t i = 0; i <= Histogram::bucketCount; i++) {
+				cumulative += h.bucket(i);
+				std::stringstream le;
+				le << std::setprecision(10);
+				if (i < Histogram::bucketCount)
+					le << "le=\"" << Histogram::bound(i) << '"';
+				else
+					le << "le=\"+Inf\"";
+				os << withLabels(base + "_bucket", labels, le.str()) << ' ' << cumulative << '\n';
+			}
+			os << withLabels(base + "_sum", labels) << ' ' << h.sum() << '\n'
+			   << withLabels(base + "_count", labels) << ' ' << cumulative << '\n';
+		}
+	}
+}
+
+void Metrics::writeFile(const std::filesystem::path& path) {
+	auto temp = path;
+	temp += ".tmp";
+	{
+		auto file = openFileOut(temp);
+		write(file);
+		file.close();
+		if (!file)
+			throw std::runtime_error("could not write " + temp.string());
+	}
+	std::filesystem::rename(temp, path);
+}
+
+auto Metrics::entries() -> std::vector<Entry> {
+	auto& r = registry();
+	std::lock_guard lock{r.mutex};
+	std::vector<Entry> result;
+	result.reserve(r.metrics.size());
+	for (const auto& [name, metric] : r.metrics)
+		result.push_back({name, metric.first, metric.second});
+	return result;
+}
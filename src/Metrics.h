@@ -0,0 +1,122 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <variant>
+#include <vector>
+
+class Counter final {
+public:
+	void add(uint64_t n = 1) {
+		m_value.fetch_add(n, std::memory_order_relaxed);
+	}
+
+	auto value() const -> uint64_t {
+		return m_value.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<uint64_t> m_value{0};
+};
+
+class Gauge final {
+public:
+	void set(int64_t value) {
+		m_value.store(value, std::memory_order_relaxed);
+	}
+
+	void add(int64_t n = 1) {
+		m_value.fetch_add(n, std::memory_order_relaxed);
+	}
+
+	void sub(int64_t n = 1) {
+		m_value.fetch_sub(n, std::memory_order_relaxed);
+	}
+
+	auto value() const -> int64_t {
+		return m_value.load(std::memory_order_relaxed);
+	}
+
+private:
+	std::atomic<int64_t> m_value{0};
+};
+
+/**
+* Counts durations in buckets doubling from 1 µs to about 8 s, plus one bucket for everything longer.
+*/
+class Histogram final {
+public:
+	static constexpr std::size_t bucketCount = 24;
+
+	/**
+	* Negative durations are counted as 0 and infinite ones in the last bucket, NaN is ignored.
+	*/
+	void observe(double seconds);
+
+	/**
+	* The upper bound in seconds of bucket i, infinity for the last.
+	*/
+	static auto bound(std::size_t i) -> double;
+
+	auto bucket(std::size_t i) const -> uint64_t;
+	auto count() const -> uint64_t;
+	auto sum() const -> double;
+
+	/**
+	* The upper bound of the bucket containing the given fraction of all durations, an estimate of the quantile.
+	*/
+	auto quantile(double fraction) const -> double;
+
+private:
+	std::array<std::atomic<uint64_t>, bucketCount + 1> m_buckets{};
+	std::atomic<uint64_t> m_count{0};
+	std::atomic<uint64_t> m_sumNanoseconds{0};
+};
+
+/**
+* The process wide registry of named metrics. Registering the same name again returns the same metric, so the references can be kept
+* in static variables of the instrumented code. Updating a metric is a relaxed atomic operation and never locks.
+* Names follow Prometheus, labels are part of the name, e.g. dpg_chunks_in_flight{source="disk"}.
+*/
+class Metrics final {
+public:
+	static auto counter(const std::string& name, const char* help) -> Counter&;
+	static auto gauge(const std::string& name, const char* help) -> Gauge&;
+	static auto histogram(const std::string& name, const char* help) -> Histogram&;
+
+	/**
+	* Calls f(name, counter), f(name, gauge) or f(name, histogram) for each metric, sorted by name.
+	*/
+	template <typename F>
+	static void forEach(F&& f);
+
+	/**
+	* Writes all metrics in the Prometheus text format, e.g. for the textfile collector of the node exporter.
+	*/
+	static void write(std::ostream& os);
+
+	/**
+	* Writes to a temporary file first and renames it, so readers never see a partial file.
+	* Throws std::runtime_error if the file cannot be written.
+	*/
+	static void writeFile(const std::filesystem::path& path);
+
+private:
+	struct Entry {
+		std::string name;
+		const char* help;
+		std::variant<Counter*, Gauge*, Histogram*> metric;
+	};
+
+	static auto entries() -> std::vector<Entry>;
+};
+
+template <typename F>
+void Metrics::forEach(F&& f) {
+	for (const auto& e : entries())
+		std::visit([&](const auto* metric) { f(e.name, *metric); }, e.metric);
+}
@@ -0,0 +1,98 @@
+#include "Physics.h"
+
+#include <algorithm>
+
+#include "gl.h"
+#include "utils.h"
+
+namespace {
+	constexpr auto gravity = 10.0f;
+	constexpr auto maxSpeed = 50.0f;
+	constexpr auto restitution = 0.3f;
+	constexpr auto friction = 0.8f;
+	constexpr auto surfaceOffset = 0.01f; // keeps bodies from resting exactly on the surface
+	constexpr auto groundSlope = 0.5f;    // minimum z of the surface normal to count as ground
+}
+
+auto PhysicsSystem::spawn(glm::vec3 position, glm::vec3 velocity) -> std::size_t {
+	positions.push_back(position);
+	velocities.push_back(velocity);
+	onGround.push_back(false);
+	return positions.size() - 1;
+}
+
+void PhysicsSystem::clear() {
+	positions.clear();
+	velocities.clear();
+	onGround.clear();
+}
+
+auto PhysicsSystem::size() const -> std::size_t {
+	return positions.size();
+}
+
+auto PhysicsSystem::update(double frameTime, const World& world) -> int {
+	accumulator += frameTime;
+
+	int steps = 0;
+	while (accumulator >= fixedTimeStep && steps < maxStepsPerUpdate) {
+		step(world);
+		accumulator -= fixedTimeStep;
+		steps++;
+	}
+
+	// drop the remaining time if we cannot keep up, instead of falling further behind every frame
+	if (steps == maxStepsPerUpdate)
+		accumulator = std::min(accumulator, fixedTimeStep);
+
+	return steps;
+}
+
+void PhysicsSystem::step(const World& world) {
+	constexpr auto dt = static_cast<float>(fixedTimeStep);
+	const auto count = positions.size();
+	targets.resize(count);
+
+	// integrate
+	parallelFor(count, [&](std::size_t begin, std::size_t end) {
+		for (auto i = begin; i < end; i++) {
+			auto& v = velocities[i];
+			v.z -= gravity * dt;
+			if (const auto speed = length(v); speed > maxSpeed)
+				v *= maxSpeed / speed;
+			targets[i] = positions[i] + v * dt;
+		}
+	});
+
+	// collide with the terrain
+	world.traceBatch(positions, targets, results);
+
+	// respond
+	parallelFor(count, [&](std::size_t begin, std::size_t end) {
+		for (auto i = begin; i < end; i++) {
+			const auto& r = results[i];
+			auto& v = velocities[i];
+			if (r.collision) {
+				// bounce off the surface and damp the tangential movement
+				const auto vn = dot(v, r.normal);
+				const auto normalPart = r.normal * vn;
+				v = (v - normalPart) * friction - normalPart * restitution;
+				positions[i] = r.end + r.normal * surfaceOffset;
+				onGround[i] = r.normal.z > groundSlope;
+			} else {
+				positions[i] = r.end;
+				onGround[i] = false;
+			}
+		}
+	});
+}
+
+void PhysicsSystem::render() const {
+	glPointSize(4.0f);
+	glColor3f(1.0, 0.5, 0.0);
+	glBegin(GL_POINTS);
+	for (const auto& p : positions)
+		glVertex3fv(glm::value_ptr(p));
+	glEnd();
+	glPointSize(1.0f);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <vector>
+
+#include "World.h"
+
+/**
+* Simulates many point bodies (NPCs, projectiles, debris) against the terrain.
+* The bodies are stored as a structure of arrays and stepped at a fixed timestep.
+*/
+class PhysicsSystem final {
+public:
+	static constexpr auto fixedTimeStep = 1.0 / 60.0;
+	static constexpr auto maxStepsPerUpdate = 5;
+
+	auto spawn(glm::vec3 position, glm::vec3 velocity = {}) -> std::size_t;
+	void clear();
+	auto size() const -> std::size_t;
+
+	/**
+	* Advances the simulation by the given frame time using as many fixed steps as fit in.
+	* Returns the number of steps taken.
+	*/
+	auto update(double frameTime, const World& world) -> int;
+	void step(const World& world);
+
+	void render() const;
+
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> velocities;
+	std::vector<uint8_t> onGround; // not vector<bool>, so threads can write neighboring elements
+
+private:
+	double accumulator = 0;
+
+	// scratch space for the batched terrain queries
+	std::vector<glm::vec3> targets;
+	std::vector<TraceResult> results;
+};
@@ -0,0 +1,229 @@
+#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "IO.h"
+
+namespace {
+	using Clock = std::chrono::steady_clock;
+
+	// events a thread may record per frame, the rest is dropped instead of growing without bound
+	constexpr std::size_t maxThreadEvents = 1 << 16;
+
+	// events kept by a capture, about 32 MiB
+	constexpr std::size_t maxCaptureEvents = 1 << 20;
+
+	const auto epoch = Clock::now();
+
+	struct ThreadBuffer {
+		std::mutex mutex; // only contended while endFrame takes the events
+		uint32_t id;
+		std::string name;
+		std::vector<ProfileEvent> events;
+		std::size_t dropped = 0;
+		uint32_t depth = 0; // only used by the owning thread
+	};
+
+	std::mutex registryMutex;
+	std::vector<std::shared_ptr<ThreadBuffer>> registry;
+	uint32_t nextThreadId = 0;
+	std::vector<uint32_t> freeThreadIds; // of exited threads, so short lived threads share a few rows in the timeline and the trace
+
+	// the registry keeps the buffer of an exited thread until its last events are taken
+	thread_local std::shared_ptr<ThreadBuffer> threadBuffer;
+	thread_local const char* threadName = nullptr;
+
+	auto buffer() -> ThreadBuffer& {
+		if (!threadBuffer) {
+			auto b = std::make_shared<ThreadBuffer>();
+			std::lock_guard lock{registryMutex};
+			if (freeThreadIds.empty())
+				b->id = nextThreadId++;
+			else {
+				const auto smallest = std::min_element(freeThreadIds.begin(), freeThreadIds.end());
+				b->id = *smallest;
+				freeThreadIds.erase(smallest);
+			}
+			b->name = threadName ? threadName : "thread " + std::to_string(b->id);
+			registry.push_back(b);
+			threadBuffer = std::move(b);
+		}
+		return *threadBuffer;
+	}
+
+	ProfileFrame last;
+	uint64_t frameStart = 0;
+	std::vector<ProfileFrame> capture;
+	std::size_t captureEvents = 0;
+	bool capturingFrames = false;
+	std::size_t dropped = 0;
+
+	void writeEscaped(std::ostream& os, const std::string& s) {
+		os << '"';
+		for (const auto c : s) {
+			if (c == '"' || c == '\\')
+				os << '\\';
+			if (static_cast<unsigned char>(c) >= 0x20)
+				os << c;
+		}
+		os << '"';
+	}
+
+	// the trace format counts in microseconds
+	void writeMicroseconds(std::ostream& os, uint64_t nanoseconds) {
+		os << nanoseconds / 1000 << '.' << std::setw(3) << std::setfill('0') << nanoseconds % 1000;
+	}
+}
+
+void Profiler::setEnabled(bool enabled) {
+	s_enabled = enabled;
+}
+
+auto Profiler::now() -> uint64_t {
+	return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch).count());
+}
+
+void Profiler::setThreadName(const char* name) {
+	threadName = name;
+	if (threadBuffer) {
+		std::lock_guard lock{threadBuffer->mutex};
+		threadBuffer->name = name;
+	}
+}
+
+void Profiler::endFrame() {
+	last.start = frameStart;
+	last.end = frameStart = now();
+	last.threads.clear();
+
+	{
+		std::lock_guard lock{registryMutex};
+		for (auto it = registry.begin(); it != registry.end();) {
+			auto& b = **it;
+			{
+				std::lock_guard bufferLock{b.mutex};
+				dropped += std::exchange(b.dropped, 0);
+				if (!b.events.empty()) {
+					last.threads.push_back({b.id, b.name, {}});
+					std::swap(last.threads.back().events, b.events);
+					b.events.reserve(last.threads.back().events.size());
+				}
+			}
+			// only the registry refers to the buffer once its thread exited
+			if (it->use_count() == 1) {
+				freeThreadIds.push_back(b.id);
+				it = registry.erase(it);
+			} else
+				++it;
+		}
+	}
+	std::sort(last.threads.begin(), last.threads.end(), [](const ProfileThread& a, const ProfileThread& b) { return a.id < b.id; });
+
+	if (capturingFrames) {
+		std::size_t events = 0;
+		for (const auto& t : last.threads)
+			events += t.events.size();
+		if (captureEvents + events > maxCaptureEvents)
+			dropped += events;
+		else {
+			captureEvents += events;
+			capture.push_back(last);
+		}
+	}
+}
+
+auto Profiler::lastFrame() -> const ProfileFrame& {
+	return last;
+}
+
+void Profiler::startCapture() {
+	capture.clear();
+	captureEvents = 0;
+	capturingFrames = true;
+	setEnabled(true);
+}
+
+void Profiler::stopCapture() {
+	capturingFrames = false;
+}
+
+auto Profiler::capturing() -> bool {
+	return capturingFrames;
+}
+
+auto Profiler::capturedFrames() -> std::size_t {
+	return capture.size();
+}
+
+void Profiler::writeChromeTrace(const std::filesystem::path& path) {
+	auto file = openFileOut(path);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	auto first = true;
+	const auto separator = [&] {
+		if (!first)
+			file << ",";
+		first = false;
+		file << "\n";
+	};
+
+	std::vector<std::pair<uint32_t, std::string>> names;
+	for (const auto& frame : capture) {
+		separator();
+		file << "{\"name\":\"frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":";
+		writeMicroseconds(file, frame.end);
+		file << "}";
+
+		for (const auto& t : frame.threads) {
+			if (std::none_of(names.begin(), names.end(), [&](const auto& n) { return n.first == t.id; }))
+				names.emplace_back(t.id, t.name);
+			for (const auto& e : t.events) {
+				separator();
+				file << "{\"name\":";
+				writeEscaped(file, e.name);
+				file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << t.id << ",\"ts\":";
+				writeMicroseconds(file, e.start);
+				file << ",\"dur\":";
+				writeMicroseconds(file, e.end - e.start);
+				file << "}";
+			}
+		}
+	}
+
+	for (const auto& [id, name] : names) {
+		separator();
+		file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << id << ",\"args\":{\"name\":";
+		writeEscaped(file, name);
+		file << "}}";
+	}
+	file << "\n]}\n";
+
+	file.close();
+	if (!file)
+		throw std::runtime_error("could not write " + path.string());
+}
+
+auto Profiler::droppedEvents() -> std::size_t {
+	return dropped;
+}
+
+void Profiler::begin() {
+	buffer().depth++;
+}
+
+void Profiler::end(const char* name, uint64_t start) {
+	const auto endTime = now();
+	auto& b = buffer();
+	b.depth--;
+	std::lock_guard lock{b.mutex};
+	if (b.events.size() < maxThreadEvents)
+		b.events.push_back({name, start, endTime, b.depth});
+	else
+		b.dropped++;
+}
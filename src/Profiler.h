@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// set to 0 to compile all profiling markers out, the CMake option DPG_PROFILING is off by default for release builds
+#ifndef DPG_PROFILING
+#define DPG_PROFILING 1
+#endif
+
+struct ProfileEvent {
+	const char* name; // a string literal, compared by address
+	uint64_t start; // nanoseconds since the profiler was started
+	uint64_t end;
+	uint32_t depth; // number of enclosing scopes on the same thread
+};
+
+struct ProfileThread {
+	uint32_t id;
+	std::string name;
+	std::vector<ProfileEvent> events; // in the order the scopes ended
+};
+
+struct ProfileFrame {
+	uint64_t start = 0;
+	uint64_t end = 0;
+	std::vector<ProfileThread> threads; // only threads with events in the frame
+};
+
+/**
+* Collects the scopes marked with PROFILE_SCOPE on all threads. Each thread writes into its own buffer, which the thread
+* calling endFrame moves into the last frame once per frame. Scopes are only recorded while the profiler is enabled.
+* A capture keeps all frames from startCapture to stopCapture, which writeChromeTrace saves in the Chrome trace event format
+* (chrome://tracing, ui.perfetto.dev).
+*/
+class Profiler final {
+public:
+	static auto enabled() -> bool {
+		return s_enabled.load(std::memory_order_relaxed);
+	}
+	static void setEnabled(bool enabled);
+
+	static auto now() -> uint64_t;
+
+	/**
+	* Names the calling thread in the timeline and the trace. Only stores the pointer, so it is free while disabled.
+	*/
+	static void setThreadName(const char* name);
+
+	/**
+	* Called at the end of each frame, from one thread only. The other functions below must be called from the same thread.
+	*/
+	static void endFrame();
+	static auto lastFrame() -> const ProfileFrame&;
+
+	static void startCapture();
+	static void stopCapture();
+	static auto capturing() -> bool;
+	static auto capturedFrames() -> std::size_t;
+
+	/**
+	* Throws std::runtime_error if the file cannot be written.
+	*/
+	static void writeChromeTrace(const std::filesystem::path& path);
+
+	/**
+	* Events lost because a thread recorded more than its buffer holds within a frame, or the capture was full.
+	*/
+	static auto droppedEvents() -> std::size_t;
+
+private:
+	friend class ProfileScope;
+
+	static void begin();
+	static void end(const char* name, uint64_t start);
+
+	inline static std::atomic<bool> s_enabled{false};
+};
+
+/**
+* Records the time from its construction to its destruction. Does nothing but test a flag if the profiler is disabled.
+*/
+class ProfileScope final {
+public:
+	explicit ProfileScope(const char* name) {
+		if (Profiler::enabled()) {
+			m_name = name;
+			Profiler::begin();
+			m_start = Profiler::now();
+		}
+	}
+
+	~ProfileScope() {
+		if (m_name)
+			Profiler::end(m_name, m_start);
+	}
+
+	ProfileScope(const ProfileScope&) = delete;
+	auto operator=(const ProfileScope&) -> ProfileScope& = delete;
+
+private:
+	const char* m_name = nullptr;
+	uint64_t m_start = 0;
+};
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+
+#if DPG_PROFILING
+#define PROFILE_SCOPE(name) const ProfileScope PROFILE_CONCAT(profileScope, __LINE__){name}
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#endif
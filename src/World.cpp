@@ -1,18 +1,36 @@
 #include <Windows.h>
 
+#include <algorithm>
 #include <cmath>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <optional>
+#include <thread>
+#include <unordered_map>
 
 #include "Camera.h"
 #include "geometry.h"
 #include "globals.h"
+#include "Metrics.h"
+#include "Profiler.h"
+#include "simd.h"
 #include "utils.h"
 
 #include "World.h"
 
 
 namespace {
+	// chunks beyond the render radius which stay loaded, so turning around does not evict them
+	constexpr auto evictionMargin = 2;
+
+	auto& updateSeconds = Metrics::histogram("dpg_world_update_seconds", "Seconds of World::update per frame");
+	auto& renderListChunks = Metrics::gauge("dpg_render_list_chunks", "Loaded chunks within the render radius");
+	auto& visibleChunks = Metrics::gauge("dpg_visible_chunks", "Chunks drawn in the last frame after culling");
+	auto& chunksEntered = Metrics::counter("dpg_chunks_entered_total", "Chunks entering the render sphere because the camera moved");
+	auto& chunksEnteredLoaded = Metrics::counter("dpg_chunks_entered_loaded_total", "Chunks entering the render sphere which were already loaded");
+	auto& editLatency = Metrics::histogram("dpg_edit_latency_seconds", "Seconds from an edit until the remeshed chunk is swapped in");
+
 	auto voxelPos(glm::vec3 pos, float voxelLength) -> glm::ivec3 {
 		auto chunkPos = pos / voxelLength;
 		return glm::ivec3(floor(chunkPos));
@@ -71,28 +89,158 @@ namespace {
 
 World::World() {}
 
-void World::update(Camera& camera) {
+void World::update(Camera& camera, glm::vec3 velocity) {
+	PROFILE_SCOPE("World::update");
+	const auto start = Clock::now();
+
 	// Get camera position
 	glm::ivec3 cameraChunkPos = getChunkPos(camera.position);
 
+	// Swap in the meshes of edited chunks
+	finishRemeshes();
+
 	// Check for chunks to load, unload, generate and build renderList
 	buildRenderList(cameraChunkPos);
+
+	// prefetches come after the chunks needed now and only a few run at once, so they do not delay them much
+	chunks.collectPrefetched();
+	if (global::prefetchChunks) {
+		const auto maxInFlight = std::max<std::size_t>(2, std::thread::hardware_concurrency() / 2);
+		for (const auto& chunkPos : prefetcher.predict(camera.position / float(chunkResolution), camera.viewVector(), velocity / float(chunkResolution), global::CAMERA_CHUNK_RADIUS)) {
+			if (chunks.prefetchesInFlight() >= maxInFlight)
+				break;
+			if (chunks.prefetch(chunkPos))
+				prefetcher.requested();
+		}
+	}
+
+	// chunks which arrived after an edit touched their samples
+	applyDeferredEdits();
+
+	// chunks beyond the margin around the render sphere, which are neither predicted nor being remeshed, move to the compressed cache
+	if (global::compressChunks && lastEvictionChunk != cameraChunkPos) {
+		lastEvictionChunk = cameraChunkPos;
+		chunks.evict([&](const glm::ivec3& chunkPos) {
+			return distance(glm::vec3(chunkPos), glm::vec3(cameraChunkPos)) <= global::CAMERA_CHUNK_RADIUS + evictionMargin ||
+				(global::prefetchChunks && prefetcher.predicted(chunkPos)) || remeshes.count(chunkPos);
+		});
+	}
+
+	renderListChunks.set(static_cast<int64_t>(renderList.size()));
+	visibleChunks.set(static_cast<int64_t>(m_cullStats.drawn));
+	updateSeconds.observe(std::chrono::duration<double>(Clock::now() - start).count());
+}
+
+auto World::chunksLoaded() const -> bool {
+	return renderListComplete;
+}
+
+void World::cull(const Camera& camera, const glm::mat4& viewProjection) {
+	PROFILE_SCOPE("World::cull");
+	const auto frustum = frustumFromMatrix(viewProjection);
+
+	visibleList.clear();
+	m_cullStats = {};
+	m_cullStats.inRadius = renderList.size();
+
+	std::unordered_map<glm::ivec3, Chunk*> candidates;
+	for (Chunk* c : renderList) {
+		if (intersects(frustum, c->aabb())) {
+			candidates[c->chunkIndex()] = c;
+			m_cullStats.inFrustum++;
+		}
+	}
+
+	if (!global::occlusionCulling) {
+		for (const auto& [pos, c] : candidates)
+			visibleList.push_back(c);
+		m_cullStats.drawn = visibleList.size();
+		return;
+	}
+
+	// breadth first search from the camera chunk, entering neighbors only through faces connected to the face we came in.
+	// We never step against a direction we already went, otherwise the search could wrap around behind occluders.
+	// see: https://tomcc.github.io/2014/08/31/visibility-1.html
+	const glm::ivec3 faceDirections[6] = {{-1, 0, 0}, {1, 0, 0}, {0, -1, 0}, {0, 1, 0}, {0, 0, -1}, {0, 0, 1}};
+	const auto opposite = [](int face) { return face ^ 1; };
+
+	struct Step {
+		glm::ivec3 pos;
+		int entryFace; // -1 for the camera chunk
+		uint8_t directions; // faces we already left through
+	};
+
+	const auto cameraChunkPos = getChunkPos(camera.position);
+	std::unordered_map<glm::ivec3, bool> visited;
+	std::vector<Step> queue{{cameraChunkPos, -1, 0}};
+	visited[cameraChunkPos] = true;
+	for (std::size_t i = 0; i < queue.size(); i++) {
+		const auto step = queue[i];
+
+		// chunks not loaded yet are treated as air, so we do not hide what is behind them
+		const Chunk* chunk = nullptr;
+		if (const auto it = candidates.find(step.pos); it != candidates.end()) {
+			chunk = it->second;
+			visibleList.push_back(it->second);
+		} else if (step.entryFace != -1 && chunks.find(step.pos)) {
+			continue; // loaded, but outside of radius or frustum
+		}
+
+		for (auto face = 0; face < 6; face++) {
+			if (step.directions & (1 << opposite(face)))
+				continue;
+			if (chunk && step.entryFace != -1 && !chunk->facesConnected(step.entryFace, face))
+				continue;
+
+			const auto next = step.pos + faceDirections[face];
+			if (distance(glm::vec3(next), glm::vec3(cameraChunkPos)) > global::CAMERA_CHUNK_RADIUS)
+				continue;
+			if (visited[next])
+				continue;
+			visited[next] = true;
+			queue.push_back({next, opposite(face), static_cast<uint8_t>(step.directions | (1 << face))});
+		}
+	}
+	m_cullStats.drawn = visibleList.size();
+}
+
+auto World::cullStats() const -> const CullStats& {
+	return m_cullStats;
 }
 
 void World::render() {
-	for (Chunk* c : renderList)
+	PROFILE_SCOPE("World::render");
+	for (Chunk* c : visibleList)
 		c->render();
 }
 
 void World::renderAuxiliary() {
-	for (Chunk* c : renderList)
+	for (Chunk* c : visibleList)
 		c->renderAuxiliary();
 }
 
 void World::clearChunks() {
+	renderList.clear();
+	visibleList.clear();
+	renderListComplete = false;
+	renderListBuilt = false;
+	lastEvictionChunk.reset();
+	remeshes.clear();
+	deferredEdits.clear();
 	chunks.clear();
 }
 
+void World::setMesher(Mesher mesher) {
+	if (mesher == chunks.mesher())
+		return;
+	clearChunks();
+	chunks.setMesher(mesher);
+}
+
+auto World::mesher() const -> Mesher {
+	return chunks.mesher();
+}
+
 static auto interpolateLinear(float coord, float v0, float v1) {
 	return v0 * (1 - coord) + v1 * coord;
 }
@@ -121,25 +269,21 @@ static auto gradient(glm::vec3 coord, std::array<float, 8> d) {
 
 constexpr auto hitAtStartEpsilon = 0.001f;
 
-auto World::trace(const glm::vec3 start, const glm::vec3 end, bool dump) const -> TraceResult {
+// Traces along the voxels from start to end. chunkAt maps a chunk position to a loaded chunk or nullptr.
+// With verbose, every visited voxel is logged and, if dumpCounter is set, dumped as ply files.
+template<typename ChunkLookup>
+static auto traceVoxels(const glm::vec3 start, const glm::vec3 end, const ChunkLookup& chunkAt, bool verbose, std::optional<int> dumpCounter = {}) -> TraceResult {
 	if (start == end)
 		return {end, false};
 
-	const auto startPos = getVoxelPos(start);
-	const auto endPos = getVoxelPos(end);
+	const auto endPos = voxelPos(end, 1.0f);
 
 	const auto delta = end - start;
 	const auto maxT = length(delta);
 	const auto ray = Ray{start, normalize(delta)};
 
-	//dump = GetKeyState('D') & 0x8000;
-
-	static auto counter = 0;
-	counter++;
-	if (dump)
-		dumpLines("trace" + std::to_string(counter) + "/line.ply", std::vector{Line{start, end}});
-
-	std::cout << "Tracing from " << start << " to " << end << "\n";
+	if (verbose)
+		std::cout << "Tracing from " << start << " to " << end << "\n";
 
 	int i = 0;
 	CellTraverser traverser{1.0f, ray};
@@ -147,9 +291,10 @@ auto World::trace(const glm::vec3 start, const glm::vec3 end, bool dump) const -
 		i++;
 
 		const glm::ivec3 voxelIndex = traverser.nextIndex();
-		std::cout << "    at voxel " << voxelIndex << "\n";
+		if (verbose)
+			std::cout << "    at voxel " << voxelIndex << "\n";
 
-		const Chunk* chunk = chunks.get(voxelIndex / chunkResolution);
+		const Chunk* chunk = chunkAt(voxelPos(glm::vec3{voxelIndex}, chunkResolution));
 		if (!chunk) {
 			//std::cout << "        no chunk, we stay at " << start << "\n";
 			return {start, false};
@@ -163,18 +308,20 @@ auto World::trace(const glm::vec3 start, const glm::vec3 end, bool dump) const -
 		if (localIndex.y < 0) localIndex.y += chunkResolution;
 		if (localIndex.z < 0) localIndex.z += chunkResolution;
 
-		if (dump) {
+		if (dumpCounter) {
 			const auto& l = chunk->lower();
-			dumpLines("trace" + std::to_string(counter) + "/aabb_" + std::to_string(i) + ".ply", boxEdges({l + glm::vec3{voxelIndex}, l + glm::vec3{voxelIndex} + 1.0f}));
+			dumpLines("trace" + std::to_string(*dumpCounter) + "/aabb_" + std::to_string(i) + ".ply", boxEdges({l + glm::vec3{voxelIndex}, l + glm::vec3{voxelIndex} + 1.0f}));
 		}
 
 		const auto densities = chunk->densityCubeAt(localIndex);
 		const auto case_ = chunk->caseIndexFromVoxel(densities);
 		const auto cat = chunk->categorizeVoxel(localIndex);
-		std::cout << "    cat " << (int)cat << " case " << case_ << " densities: " << densities[0] << ", " << densities[1] << ", " << densities[2] << ", " << densities[3] << ", " << densities[4] << ", " << densities[5] << ", " << densities[6] << ", " << densities[7] << "\n";
+		if (verbose)
+			std::cout << "    cat " << (int)cat << " case " << case_ << " densities: " << densities[0] << ", " << densities[1] << ", " << densities[2] << ", " << densities[3] << ", " << densities[4] << ", " << densities[5] << ", " << densities[6] << ", " << densities[7] << "\n";
 		if (cat == Chunk::VoxelType::SOLID) {
 			// this is problematic, because we must have missed a surface intersection
-			std::cerr << "    ERROR: tracing inside solid block\n";
+			if (verbose)
+				std::cerr << "    ERROR: tracing inside solid block\n";
 			return {start, false};
 		} else if (cat == Chunk::VoxelType::SURFACE) {
 			const auto box = chunk->voxelAabb(localIndex);
@@ -183,26 +330,28 @@ auto World::trace(const glm::vec3 start, const glm::vec3 end, bool dump) const -
 				const auto exit = ray.origin + ray.direction * hitDepths->second;
 				const auto entryCoord = clamp(entry - box.lower, {glm::vec3{0}, glm::vec3{1}});
 				const auto exitCoord = clamp(exit - box.lower, {glm::vec3{0}, glm::vec3{1}});
-				const auto densities = chunk->densityCubeAt(localIndex);
 				const auto entryDensity = interpolateTrilinear(entryCoord, densities);
 				const auto exitDensity = interpolateTrilinear(exitCoord, densities);
-				std::cout << "        entry/exit at " << entry << " " << exit << " densities " << entryDensity << " " << exitDensity << "\n";
+				if (verbose)
+					std::cout << "        entry/exit at " << entry << " " << exit << " densities " << entryDensity << " " << exitDensity << "\n";
 				const auto t = interpolate(entryDensity, exitDensity, hitDepths->first, hitDepths->second);
 				if (t > maxT)
 					return {end, false};
 				const auto hit = ray.origin + ray.direction * t;
 
+				// the gradient points towards higher densities (it points into the solidness), therefore invert the normal
+				const auto hitCoord = clamp(hit - box.lower, {glm::vec3{0}, glm::vec3{1}});
+				const auto hitNormal = -normalize(gradient(hitCoord, densities));
 				if (t < hitAtStartEpsilon) {
 					// if we hit the ground at the start, but we are jumping away, continue
-					const auto hitCoord = clamp(hit - box.lower, {glm::vec3{0}, glm::vec3{1}});
-					const auto hitNormal = -normalize(gradient(hitCoord, densities));
-					std::cout << "        hit at start, t " << t << " normal " << hitNormal << " ray " << ray.direction << "\n";
+					if (verbose)
+						std::cout << "        hit at start, t " << t << " normal " << hitNormal << " ray " << ray.direction << "\n";
 					if (dot(hitNormal, ray.direction) > 0)
 						continue;
 				}
 
 				// TODO: compute slide off vector and continue tracing
-				return {hit, true};
+				return {hit, true, hitNormal};
 			}
 		} else {
 			assert(cat == Chunk::VoxelType::AIR);
@@ -218,6 +367,390 @@ auto World::trace(const glm::vec3 start, const glm::vec3 end, bool dump) const -
 	return {end, false};
 }
 
+auto World::trace(const glm::vec3 start, const glm::vec3 end, bool dump) const -> TraceResult {
+	PROFILE_SCOPE("World::trace");
+	//dump = GetKeyState('D') & 0x8000;
+
+	static auto counter = 0;
+	counter++;
+	if (dump)
+		dumpLines("trace" + std::to_string(counter) + "/line.ply", std::vector{Line{start, end}});
+
+	const auto chunkAt = [&](const glm::ivec3& chunkPos) { return chunks.get(chunkPos); };
+	return traceVoxels(start, end, chunkAt, true, dump ? std::optional{counter} : std::nullopt);
+}
+
+void World::traceBatch(const std::vector<glm::vec3>& starts, const std::vector<glm::vec3>& ends, std::vector<TraceResult>& results) const {
+	PROFILE_SCOPE("World::traceBatch");
+	assert(starts.size() == ends.size());
+	results.resize(starts.size());
+
+	// resolve all chunks the traces may touch up front, so the traces only read from a fixed set of chunks and can run in parallel
+	BatchChunks batchChunks;
+	for (std::size_t i = 0; i < starts.size(); i++)
+		resolveChunks(batchChunks, getChunkPos(glm::min(starts[i], ends[i])), getChunkPos(glm::max(starts[i], ends[i])));
+
+	const auto chunkAt = [&](const glm::ivec3& chunkPos) { return batchChunks.find(chunkPos); };
+	parallelFor(starts.size(), [&](std::size_t begin, std::size_t end) {
+		for (auto i = begin; i < end; i++)
+			results[i] = traceVoxels(starts[i], ends[i], chunkAt, false);
+	});
+}
+
+void World::resolveChunks(BatchChunks& batchChunks, const glm::ivec3& lower, const glm::ivec3& upper) const {
+	glm::ivec3 cp;
+	for (cp.x = lower.x; cp.x <= upper.x; cp.x++)
+		for (cp.y = lower.y; cp.y <= upper.y; cp.y++)
+			for (cp.z = lower.z; cp.z <= upper.z; cp.z++)
+				if (batchChunks.chunks.find(cp) == batchChunks.chunks.end()) {
+					const auto* chunk = chunks.get(cp);
+					if (chunk)
+						chunk->densities.load();
+					batchChunks.chunks[cp] = chunk;
+				}
+}
+
+namespace {
+	// The voxel corner densities around simd::lanes sample positions, transposed so each corner can be loaded into one register.
+	struct VoxelCorners {
+		alignas(16) float densities[8][simd::lanes];
+		alignas(16) float coord[3][simd::lanes]; // position inside the voxel
+		bool valid[simd::lanes];
+	};
+
+	// Remembers the last looked up chunk, since consecutive positions of a batch are often in the same chunk.
+	struct LastChunk {
+		glm::ivec3 pos;
+		const Chunk* chunk = nullptr;
+	};
+
+	void gatherVoxelCorners(const World::BatchChunks& batchChunks, const glm::vec3* positions, std::size_t count, VoxelCorners& corners, LastChunk& last) {
+		for (std::size_t l = 0; l < simd::lanes; l++) {
+			const Chunk* chunk = nullptr;
+			glm::ivec3 localIndex;
+			glm::vec3 coord{0};
+			if (l < count) {
+				const auto p = positions[l];
+				const auto voxelIndex = voxelPos(p, 1.0f);
+				const auto chunkPos = voxelPos(glm::vec3{voxelIndex}, chunkResolution);
+				if (!last.chunk || last.pos != chunkPos)
+					last = {chunkPos, batchChunks.find(chunkPos)};
+				chunk = last.chunk;
+				localIndex = voxelIndex - chunkPos * chunkResolution;
+				coord = p - glm::vec3{voxelIndex};
+			}
+
+			corners.valid[l] = chunk != nullptr;
+			const auto densities = chunk ? chunk->densityCubeAt(localIndex) : std::array<Chunk::DensityType, 8>{};
+			for (auto c = 0; c < 8; c++)
+				corners.densities[c][l] = densities[c];
+			for (auto d = 0; d < 3; d++)
+				corners.coord[d][l] = coord[d];
+		}
+	}
+
+	// Same as interpolateTrilinear, on all lanes at once.
+	auto trilinearLanes(const VoxelCorners& corners) -> simd::Float4 {
+		using simd::lerp;
+		const auto d = [&](int i) { return simd::Float4::load(corners.densities[i]); };
+		const auto x = simd::Float4::load(corners.coord[0]);
+		const auto y = simd::Float4::load(corners.coord[1]);
+		const auto z = simd::Float4::load(corners.coord[2]);
+
+		const auto y1 = lerp(lerp(d(0), d(1), z), lerp(d(3), d(2), z), x);
+		const auto y2 = lerp(lerp(d(4), d(5), z), lerp(d(7), d(6), z), x);
+		return lerp(y1, y2, y);
+	}
+
+	// Same as gradient, on all lanes at once.
+	auto gradientLanes(const VoxelCorners& corners) -> std::array<simd::Float4, 3> {
+		using simd::lerp;
+		const auto d = [&](int i) { return simd::Float4::load(corners.densities[i]); };
+		const auto x = simd::Float4::load(corners.coord[0]);
+		const auto y = simd::Float4::load(corners.coord[1]);
+		const auto z = simd::Float4::load(corners.coord[2]);
+
+		return {
+			lerp(lerp(d(3) - d(0), d(7) - d(4), y), lerp(d(2) - d(1), d(6) - d(5), y), z),
+			lerp(lerp(d(4) - d(0), d(7) - d(3), x), lerp(d(5) - d(1), d(6) - d(2), x), z),
+			lerp(lerp(d(1) - d(0), d(2) - d(3), x), lerp(d(5) - d(4), d(6) - d(7), x), y)};
+	}
+
+	// Runs f(firstPosition, count, corners) for groups of simd::lanes positions, in parallel.
+	template<typename F>
+	void forEachLaneGroup(const World::BatchChunks& batchChunks, const std::vector<glm::vec3>& positions, F f) {
+		const auto groups = (positions.size() + simd::lanes - 1) / simd::lanes;
+		parallelFor(groups, [&](std::size_t begin, std::size_t end) {
+			VoxelCorners corners;
+			LastChunk last;
+			for (auto g = begin; g < end; g++) {
+				const auto first = g * simd::lanes;
+				const auto count = std::min(simd::lanes, positions.size() - first);
+				gatherVoxelCorners(batchChunks, &positions[first], count, corners, last);
+				f(first, count, corners);
+			}
+		});
+	}
+}
+
+void World::resolveChunks(BatchChunks& batchChunks, const std::vector<glm::vec3>& positions) const {
+	// the voxel corners of a position on the chunk's upper boundary are still stored in the chunk, so one chunk per position suffices
+	std::optional<glm::ivec3> last;
+	for (const auto& p : positions) {
+		const auto cp = getChunkPos(glm::vec3{getVoxelPos(p)});
+		if (cp != last)
+			resolveChunks(batchChunks, cp, cp);
+		last = cp;
+	}
+}
+
+void World::sampleDensity(const std::vector<glm::vec3>& positions, std::vector<float>& densities) const {
+	densities.resize(positions.size());
+
+	BatchChunks batchChunks;
+	resolveChunks(batchChunks, positions);
+
+	forEachLaneGroup(batchChunks, positions, [&](std::size_t first, std::size_t count, const VoxelCorners& corners) {
+		alignas(16) float result[simd::lanes];
+		trilinearLanes(corners).store(result);
+		for (std::size_t l = 0; l < count; l++)
+			densities[first + l] = corners.valid[l] ? result[l] : std::numeric_limits<float>::quiet_NaN();
+	});
+}
+
+void World::sampleGradient(const std::vector<glm::vec3>& positions, std::vector<glm::vec3>& gradients) const {
+	gradients.resize(positions.size());
+
+	BatchChunks batchChunks;
+	resolveChunks(batchChunks, positions);
+
+	forEachLaneGroup(batchChunks, positions, [&](std::size_t first, std::size_t count, const VoxelCorners& corners) {
+		alignas(16) float result[3][simd::lanes];
+		const auto g = gradientLanes(corners);
+		for (auto d = 0; d < 3; d++)
+			g[d].store(result[d]);
+		for (std::size_t l = 0; l < count; l++)
+			gradients[first + l] = corners.valid[l] ? glm::vec3{result[0][l], result[1][l], result[2][l]} : glm::vec3{std::numeric_limits<float>::quiet_NaN()};
+	});
+}
+
+namespace {
+	auto brushWeight(const Brush& brush, glm::vec3 pos) -> float {
+		switch (brush.shape) {
+			case BrushShape::SPHERE:
+				return std::clamp(1.0f - distance(pos, brush.center) / brush.radius, 0.0f, 1.0f);
+			case BrushShape::BOX: {
+				const auto d = abs(pos - brush.center);
+				return std::max({d.x, d.y, d.z}) <= brush.radius ? 1.0f : 0.0f;
+			}
+			default: std::terminate();
+		}
+	}
+}
+
+void World::edit(const Brush& brush) {
+	const auto editTime = Clock::now();
+	stats.edits++;
+
+	// all density samples the brush may touch
+	const auto lower = glm::ivec3{floor(brush.center - brush.radius)};
+	const auto upper = glm::ivec3{ceil(brush.center + brush.radius)};
+	const auto size = upper - lower + 1;
+
+	// reads a sample from the chunk owning it
+	const auto sampleAt = [&](glm::ivec3 p) -> std::optional<float> {
+		const auto chunkPos = getChunkPos(glm::vec3{p});
+		if (const Chunk* chunk = chunks.findWithDensities(chunkPos))
+			return chunk->densityAt(p - chunkPos * chunkResolution);
+		return {};
+	};
+
+	// compute all new values first, so smoothing reads unmodified neighbors
+	std::vector<std::optional<float>> newValues(size.x * size.y * size.z);
+	glm::ivec3 p;
+	for (p.z = lower.z; p.z <= upper.z; p.z++) {
+		for (p.y = lower.y; p.y <= upper.y; p.y++) {
+			for (p.x = lower.x; p.x <= upper.x; p.x++) {
+				const auto weight = brushWeight(brush, glm::vec3{p});
+				if (weight <= 0)
+					continue;
+				const auto old = sampleAt(p);
+				if (!old)
+					continue;
+
+				const auto i = p - lower;
+				auto& value = newValues[(i.z * size.y + i.y) * size.x + i.x];
+				switch (brush.mode) {
+					case BrushMode::ADD: value = *old + brush.strength * weight; break;
+					case BrushMode::SUBTRACT: value = *old - brush.strength * weight; break;
+					case BrushMode::SMOOTH: {
+						auto sum = 0.0f;
+						for (const auto& n : {glm::ivec3{1, 0, 0}, glm::ivec3{0, 1, 0}, glm::ivec3{0, 0, 1}})
+							sum += sampleAt(p + n).value_or(*old) + sampleAt(p - n).value_or(*old);
+						value = interpolateLinear(std::min(brush.strength * weight, 1.0f), *old, sum / 6);
+						break;
+					}
+				}
+			}
+		}
+	}
+
+	// write the new values to every chunk holding a copy of the sample, i.e. local indices -1 to chunkResolution + 1
+	std::unordered_map<glm::ivec3, Chunk*> changed;
+	for (p.z = lower.z; p.z <= upper.z; p.z++) {
+		for (p.y = lower.y; p.y <= upper.y; p.y++) {
+			for (p.x = lower.x; p.x <= upper.x; p.x++) {
+				const auto i = p - lower;
+				const auto& value = newValues[(i.z * size.y + i.y) * size.x + i.x];
+				if (!value)
+					continue;
+
+				const auto firstChunk = getChunkPos(glm::vec3{p - 2});
+				const auto lastChunk = getChunkPos(glm::vec3{p + 1});
+				glm::ivec3 cp;
+				for (cp.z = firstChunk.z; cp.z <= lastChunk.z; cp.z++) {
+					for (cp.y = firstChunk.y; cp.y <= lastChunk.y; cp.y++) {
+						for (cp.x = firstChunk.x; cp.x <= lastChunk.x; cp.x++) {
+							if (Chunk* chunk = chunks.findWithDensities(cp)) {
+								chunk->setDensityAt(p - cp * chunkResolution, *value);
+								chunk->edited = true;
+								changed[cp] = chunk;
+							} else
+								deferredEdits[cp].emplace_back(p - cp * chunkResolution, *value);
+						}
+					}
+				}
+			}
+		}
+	}
+
+	for (const auto& [chunkPos, chunk] : changed)
+		startRemesh(chunkPos, *chunk, editTime);
+	stats.pendingRemeshes = remeshes.size();
+}
+
+void World::applyDeferredEdits() {
+	// the latency of these remeshes counts from the arrival of the chunk, the chunk was not visible before
+	const auto arrival = Clock::now();
+	for (auto it = deferredEdits.begin(); it != deferredEdits.end();) {
+		Chunk* chunk = chunks.findWithDensities(it->first);
+		if (!chunk) {
+			++it;
+			continue;
+		}
+		for (const auto& [localIndex, value] : it->second)
+			chunk->setDensityAt(localIndex, value);
+		chunk->edited = true;
+		startRemesh(it->first, *chunk, arrival);
+		it = deferredEdits.erase(it);
+	}
+	stats.pendingRemeshes = remeshes.size();
+}
+
+auto World::editStats() const -> const EditStats& {
+	return stats;
+}
+
+auto World::exportMeshes(const std::filesystem::path& path, glm::vec3 center, int radius, ExportProgress progress) -> std::future<MeshExportStats> {
+	const auto centerChunk = getChunkPos(center);
+	return chunks.exportMeshes(path, centerChunk - radius, centerChunk + radius, std::move(progress));
+}
+
+auto World::persistenceStats() const -> PersistenceStats {
+	return chunks.persistenceStats();
+}
+
+auto World::ioStats() const -> IoStats {
+	return chunks.ioStats();
+}
+
+auto World::ioBackend() const -> const char* {
+	return chunks.ioBackend();
+}
+
+auto World::prefetchStats() const -> PrefetchStats {
+	return prefetcher.stats(chunks.prefetchesInFlight());
+}
+
+auto World::compressedCacheStats() const -> CompressedCacheStats {
+	return chunks.compressedCacheStats();
+}
+
+auto World::loadedChunkCount() const -> std::size_t {
+	return chunks.loadedChunkCount();
+}
+
+auto World::memoryFootprint() const -> ChunkMemoryFootprint {
+	return chunks.getMemoryFootprint();
+}
+
+void World::updateMetrics() {
+	chunks.updateMetrics();
+}
+
+auto World::generationStats() const -> GenerationStats {
+	return chunks.generationStats();
+}
+
+void World::startRemesh(const glm::ivec3& chunkPos, const Chunk& chunk, Clock::time_point editTime) {
+	if (const auto it = remeshes.find(chunkPos); it != remeshes.end()) {
+		// already meshing an older state, remesh again once that is done
+		if (!it->second.editedAgain)
+			it->second.editedAgain = editTime;
+		return;
+	}
+
+	// mesh a copy, so the chunk can be rendered and edited further in the meantime
+	Chunk copy(chunkPos);
+	copy.densities = chunk.densities;
+	auto meshed = std::async(std::launch::async, [copy = std::move(copy), mesher = chunks.mesher()]() mutable {
+		copy.mesh(mesher);
+		return std::move(copy);
+	});
+	remeshes[chunkPos] = Remesh{std::move(meshed), editTime, {}};
+}
+
+void World::finishRemeshes() {
+	std::vector<std::pair<glm::ivec3, Clock::time_point>> restarts;
+	for (auto it = remeshes.begin(); it != remeshes.end();) {
+		auto& remesh = it->second;
+		if (remesh.meshed.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			++it;
+			continue;
+		}
+
+		Chunk meshed = remesh.meshed.get();
+		if (Chunk* chunk = chunks.find(it->first)) {
+			chunk->vertices = std::move(meshed.vertices);
+			chunk->triangles = std::move(meshed.triangles);
+			chunk->faceConnectivity = meshed.faceConnectivity;
+			if (!remesh.editedAgain) { // otherwise they are older than the densities
+				chunk->caseIndices = std::move(meshed.caseIndices);
+				chunk->surfaceVoxels = std::move(meshed.surfaceVoxels);
+			}
+			if (!global::headless)
+				chunk->createBuffers();
+
+			const auto latency = std::chrono::duration<double>(Clock::now() - remesh.editTime).count();
+			stats.remeshes++;
+			stats.lastLatency = latency;
+			stats.averageLatency += (latency - stats.averageLatency) / stats.remeshes;
+			stats.maxLatency = std::max(stats.maxLatency, latency);
+			editLatency.observe(latency);
+
+			if (remesh.editedAgain)
+				restarts.emplace_back(it->first, *remesh.editedAgain);
+		}
+		it = remeshes.erase(it);
+	}
+
+	for (const auto& [chunkPos, editTime] : restarts)
+		if (const Chunk* chunk = chunks.find(chunkPos))
+			startRemesh(chunkPos, *chunk, editTime);
+
+	stats.pendingRemeshes = remeshes.size();
+}
+
 auto World::categorizeWorldPosition(const glm::vec3& pos) const -> Chunk::VoxelType {
 	const glm::ivec3 chunkPos = getChunkPos(pos);
 	if (const Chunk* chunk = chunks.get(chunkPos))
@@ -238,10 +771,17 @@ glm::ivec3 World::getVoxelPos(const glm::vec3& pos) const {
 }
 
 void World::buildRenderList(const glm::ivec3& cameraChunkPos) {
+	PROFILE_SCOPE("World::buildRenderList");
 	if (lastCameraChunk == cameraChunkPos && renderListComplete)
 		return; // the camera chunk has not changed, no need to rebuild the render list
 
+	// chunks are only counted as entering the sphere when the camera moves, not while the world loads initially
+	const auto previousCameraChunk = lastCameraChunk;
+	const auto moved = renderListBuilt && previousCameraChunk != cameraChunkPos;
 	lastCameraChunk = cameraChunkPos;
+	renderListBuilt = true;
+	if (moved)
+		prefetcher.left(cameraChunkPos, global::CAMERA_CHUNK_RADIUS);
 
 	// clear renderList
 	renderList.clear();
@@ -255,9 +795,17 @@ void World::buildRenderList(const glm::ivec3& cameraChunkPos) {
 				if (distance(glm::vec3(chunkPos), glm::vec3(cameraChunkPos)) > global::CAMERA_CHUNK_RADIUS)
 					continue;
 
-				if (Chunk* c = chunks.get(chunkPos))
+				Chunk* c = chunks.get(chunkPos);
+				if (moved && distance(glm::vec3(chunkPos), glm::vec3(previousCameraChunk)) > global::CAMERA_CHUNK_RADIUS) {
+					prefetcher.entered(chunkPos, c != nullptr);
+					chunksEntered.add();
+					if (c)
+						chunksEnteredLoaded.add();
+				}
+				if (c) {
 					renderList.push_back(c);
-				else
+					prefetcher.available(chunkPos);
+				} else
 					renderListComplete = false;
 			}
 }
@@ -1,30 +1,149 @@
 #pragma once
 
+#include <glm/mat4x4.hpp>
 #include <glm/vec3.hpp>
 
+#include <chrono>
+#include <future>
+#include <optional>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 #include "ChunkManager.h"
+#include "ChunkPrefetcher.h"
 
 class Camera;
 
 struct TraceResult {
 	glm::vec3 end;
 	bool collision = false;
+	glm::vec3 normal{}; // surface normal at end, if collision
+};
+
+enum class BrushMode {
+	ADD,
+	SUBTRACT,
+	SMOOTH
+};
+
+enum class BrushShape {
+	SPHERE,
+	BOX
+};
+
+struct Brush {
+	BrushMode mode = BrushMode::ADD;
+	BrushShape shape = BrushShape::SPHERE;
+	glm::vec3 center{};
+	float radius = 3.0f; // half the edge length for boxes
+	float strength = 1.0f;
+};
+
+struct EditStats {
+	std::size_t edits = 0;
+	std::size_t remeshes = 0;
+	std::size_t pendingRemeshes = 0;
+
+	// seconds from an edit until the changed mesh is uploaded
+	double lastLatency = 0;
+	double averageLatency = 0;
+	double maxLatency = 0;
+};
+
+struct CullStats {
+	std::size_t inRadius = 0;
+	std::size_t inFrustum = 0; // of inRadius
+	std::size_t drawn = 0;     // of inFrustum, reachable through air from the camera chunk
 };
 
 class World {
 public:
+	/** The chunks resolved for a batched query. Lookups are read only and may happen from multiple threads. */
+	struct BatchChunks {
+		std::unordered_map<glm::ivec3, const Chunk*> chunks;
+
+		auto find(const glm::ivec3& chunkPos) const -> const Chunk* {
+			const auto it = chunks.find(chunkPos);
+			return it != chunks.end() ? it->second : nullptr;
+		}
+	};
+
 	World();
 
-	void update(Camera& camera);
+	/**
+	* Loads the chunks around the camera. With global::prefetchChunks, the chunks ahead of the camera moving with velocity are loaded in advance.
+	* With global::compressChunks, chunks far outside the render sphere are moved to the compressed in-memory cache.
+	*/
+	void update(Camera& camera, glm::vec3 velocity = {});
+	auto chunksLoaded() const -> bool;
+
+	/**
+	* Selects the chunks to render from the chunks around the camera. Besides the frustum test, with global::occlusionCulling,
+	* only chunks are kept which are reachable from the camera chunk through chunk faces connected by air.
+	*/
+	void cull(const Camera& camera, const glm::mat4& viewProjection);
+	auto cullStats() const -> const CullStats&;
+
 	void render();
 	void renderAuxiliary();
 
 	void clearChunks();
 
+	/**
+	* Selects the mesher for this world. Loaded chunks are discarded and regenerated.
+	*/
+	void setMesher(Mesher mesher);
+	auto mesher() const -> Mesher;
+
 	auto trace(glm::vec3 start, glm::vec3 end, bool dump = false) const -> TraceResult;
 
+	/**
+	* Traces many segments at once. The chunks touched by the segments are resolved once for the whole batch
+	* and the traces run in parallel. Results are written to results, which is resized to the number of segments.
+	*/
+	void traceBatch(const std::vector<glm::vec3>& starts, const std::vector<glm::vec3>& ends, std::vector<TraceResult>& results) const;
+
+	/**
+	* Samples the trilinearly interpolated density at each world position. The chunks are resolved once per batch.
+	* Positions inside chunks which are not loaded yet yield NaN.
+	*/
+	void sampleDensity(const std::vector<glm::vec3>& positions, std::vector<float>& densities) const;
+
+	/**
+	* Samples the density gradient at each world position. The gradient points towards higher densities (into the solid)
+	* and is not normalized. Positions inside chunks which are not loaded yet yield NaN.
+	*/
+	void sampleGradient(const std::vector<glm::vec3>& positions, std::vector<glm::vec3>& gradients) const;
+
+	/**
+	* Applies the brush to the densities of all loaded chunks it touches, including the margins duplicated into neighbors.
+	* The changed chunks are remeshed in the background and swapped in by update().
+	* Margins of chunks not loaded yet are changed when update() finds them loaded.
+	*/
+	void edit(const Brush& brush);
+	auto editStats() const -> const EditStats&;
+
+	/**
+	* Starts writing the meshes of the chunks within radius chunks of the center position into a PLY or OBJ file on a separate thread,
+	* including chunks which are not loaded. The returned future is ready when the file is written, progress is called after each chunk.
+	*/
+	auto exportMeshes(const std::filesystem::path& path, glm::vec3 center, int radius, ExportProgress progress = {}) -> std::future<MeshExportStats>;
+	auto persistenceStats() const -> PersistenceStats;
+	auto ioStats() const -> IoStats;
+	auto ioBackend() const -> const char*;
+	auto generationStats() const -> GenerationStats;
+	auto prefetchStats() const -> PrefetchStats;
+	auto compressedCacheStats() const -> CompressedCacheStats;
+	auto loadedChunkCount() const -> std::size_t;
+	auto memoryFootprint() const -> ChunkMemoryFootprint;
+
+	/**
+	* Sets the gauges of the chunk pipeline and memory, which walk the loaded chunks and are therefore not set by update().
+	* Call before the metrics are shown or written.
+	*/
+	void updateMetrics();
+
 	auto categorizeWorldPosition(const glm::vec3& pos) const -> Chunk::VoxelType;
 
 	// Moves the position with the bounding box to the nearest non solid position.
@@ -34,13 +153,45 @@ public:
 	glm::ivec3 getVoxelPos(const glm::vec3& pos) const;
 
 private:
+	using Clock = std::chrono::steady_clock;
+
+	struct Remesh {
+		std::future<Chunk> meshed;
+		Clock::time_point editTime;
+		std::optional<Clock::time_point> editedAgain; // oldest edit that arrived while meshing
+	};
+
 	ChunkManager chunks;
 
+	/** Chunks which are remeshed after an edit, by chunk position. */
+	std::unordered_map<glm::ivec3, Remesh> remeshes;
+
+	/** Samples written by edits to chunks which were not loaded yet, by chunk position. Applied when the chunks are loaded, so they do not miss the edits at their borders. */
+	std::unordered_map<glm::ivec3, std::vector<std::pair<glm::ivec3, float>>> deferredEdits;
+	EditStats stats;
+
 	/** Holds all chunks that need to be rendered. This list is generated during Update() and used by Render(). */
 	std::vector<Chunk*> renderList;
 
+	/** The chunks of the renderList which passed culling. This list is generated by cull() and used by Render(). */
+	std::vector<Chunk*> visibleList;
+	CullStats m_cullStats;
+
 	glm::ivec3 lastCameraChunk{};
 	bool renderListComplete = false;
+	bool renderListBuilt = false;
+	std::optional<glm::ivec3> lastEvictionChunk;
+
+	ChunkPrefetcher prefetcher;
 
 	void buildRenderList(const glm::ivec3& cameraChunkPos);
+
+	void startRemesh(const glm::ivec3& chunkPos, const Chunk& chunk, Clock::time_point editTime);
+	void finishRemeshes();
+	void applyDeferredEdits();
+
+	// Adds all chunks between the given chunk positions (inclusive) to batchChunks and loads their densities, so parallel readers never load them.
+	void resolveChunks(BatchChunks& batchChunks, const glm::ivec3& lower, const glm::ivec3& upper) const;
+	// Adds the chunks holding the voxels of all positions to batchChunks.
+	void resolveChunks(BatchChunks& batchChunks, const std::vector<glm::vec3>& positions) const;
 };
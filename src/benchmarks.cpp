@@ -0,0 +1,1290 @@
+#include "benchmarks.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <optional>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <unordered_map>
+
+#include "Camera.h"
+#include "CameraPath.h"
+#include "ChunkCreator.h"
+#include "ChunkSerializer.h"
+#include "DensityGraph.h"
+#include "MemoryTracker.h"
+#include "MeshExporter.h"
+#include "Metrics.h"
+#include "Physics.h"
+#include "Profiler.h"
+#include "World.h"
+#include "globals.h"
+#include "utils.h"
+
+using namespace std;
+
+namespace {
+	using Clock = chrono::high_resolution_clock;
+
+	auto secondsSince(Clock::time_point start) -> double {
+		return chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	auto argOr(const vector<string>& args, size_t i, int def) -> int {
+		return args.size() > i ? stoi(args[i]) : def;
+	}
+
+	// Loads all chunks within the given radius around pos.
+	void loadWorld(World& world, glm::vec3 pos, int radius) {
+		global::CAMERA_CHUNK_RADIUS = radius;
+		Camera camera;
+		camera.position = pos;
+		const auto start = Clock::now();
+		do {
+			world.update(camera);
+			this_thread::sleep_for(chrono::milliseconds(1));
+		} while (!world.chunksLoaded());
+		cout << "Loaded world with radius " << radius << " in " << secondsSince(start) << "s\n";
+	}
+
+	int benchmarkPhysics(const vector<string>& args) {
+		const auto steps = argOr(args, 2, 600);
+
+		World world;
+		const auto center = glm::vec3{8, 8, 0};
+		loadWorld(world, center, 2);
+
+		vector<int> bodyCounts;
+		if (args.size() > 1)
+			bodyCounts.push_back(stoi(args[1]));
+		else
+			bodyCounts = {100, 1000, 10000};
+
+		for (const auto count : bodyCounts) {
+			PhysicsSystem physics;
+			mt19937 rng(42);
+			uniform_real_distribution<float> horizontal(-16, 16);
+			uniform_real_distribution<float> height(2, 20);
+			uniform_real_distribution<float> speed(-5, 5);
+			for (int i = 0; i < count; i++)
+				physics.spawn(center + glm::vec3{horizontal(rng), horizontal(rng), height(rng)}, {speed(rng), speed(rng), speed(rng)});
+
+			const auto start = Clock::now();
+			for (int i = 0; i < steps; i++)
+				physics.step(world);
+			const auto seconds = secondsSince(start);
+
+			size_t grounded = 0;
+			for (const auto g : physics.onGround)
+				grounded += g;
+
+			cout << setw(8) << count << " bodies, " << steps << " steps: " << fixed << setprecision(3) << seconds << "s, "
+				 << setprecision(0) << count * steps / seconds << " bodies/s, " << grounded << " on ground\n";
+		}
+		return 0;
+	}
+
+	int benchmarkDensitySampling(const vector<string>& args) {
+		const auto repetitions = argOr(args, 2, 20);
+
+		World world;
+		const auto center = glm::vec3{8, 8, 0};
+		loadWorld(world, center, 2);
+
+		vector<int> batchSizes;
+		if (args.size() > 1)
+			batchSizes.push_back(stoi(args[1]));
+		else
+			batchSizes = {1000, 100000, 1000000};
+
+		for (const auto count : batchSizes) {
+			mt19937 rng(42);
+			uniform_real_distribution<float> offset(-24, 24);
+			vector<glm::vec3> positions(count);
+			for (auto& p : positions)
+				p = center + glm::vec3{offset(rng), offset(rng), offset(rng)};
+
+			vector<float> densities;
+			auto start = Clock::now();
+			for (int i = 0; i < repetitions; i++)
+				world.sampleDensity(positions, densities);
+			const auto densitySeconds = secondsSince(start);
+
+			vector<glm::vec3> gradients;
+			start = Clock::now();
+			for (int i = 0; i < repetitions; i++)
+				world.sampleGradient(positions, gradients);
+			const auto gradientSeconds = secondsSince(start);
+
+			const auto samples = static_cast<double>(count) * repetitions;
+			cout << setw(8) << count << " positions: " << fixed << setprecision(0)
+				 << samples / densitySeconds << " density samples/s, "
+				 << samples / gradientSeconds << " gradient samples/s\n";
+		}
+		return 0;
+	}
+
+	int benchmarkEditing(const vector<string>& args) {
+		const auto editCount = argOr(args, 1, 100);
+
+		World world;
+		const auto center = glm::vec3{8, 8, 0};
+		loadWorld(world, center, 2);
+		Camera camera;
+		camera.position = center;
+
+		mt19937 rng(42);
+		uniform_real_distribution<float> offset(-20, 20);
+		uniform_int_distribution<int> mode(0, 2);
+		uniform_int_distribution<int> shape(0, 1);
+
+		const auto start = Clock::now();
+		for (int i = 0; i < editCount; i++) {
+			Brush brush;
+			brush.mode = static_cast<BrushMode>(mode(rng));
+			brush.shape = static_cast<BrushShape>(shape(rng));
+			brush.center = center + glm::vec3{offset(rng), offset(rng), 0};
+			brush.center.z = 0.5f + brush.center.x * 0.1f; // near the surface
+			world.edit(brush);
+
+			// one frame per edit
+			world.update(camera);
+			this_thread::sleep_for(chrono::milliseconds(16));
+		}
+		while (world.editStats().pendingRemeshes > 0)
+			world.update(camera);
+		const auto seconds = secondsSince(start);
+
+		const auto& stats = world.editStats();
+		cout << stats.edits << " edits, " << stats.remeshes << " remeshes in " << fixed << setprecision(3) << seconds << "s\n"
+			 << "edit to visible latency: avg " << stats.averageLatency * 1000 << "ms, max " << stats.maxLatency * 1000 << "ms\n";
+		return 0;
+	}
+
+	int benchmarkDeltaPersistence(const vector<string>& args) {
+		const auto side = argOr(args, 1, 8);
+		const auto editRadius = argOr(args, 2, 3);
+		global::enableChunkCache = true;
+
+		// a layer of chunks along the surface, each with a spherical edit in the middle
+		vector<glm::ivec3> positions;
+		for (int x = 0; x < side; x++)
+			for (int y = 0; y < side; y++)
+				positions.emplace_back(x, y, x * chunkResolution / 10 / chunkResolution); // the surface rises by 0.1 per voxel along x
+
+		const auto dir = filesystem::temp_directory_path() / "dpg_bench_delta";
+		for (const auto edited : {true, false}) {
+			filesystem::remove_all(dir);
+			{
+				ChunkSerializer serializer(dir);
+				for (const auto& pos : positions) {
+					Chunk c = ChunkCreator::createChunk(pos, Mesher::MARCHING_CUBES);
+					glm::ivec3 l;
+					for (l.z = -1; l.z <= chunkResolution + 1; l.z++)
+						for (l.y = -1; l.y <= chunkResolution + 1; l.y++)
+							for (l.x = -1; l.x <= chunkResolution + 1; l.x++)
+								if (distance(glm::vec3{l}, glm::vec3{chunkResolution / 2}) <= editRadius)
+									c.setDensityAt(l, c.densityAt(l) + 1.0f);
+					c.edited = edited;
+					serializer.storeChunk(c);
+				}
+			}
+
+			size_t diskBytes = 0;
+			for (const auto& e : filesystem::recursive_directory_iterator{dir})
+				if (e.is_regular_file())
+					diskBytes += e.file_size();
+
+			ChunkSerializer serializer(dir);
+			vector<bool> loaded(positions.size());
+			for (size_t remaining = positions.size(); remaining > 0;)
+				for (size_t i = 0; i < positions.size(); i++)
+					if (!loaded[i] && serializer.get(positions[i])) {
+						loaded[i] = true;
+						remaining--;
+					}
+
+			const auto stats = serializer.stats();
+			const auto loads = stats.deltaChunksLoaded + stats.fullChunksLoaded;
+			cout << (edited ? "delta" : "full ") << " chunks: " << sizeToString(diskBytes / positions.size()) << " on disk per chunk, "
+				 << fixed << setprecision(3) << (stats.deltaLoadSeconds + stats.fullLoadSeconds) * 1000 / loads << "ms load per chunk\n";
+		}
+
+		// deltas stored against other generation settings must not be applied
+		filesystem::remove_all(dir);
+		{
+			ChunkSerializer serializer(dir);
+			Chunk c = ChunkCreator::createChunk(positions.front(), Mesher::MARCHING_CUBES);
+			c.setDensityAt(glm::ivec3{chunkResolution / 2}, c.densityAt(glm::ivec3{chunkResolution / 2}) + 1.0f);
+			c.edited = true;
+			serializer.storeChunk(c);
+		}
+		global::densityBounds = !global::densityBounds;
+		bool rejected = false;
+		{
+			ChunkSerializer serializer(dir);
+			optional<Chunk> stale;
+			while (!(stale = serializer.get(positions.front()))) {}
+			rejected = serializer.stats().deltaChunksLoaded == 0 && !stale->edited;
+		}
+		global::densityBounds = !global::densityBounds;
+		filesystem::remove_all(dir);
+		cout << "delta against other settings: " << (rejected ? "rejected" : "APPLIED") << "\n";
+		return rejected ? 0 : 1;
+	}
+
+	// The resident anonymous (heap) and file backed memory of the process, zero where /proc is not available.
+	auto residentMemory() -> pair<size_t, size_t> {
+		ifstream status("/proc/self/status");
+		size_t anon = 0, file = 0;
+		for (string line; getline(status, line);) {
+			if (line.rfind("RssAnon:", 0) == 0)
+				anon = stoull(line.substr(8)) * 1024;
+			else if (line.rfind("RssFile:", 0) == 0)
+				file = stoull(line.substr(8)) * 1024;
+		}
+		return {anon, file};
+	}
+
+	// Resets the peak resident memory of the process, so peakResidentMemory() measures from here. Has no effect where /proc is not available.
+	void resetPeakResidentMemory() {
+		ofstream{"/proc/self/clear_refs"} << "5";
+	}
+
+	auto peakResidentMemory() -> size_t {
+		ifstream status("/proc/self/status");
+		for (string line; getline(status, line);)
+			if (line.rfind("VmHWM:", 0) == 0)
+				return stoull(line.substr(6)) * 1024;
+		return 0;
+	}
+
+	// The value below which the given fraction of the values lies, the values must be sorted.
+	auto percentile(const vector<double>& sorted, double fraction) -> double {
+		if (sorted.empty())
+			return 0;
+		return sorted[min(sorted.size() - 1, static_cast<size_t>(fraction * sorted.size()))];
+	}
+
+	void printDistribution(const char* name, vector<double> seconds) {
+		sort(seconds.begin(), seconds.end());
+		cout << name << fixed << setprecision(2) << "p50 " << percentile(seconds, 0.5) * 1000 << "ms, p90 " << percentile(seconds, 0.9) * 1000 << "ms, p99 "
+			 << percentile(seconds, 0.99) * 1000 << "ms, max " << (seconds.empty() ? 0.0 : seconds.back() * 1000) << "ms\n"
+			 << defaultfloat;
+	}
+
+	auto threadCount() -> size_t {
+		ifstream status("/proc/self/status");
+		for (string line; getline(status, line);)
+			if (line.rfind("Threads:", 0) == 0)
+				return stoull(line.substr(8));
+		return 0;
+	}
+
+	int benchmarkChunkIO(const vector<string>& args) {
+		const auto side = argOr(args, 1, 16);
+		if (args.size() > 2)
+			ChunkCreator::setDensityGraph(DensityGraph::load(args[2]));
+		global::enableChunkCache = true;
+		global::mapChunkFiles = false;
+
+		vector<Chunk> chunks;
+		for (int z = -1; z <= 1; z++)
+			for (int y = 0; y < side; y++)
+				for (int x = 0; x < side; x++)
+					chunks.push_back(ChunkCreator::createChunk({x, y, z}, Mesher::MARCHING_CUBES));
+
+		const auto dir = filesystem::temp_directory_path() / "dpg_bench_io";
+		for (const auto ioUring : {true, false}) {
+			global::ioUring = ioUring;
+			filesystem::remove_all(dir);
+
+			// all chunks are stored at once and written when the serializer is destroyed
+			const auto writeStart = Clock::now();
+			IoStats writeStats;
+			{
+				ChunkSerializer serializer(dir);
+				for (const auto& c : chunks)
+					serializer.storeChunk(c);
+				serializer.flush();
+				writeStats = serializer.ioStats();
+			}
+			const auto writeSeconds = secondsSince(writeStart);
+
+			ChunkSerializer serializer(dir);
+			vector<bool> loaded(chunks.size());
+			size_t peakThreads = 0;
+			const auto readStart = Clock::now();
+			for (size_t remaining = chunks.size(); remaining > 0;) {
+				for (size_t i = 0; i < chunks.size(); i++)
+					if (!loaded[i] && serializer.get(chunks[i].chunkIndex())) {
+						loaded[i] = true;
+						remaining--;
+					}
+				peakThreads = max(peakThreads, threadCount());
+			}
+			const auto readSeconds = secondsSince(readStart);
+
+			const auto stats = serializer.ioStats();
+			const auto persistence = serializer.stats();
+			cout << setw(11) << serializer.ioBackend() << ": " << fixed << setprecision(1) << "write " << writeStats.bytesWritten / writeSeconds / (1 << 20) << " MiB/s, read "
+				 << stats.bytesRead / readSeconds / (1 << 20) << " MiB/s, " << setprecision(3) << stats.readSeconds * 1000 / stats.reads << "ms read latency, "
+				 << persistence.fullLoadSeconds * 1000 / persistence.fullChunksLoaded << "ms build per chunk, queue depth max " << stats.maxQueueDepth << ", "
+				 << setprecision(1) << (stats.batches > 0 ? static_cast<double>(stats.reads) / stats.batches : 0.0) << " reads per batch, " << peakThreads << " threads\n"
+				 << defaultfloat;
+		}
+		filesystem::remove_all(dir);
+		return 0;
+	}
+
+	int benchmarkCacheStartup(const vector<string>& args) {
+		const auto count = argOr(args, 1, 100000);
+		global::enableChunkCache = true;
+
+		// empty files named like chunks, opening the cache only looks at their names
+		const auto dir = filesystem::temp_directory_path() / "dpg_bench_startup";
+		filesystem::remove_all(dir);
+		filesystem::create_directories(dir);
+		vector<glm::ivec3> positions;
+		for (int i = 0; i < count; i++) {
+			positions.emplace_back(i % 1000, i / 1000 % 1000, i / 1000000);
+			ofstream{dir / toHexString(ChunkGridCoordinateToId(positions.back()))};
+		}
+
+		const auto open = [&](const char* what) {
+			const auto start = Clock::now();
+			ChunkSerializer serializer(dir);
+			const auto seconds = secondsSince(start);
+
+			const auto lookupStart = Clock::now();
+			size_t found = 0;
+			for (const auto& pos : positions)
+				found += serializer.hasChunk(pos);
+			const auto lookupSeconds = secondsSince(lookupStart);
+
+			const auto stats = serializer.manifestStats();
+			cout << setw(9) << what << ": " << fixed << setprecision(3) << seconds * 1000 << "ms to open " << stats.manifestEntries << " chunks (" << stats.rebuilds
+				 << " rebuilds), " << setprecision(1) << lookupSeconds * 1e9 / positions.size() << "ns per lookup, " << found << " found\n"
+				 << defaultfloat;
+		};
+		open("listing"); // no manifest yet
+		open("manifest");
+
+		// a chunk file deleted behind the manifest's back is only noticed when it is loaded
+		filesystem::remove(dir / toHexString(ChunkGridCoordinateToId(positions[0])));
+		{
+			ChunkSerializer serializer(dir);
+			while (!serializer.get(positions[0]))
+				this_thread::sleep_for(chrono::milliseconds(1));
+			serializer.flush();
+			const auto stats = serializer.manifestStats();
+			cout << "    stale: chunk regenerated, " << stats.rebuilds << " rebuild in " << fixed << setprecision(3) << stats.rebuildSeconds * 1000 << "ms, "
+				 << stats.manifestEntries << " chunks listed\n"
+				 << defaultfloat;
+		}
+		open("rebuilt");
+
+		filesystem::remove_all(dir);
+		return 0;
+	}
+
+	int benchmarkMappedLoading(const vector<string>& args) {
+		const auto side = argOr(args, 1, 16);
+		if (args.size() > 2)
+			ChunkCreator::setDensityGraph(DensityGraph::load(args[2]));
+		global::enableChunkCache = true;
+
+		// three layers of chunks around the surface
+		vector<glm::ivec3> positions;
+		for (int z = -1; z <= 1; z++)
+			for (int y = 0; y < side; y++)
+				for (int x = 0; x < side; x++)
+					positions.emplace_back(x, y, z);
+
+		const auto dir = filesystem::temp_directory_path() / "dpg_bench_mapping";
+		filesystem::remove_all(dir);
+		{
+			ChunkSerializer serializer(dir);
+			for (const auto& pos : positions)
+				serializer.storeChunk(ChunkCreator::createChunk(pos, Mesher::MARCHING_CUBES));
+		}
+
+		// mapped first, so the heap freed by reading does not hide the heap growth of mapping
+		for (const auto mapped : {true, false}) {
+			global::mapChunkFiles = mapped;
+			const auto [anonBefore, fileBefore] = residentMemory();
+			{
+				ChunkSerializer serializer(dir);
+				vector<optional<Chunk>> chunks(positions.size());
+				for (size_t remaining = positions.size(); remaining > 0;)
+					for (size_t i = 0; i < positions.size(); i++)
+						if (!chunks[i] && (chunks[i] = serializer.get(positions[i])))
+							remaining--;
+
+				const auto [anonAfter, fileAfter] = residentMemory();
+				const auto stats = serializer.stats();
+				cout << (mapped ? "mapped: " : "read:   ") << stats.fullChunksLoaded << " chunks, " << fixed << setprecision(3)
+					 << stats.fullLoadSeconds * 1000 / stats.fullChunksLoaded << "ms load per chunk, resident heap +" << sizeToString(anonAfter - min(anonAfter, anonBefore))
+					 << ", resident file +" << sizeToString(fileAfter - min(fileAfter, fileBefore)) << "\n"
+					 << defaultfloat;
+			}
+		}
+		filesystem::remove_all(dir);
+		return 0;
+	}
+
+	int benchmarkSectionedLoading(const vector<string>& args) {
+		const auto side = argOr(args, 1, 16);
+		const auto nearRadius = argOr(args, 2, 2);
+		if (args.size() > 3)
+			ChunkCreator::setDensityGraph(DensityGraph::load(args[3]));
+		global::enableChunkCache = true;
+
+		vector<glm::ivec3> positions;
+		for (int z = -1; z <= 1; z++)
+			for (int y = 0; y < side; y++)
+				for (int x = 0; x < side; x++)
+					positions.emplace_back(x, y, z);
+
+		const auto dir = filesystem::temp_directory_path() / "dpg_bench_sections";
+		filesystem::remove_all(dir);
+		{
+			ChunkSerializer serializer(dir);
+			for (const auto& pos : positions)
+				serializer.storeChunk(ChunkCreator::createChunk(pos, Mesher::MARCHING_CUBES));
+		}
+
+		// every chunk is rendered, only the chunks near the middle are traced, which needs their densities
+		const auto middle = glm::ivec3{side / 2, side / 2, 0};
+		for (const auto mapped : {false, true}) {
+			global::mapChunkFiles = mapped;
+			for (const auto lazy : {false, true}) {
+				global::lazyDensities = lazy;
+				const auto [anonBefore, fileBefore] = residentMemory();
+				ChunkSerializer serializer(dir);
+				vector<optional<Chunk>> chunks(positions.size());
+				const auto start = Clock::now();
+				for (size_t remaining = positions.size(); remaining > 0;)
+					for (size_t i = 0; i < positions.size(); i++)
+						if (!chunks[i] && (chunks[i] = serializer.get(positions[i])))
+							remaining--;
+				const auto loadSeconds = secondsSince(start);
+
+				size_t traced = 0;
+				for (auto& c : chunks)
+					if (const auto d = glm::abs(c->chunkIndex() - middle); max(d.x, max(d.y, d.z)) <= nearRadius) {
+						for (int i = 0; i <= chunkResolution; i++)
+							c->densityAt({i, i, i});
+						traced++;
+					}
+
+				const auto [anonAfter, fileAfter] = residentMemory();
+				const auto io = serializer.ioStats();
+				const auto stats = serializer.stats();
+				const auto bytes = mapped ? fileAfter - min(fileAfter, fileBefore) : io.bytesRead + stats.densityBytesLoaded;
+				cout << (mapped ? "mapped, " : "read,   ") << (lazy ? "lazy densities:  " : "eager densities: ") << fixed << setprecision(3) << loadSeconds * 1000 / positions.size()
+					 << "ms per chunk, " << traced << " of " << positions.size() << " traced, " << stats.densityLoads << " lazy density loads, "
+					 << (mapped ? "resident file +" : "read ") << sizeToString(bytes) << " (" << sizeToString(bytes / positions.size()) << " per chunk)\n"
+					 << defaultfloat;
+			}
+		}
+		filesystem::remove_all(dir);
+		return 0;
+	}
+
+	int benchmarkDeduplication(const vector<string>& args) {
+		const auto side = argOr(args, 1, 16);
+		const auto layers = argOr(args, 2, 8);
+		if (args.size() > 3)
+			ChunkCreator::setDensityGraph(DensityGraph::load(args[3]));
+		global::enableChunkCache = true;
+
+		// layers of chunks through the surface, most of them air or solid rock
+		vector<glm::ivec3> positions;
+		for (int z = -layers / 2; z < layers - layers / 2; z++)
+			for (int y = 0; y < side; y++)
+				for (int x = 0; x < side; x++)
+					positions.emplace_back(x, y, z);
+
+		const auto [anonBefore, fileBefore] = residentMemory();
+		vector<Chunk> generated;
+		for (const auto& pos : positions)
+			generated.push_back(ChunkCreator::createChunk(pos, Mesher::MARCHING_CUBES));
+		const auto [anonGenerated, fileGenerated] = residentMemory();
+		const auto sharing = count_if(generated.begin(), generated.end(), [](const Chunk& c) { return c.densities.mapped(); });
+		cout << "generated: " << positions.size() << " chunks, " << sharing << " viewing shared densities, resident heap +"
+			 << sizeToString(anonGenerated - min(anonGenerated, anonBefore)) << " (" << sizeToString(sharing * generated.front().densities.byteSize()) << " not copied)\n";
+
+		const auto dir = filesystem::temp_directory_path() / "dpg_bench_dedup";
+		filesystem::remove_all(dir);
+		{
+			ChunkSerializer serializer(dir);
+			for (const auto& c : generated)
+				serializer.storeChunk(c);
+			serializer.flush();
+			for (const auto& c : generated)
+				serializer.storeChunk(c);
+			serializer.flush();
+
+			const auto stats = serializer.stats();
+			size_t files = 0, diskBytes = 0;
+			for (const auto& e : filesystem::recursive_directory_iterator{dir})
+				if (e.is_regular_file()) {
+					files++;
+					diskBytes += e.file_size();
+				}
+			cout << "stored:    " << stats.fullChunksStored << " payload files of " << sizeToString(stats.fullBytesStored) << ", " << stats.dedupedChunks << " chunks deduplicated ("
+				 << sizeToString(stats.dedupedBytes) << " not written), " << stats.unchangedChunks << " unchanged when stored again, " << files << " files with "
+				 << sizeToString(diskBytes) << " on disk\n";
+		}
+		generated.clear();
+
+		for (const auto mapped : {true, false}) {
+			global::mapChunkFiles = mapped;
+			const auto [anonBefore, fileBefore] = residentMemory();
+			ChunkSerializer serializer(dir);
+			vector<optional<Chunk>> chunks(positions.size());
+			const auto start = Clock::now();
+			for (size_t remaining = positions.size(); remaining > 0;)
+				for (size_t i = 0; i < positions.size(); i++)
+					if (!chunks[i] && (chunks[i] = serializer.get(positions[i])))
+						remaining--;
+			const auto loadSeconds = secondsSince(start);
+			for (auto& c : chunks)
+				c->densityAt({0, 0, 0});
+
+			const auto [anonAfter, fileAfter] = residentMemory();
+			const auto stats = serializer.stats();
+			cout << (mapped ? "mapped:    " : "read:      ") << fixed << setprecision(3) << loadSeconds * 1000 / positions.size() << "ms per chunk, "
+				 << stats.sharedLoads << " payload parts shared, " << stats.densityLoads << " density loads, resident heap +" << sizeToString(anonAfter - min(anonAfter, anonBefore))
+				 << ", resident file +" << sizeToString(fileAfter - min(fileAfter, fileBefore)) << "\n"
+				 << defaultfloat;
+		}
+
+		// a payload with the same hash but other bytes must not be shared, simulated by changing the stored payload
+		filesystem::remove_all(dir);
+		const auto original = ChunkCreator::createChunk({0, 0, 0}, Mesher::MARCHING_CUBES);
+		{
+			ChunkSerializer serializer(dir);
+			serializer.storeChunk(original);
+		}
+		for (const auto& e : filesystem::directory_iterator{dir / ChunkManifest::payloadDirectory}) {
+			fstream f(e.path(), ios::binary | ios::in | ios::out);
+			f.seekp(-1, ios::end);
+			f.put('\x7f');
+		}
+		bool separate = false;
+		{
+			ChunkSerializer serializer(dir);
+			serializer.storeChunk(original);
+			serializer.flush();
+			separate = serializer.stats().fullChunksStored == 1;
+		}
+		{
+			ChunkSerializer serializer(dir);
+			optional<Chunk> loaded;
+			while (!(loaded = serializer.get(original.chunkIndex()))) {}
+			glm::ivec3 l;
+			for (l.z = 0; l.z < chunkResolution; l.z++)
+				for (l.y = 0; l.y < chunkResolution; l.y++)
+					for (l.x = 0; l.x < chunkResolution; l.x++)
+						separate &= loaded->densityAt(l) == original.densityAt(l);
+		}
+		filesystem::remove_all(dir);
+		cout << "colliding payload: " << (separate ? "stored separately" : "SHARED") << "\n";
+		return separate ? 0 : 1;
+	}
+
+	int benchmarkExport(const vector<string>& args) {
+		const auto side = argOr(args, 1, 24);
+		const auto layers = argOr(args, 2, 4);
+		if (args.size() > 3)
+			ChunkCreator::setDensityGraph(DensityGraph::load(args[3]));
+
+		const auto from = glm::ivec3{0, 0, -layers / 2};
+		const auto to = glm::ivec3{side - 1, side - 1, layers - layers / 2 - 1};
+		const auto dir = filesystem::temp_directory_path() / "dpg_bench_export";
+		filesystem::remove_all(dir);
+		filesystem::create_directories(dir);
+
+		const auto source = [](const glm::ivec3& pos) { return ChunkCreator::createChunk(pos, Mesher::MARCHING_CUBES); };
+
+		// warms up the sample cache and the heap, so the runs below measure the export only
+		exportMeshes(dir / "warmup.ply", from, to, source);
+		bool progressed = true;
+		for (const auto* name : {"streamed.ply", "streamed.obj"}) {
+			ChunkCreator::setDensityGraph(DensityGraph{*ChunkCreator::densityGraph()}); // empties the sample cache of the previous run
+			resetPeakResidentMemory();
+			const auto baseline = peakResidentMemory();
+			std::size_t reported = 0;
+			const auto stats = exportMeshes(dir / name, from, to, source, [&](std::size_t written, std::size_t total) {
+				progressed &= written == reported + 1 && total == static_cast<std::size_t>(side) * side * layers;
+				reported = written;
+			});
+			progressed &= reported == stats.chunks;
+			cout << name << ": " << stats.chunks << " chunks, " << stats.triangles << " triangles, " << sizeToString(stats.bytes) << " in " << fixed << setprecision(3) << stats.seconds
+				 << "s, at most " << stats.maxChunksBuffered << " chunks buffered, peak resident +" << sizeToString(peakResidentMemory() - min(peakResidentMemory(), baseline)) << "\n"
+				 << defaultfloat;
+		}
+
+		// the previous way: expand all triangles of the region, then write them
+		{
+			ChunkCreator::setDensityGraph(DensityGraph{*ChunkCreator::densityGraph()});
+			resetPeakResidentMemory();
+			const auto baseline = peakResidentMemory();
+			const auto start = Clock::now();
+			vector<Triangle> triangles;
+			for (int z = from.z; z <= to.z; z++)
+				for (int y = from.y; y <= to.y; y++)
+					for (int x = from.x; x <= to.x; x++) {
+						const auto t = source({x, y, z}).fullTriangles();
+						triangles.insert(triangles.end(), t.begin(), t.end());
+					}
+			dumpTriangles(dir / "dumped.ply", triangles);
+			cout << "dumpTriangles: " << triangles.size() << " triangles, " << sizeToString(filesystem::file_size(dir / "dumped.ply")) << " in " << fixed << setprecision(3) << secondsSince(start)
+				 << "s, peak resident +" << sizeToString(peakResidentMemory() - min(peakResidentMemory(), baseline)) << "\n"
+				 << defaultfloat;
+		}
+		filesystem::remove_all(dir);
+		cout << "progress: " << (progressed ? "reported for every chunk" : "MISSING") << "\n";
+		return progressed ? 0 : 1;
+	}
+
+	int benchmarkProfiler(const vector<string>& args) {
+		const auto markers = argOr(args, 1, 10'000'000);
+		const auto radius = argOr(args, 2, 4);
+		const auto frames = argOr(args, 3, 120);
+
+		// cost of a marker, drained like once per frame so no events are dropped
+		volatile uint64_t sink = 0;
+		for (const auto enabled : {false, true}) {
+			Profiler::setEnabled(enabled);
+			const auto start = Clock::now();
+			for (int i = 0; i < markers; i++) {
+				PROFILE_SCOPE("marker");
+				sink = sink + i;
+				if (i % 10'000 == 0)
+					Profiler::endFrame();
+			}
+			Profiler::endFrame();
+			cout << (enabled ? "enabled:  " : "disabled: ") << fixed << setprecision(2) << secondsSince(start) * 1e9 / markers << "ns per marker\n" << defaultfloat;
+		}
+#if !DPG_PROFILING
+		cout << "markers compiled out (DPG_PROFILING=0)\n";
+#endif
+
+		// a capture of the world loading and then flying along x, written as a Chrome trace
+		Profiler::setThreadName("main");
+		Profiler::startCapture();
+		World world;
+		Camera camera;
+		camera.position = {8, 8, 8};
+		global::CAMERA_CHUNK_RADIUS = radius;
+		for (int f = 0; f < frames; f++) {
+			camera.position.x += 4;
+			world.update(camera);
+			Profiler::endFrame();
+			this_thread::sleep_for(chrono::milliseconds(16));
+		}
+		Profiler::stopCapture();
+		Profiler::setEnabled(false);
+
+		const auto path = filesystem::temp_directory_path() / "dpg_bench_profile.json";
+		Profiler::writeChromeTrace(path);
+		cout << Profiler::capturedFrames() << " frames captured, " << Profiler::droppedEvents() << " events dropped, trace " << sizeToString(filesystem::file_size(path)) << " at " << path.string() << "\n";
+		return 0;
+	}
+
+	int benchmarkPrefetch(const vector<string>& args) {
+		const auto speed = argOr(args, 1, 64);
+		const auto radius = argOr(args, 2, 4);
+		const auto seconds = argOr(args, 3, 5);
+		if (args.size() > 4)
+			ChunkCreator::setDensityGraph(DensityGraph::load(args[4]));
+
+		// the camera flies along the surface at constant speed, updating the world at 60 frames per second
+		for (const auto prefetch : {false, true}) {
+			global::prefetchChunks = prefetch;
+			ChunkCreator::setDensityGraph(DensityGraph{*ChunkCreator::densityGraph()}); // empties the sample cache of the previous run
+			World world;
+			const auto start = glm::vec3{8, 8, 8};
+			loadWorld(world, start, radius);
+
+			Camera camera;
+			camera.position = start;
+			const auto velocity = glm::vec3{speed, 0, 0};
+			constexpr auto frame = chrono::microseconds(16667);
+			const auto flightStart = Clock::now();
+			for (auto next = flightStart; secondsSince(flightStart) < seconds; next += frame) {
+				this_thread::sleep_until(next);
+				camera.position = start + velocity * static_cast<float>(secondsSince(flightStart));
+				world.update(camera, velocity);
+			}
+
+			const auto stats = world.prefetchStats();
+			cout << (prefetch ? "prefetch:    " : "no prefetch: ") << stats.entered << " chunks entered, " << stats.hits << " loaded before (" << fixed << setprecision(1)
+				 << (stats.entered > 0 ? 100.0 * stats.hits / stats.entered : 0.0) << "%), " << stats.requested << " prefetched, time to visible avg " << setprecision(2)
+				 << stats.averageTimeToVisible * 1000 << "ms, max " << stats.maxTimeToVisible * 1000 << "ms\n"
+				 << defaultfloat;
+		}
+		return 0;
+	}
+
+	// A circle along the surface at constant speed, looking ahead, at 60 frames per second.
+	auto circlePath(float speed, float seconds, int radius) -> CameraPath {
+		constexpr auto frames = 60;
+		const auto circleRadius = speed * seconds / degToRad(360.0f);
+		CameraPath path;
+		path.chunkRadius = radius;
+		Camera camera;
+		for (int f = 0; f < seconds * frames; f++) {
+			const auto angle = speed * f / frames / circleRadius;
+			camera.position = glm::vec3{8 + circleRadius * std::sin(angle), 8 + circleRadius * (1 - std::cos(angle)), 8};
+			camera.yaw = radToDeg(angle);
+			path.record(1.0 / frames, camera);
+		}
+		return path;
+	}
+
+	int benchmarkReplay(const vector<string>& args) {
+		const auto path = args.size() > 1 && args[1] != "-" ? CameraPath::load(args[1]) : circlePath(64, 20, 4);
+		const auto radius = argOr(args, 2, path.chunkRadius > 0 ? path.chunkRadius : 4);
+		if (args.size() > 3)
+			ChunkCreator::setDensityGraph(DensityGraph::load(args[3]));
+		const auto projection = glm::perspective(45.0f, 4.0f / 3.0f, 0.1f, 1000.0f);
+
+		World world;
+		Camera camera;
+		path.apply(0, camera);
+		loadWorld(world, camera.position, radius);
+
+		// each frame gets the camera and the interval recorded for it, the replay waits where a frame took less than that
+		resetPeakResidentMemory();
+		MemoryTracker::resetPeaks();
+		const auto baseline = peakResidentMemory();
+		vector<double> frameSeconds;
+		size_t overBudget = 0;
+		auto next = Clock::now();
+		for (size_t f = 0; f < path.size(); f++) {
+			const auto previousPosition = camera.position;
+			const auto interval = path.apply(f, camera);
+			next += chrono::duration_cast<Clock::duration>(chrono::duration<double>(interval));
+
+			const auto frameStart = Clock::now();
+			world.update(camera, interval > 0 ? (camera.position - previousPosition) / static_cast<float>(interval) : glm::vec3{});
+			world.cull(camera, projection * camera.viewMatrix());
+			frameSeconds.push_back(secondsSince(frameStart));
+			if (frameSeconds.back() > interval)
+				overBudget++;
+			this_thread::sleep_until(next);
+		}
+
+		const auto stats = world.prefetchStats();
+		cout << "replayed " << path.size() << " frames (" << fixed << setprecision(1) << path.seconds() << "s) at radius " << radius << ", " << overBudget
+			 << " frames longer than recorded\n"
+			 << defaultfloat;
+		printDistribution("frame time:      ", frameSeconds);
+		cout << "chunks entered:  " << stats.entered << ", " << stats.hits << " loaded before (" << fixed << setprecision(1) << (stats.entered > 0 ? 100.0 * stats.hits / stats.entered : 0.0) << "%)\n"
+			 << defaultfloat;
+		// the prefetcher keeps no list of the times, the histogram has the distribution in buckets doubling in size
+		const auto& timeToVisible = Metrics::histogram("dpg_time_to_visible_seconds", "");
+		const auto quantileMs = [&](double fraction) { return min(timeToVisible.quantile(fraction), stats.maxTimeToVisible) * 1000; };
+		cout << "time to visible: " << fixed << setprecision(2) << "p50 <= " << quantileMs(0.5) << "ms, p90 <= " << quantileMs(0.9) << "ms, p99 <= " << quantileMs(0.99)
+			 << "ms, max " << stats.maxTimeToVisible * 1000 << "ms\n"
+			 << defaultfloat;
+		cout << "peak resident:   " << sizeToString(peakResidentMemory()) << ", +" << sizeToString(peakResidentMemory() - min(peakResidentMemory(), baseline)) << " during the replay\n";
+		for (size_t i = 0; i < memoryTagCount; i++) {
+			const auto s = MemoryTracker::stats(static_cast<MemoryTag>(i));
+			cout << "  " << left << setw(15) << tagName(static_cast<MemoryTag>(i)) << right << sizeToString(static_cast<size_t>(s.liveBytes)) << " live, "
+				 << sizeToString(static_cast<size_t>(s.peakBytes)) << " peak, " << s.allocations << " allocations\n";
+		}
+
+		const auto metricsPath = filesystem::temp_directory_path() / "dpg_bench_replay.prom";
+		world.updateMetrics();
+		Metrics::writeFile(metricsPath);
+		cout << "metrics:         " << metricsPath.string() << "\n";
+		return 0;
+	}
+
+	int benchmarkCompressedChunks(const vector<string>& args) {
+		const auto distance = argOr(args, 1, 12);
+		const auto radius = argOr(args, 2, 3);
+		if (args.size() > 3)
+			ChunkCreator::setDensityGraph(DensityGraph::load(args[3]));
+		global::CAMERA_CHUNK_RADIUS = radius;
+		global::prefetchChunks = false;
+
+		// the camera walks chunk by chunk away from the start and back, waiting at each chunk until the render sphere is loaded
+		struct Mode {
+			const char* name;
+			bool compress;
+			int budgetMiB;
+		};
+		for (const auto& mode : {Mode{"all loaded", false, 0}, Mode{"regenerate", true, 0}, Mode{"compressed", true, 256}}) {
+			global::compressChunks = mode.compress;
+			global::compressedCacheMiB = mode.budgetMiB;
+			ChunkCreator::setDensityGraph(DensityGraph{*ChunkCreator::densityGraph()}); // empties the sample cache of the previous run
+			const auto [anonBefore, fileBefore] = residentMemory();
+			World world;
+			Camera camera;
+			const auto walk = [&](int from, int to) {
+				const auto start = Clock::now();
+				for (int x = from;; x += from < to ? 1 : -1) {
+					camera.position = glm::vec3{x + 0.5f, 0.5f, 0.5f} * static_cast<float>(chunkResolution);
+					do
+						world.update(camera);
+					while (!world.chunksLoaded());
+					if (x == to)
+						break;
+				}
+				return secondsSince(start);
+			};
+			const auto outSeconds = walk(0, distance);
+			const auto backSeconds = walk(distance, 0);
+			const auto [anonAfter, fileAfter] = residentMemory();
+
+			const auto stats = world.compressedCacheStats();
+			cout << setw(10) << mode.name << ": out " << fixed << setprecision(1) << outSeconds * 1000 << "ms, back " << backSeconds * 1000 << "ms, "
+				 << world.loadedChunkCount() << " chunks loaded, resident heap +" << sizeToString(anonAfter - min(anonAfter, anonBefore)) << ", " << stats.hits << " of "
+				 << stats.inserted << " evicted chunks decompressed" << setprecision(3);
+			if (stats.inserted > 0)
+				cout << ", " << stats.compressSeconds * 1000 / stats.inserted << "ms compress";
+			if (stats.hits > 0)
+				cout << ", " << stats.decompressSeconds * 1000 / stats.hits << "ms decompress";
+			if (stats.uncompressedBytes > 0)
+				cout << ", ratio " << setprecision(2) << static_cast<double>(stats.uncompressedBytes) / stats.bytes;
+			cout << "\n" << defaultfloat;
+		}
+		return 0;
+	}
+
+	int benchmarkCulling(const vector<string>& args) {
+		const auto radius = argOr(args, 1, 6);
+		const auto projection = glm::perspective(45.0f, 4.0f / 3.0f, 0.1f, 1000.0f);
+
+		for (const auto z : {8.0f, -40.0f}) {
+			World world;
+			const auto pos = glm::vec3{8, 8, z};
+			loadWorld(world, pos, radius);
+
+			Camera camera;
+			camera.position = pos;
+			for (const auto pitch : {0.0f, -45.0f}) {
+				camera.pitch = pitch;
+				for (const auto occlusion : {false, true}) {
+					global::occlusionCulling = occlusion;
+					const auto start = Clock::now();
+					world.cull(camera, projection * camera.viewMatrix());
+					const auto seconds = secondsSince(start);
+
+					const auto& stats = world.cullStats();
+					cout << defaultfloat << "camera at z " << setw(4) << z << ", pitch " << setw(4) << pitch << (occlusion ? ", occlusion culling:    " : ", frustum culling only: ")
+						 << stats.inRadius << " in radius, " << stats.inFrustum << " in frustum, " << stats.drawn << " drawn, "
+						 << fixed << setprecision(3) << seconds * 1000 << "ms\n";
+				}
+			}
+		}
+		return 0;
+	}
+
+	int benchmarkDensityGraph(const vector<string>& args) {
+		const auto graph = args.size() > 1 ? DensityGraph::load(args[1]) : DensityGraph::defaultGraph();
+		const auto chunks = argOr(args, 2, 200);
+
+		// the density function hard-coded before density graphs, as reference for the default graph
+		const auto handWritten = [](glm::vec3 pos) {
+			return -pos.z + 0.5f + pos.x * 0.1f;
+		};
+
+		const unsigned int size = chunkSamples;
+		const auto count = size * size * size;
+		vector<float> xs(count), ys(count), zs(count), densities(count);
+
+		auto start = Clock::now();
+		float checksum = 0;
+		for (int c = 0; c < chunks; c++) {
+			for (unsigned int z = 0; z < size; z++)
+				for (unsigned int y = 0; y < size; y++)
+					for (unsigned int x = 0; x < size; x++)
+						densities[z * size * size + y * size + x] = handWritten({x + c * static_cast<float>(chunkResolution), y, z});
+			checksum += densities[c % count];
+		}
+		const auto handSeconds = secondsSince(start);
+
+		start = Clock::now();
+		for (int c = 0; c < chunks; c++) {
+			for (unsigned int z = 0; z < size; z++) {
+				for (unsigned int y = 0; y < size; y++) {
+					for (unsigned int x = 0; x < size; x++) {
+						const auto i = z * size * size + y * size + x;
+						xs[i] = x + c * static_cast<float>(chunkResolution);
+						ys[i] = y;
+						zs[i] = z;
+					}
+				}
+			}
+			graph.evaluate(xs.data(), ys.data(), zs.data(), densities.data(), count);
+			checksum += densities[c % count];
+		}
+		const auto graphSeconds = secondsSince(start);
+
+		const auto samples = static_cast<double>(count) * chunks;
+		cout << graph.instructionCount() << " instructions, " << chunks << " chunks (checksum " << checksum << ")\n"
+			 << fixed << setprecision(0)
+			 << "hand-written: " << samples / handSeconds << " samples/s\n"
+			 << "graph:        " << samples / graphSeconds << " samples/s\n"
+			 << "per node:\n";
+		for (const auto& cost : graph.profile(1 << 20))
+			cout << "    " << setw(12) << left << cost.node << setw(12) << cost.op << right << setprecision(2) << cost.nanosecondsPerSample << " ns/sample\n";
+		return 0;
+	}
+
+	int benchmarkDensityBounds(const vector<string>& args) {
+		const auto boxes = argOr(args, 1, 2000);
+
+		// warps with negative amounts and frequencies flip the noise interval, which the bounds must follow
+		const vector<pair<const char*, string>> graphs = {
+			{"default", ""},
+			{"warp +", "density = warp z x y z 8 0.05\n"},
+			{"warp -", "density = warp z x y z -8 0.05\n"},
+			{"warp -f", "density = warp z x y z -8 -0.05 3\n"},
+			{"perlin", "n = perlin x y z 0.1\ndensity = mul n -6\n"},
+			{"fbm", "hills = fbm x y 0 0.02 4\nheight = mul hills 12\ndensity = sub height z\n"},
+			{"domain", "wx = warp x x y z 4 0.05\nwy = warp y x y z -4 0.05 37\nwz = warp z x y z 4 0.05 71\nn = perlin wx wy wz 0.1\n"
+					   "m = mul n -6\ndensity = sub m wz\n"},
+		};
+
+		auto failed = false;
+		for (const auto& [name, source] : graphs) {
+			const auto graph = source.empty() ? DensityGraph::defaultGraph() : DensityGraph::parse(source);
+
+			// brute force: the densities at a grid of points in each box must lie within the box's bounds
+			constexpr auto side = 9;
+			vector<float> xs(side * side * side), ys(xs.size()), zs(xs.size()), densities(xs.size());
+			mt19937 rng(42);
+			uniform_real_distribution<float> corner(-200, 200);
+			uniform_real_distribution<float> size(0.5f, 2.0f * chunkResolution);
+			size_t violations = 0;
+			float worst = 0;
+			for (int b = 0; b < boxes; b++) {
+				const auto lower = glm::vec3{corner(rng), corner(rng), corner(rng) / 10};
+				const auto box = BoundingBox{lower, lower + glm::vec3{size(rng)}};
+				for (size_t i = 0; i < xs.size(); i++) {
+					const auto t = glm::vec3{i % side, i / side % side, i / (side * side)} / static_cast<float>(side - 1);
+					const auto p = box.lower + t * (box.upper - box.lower);
+					xs[i] = p.x;
+					ys[i] = p.y;
+					zs[i] = p.z;
+				}
+				graph.evaluate(xs.data(), ys.data(), zs.data(), densities.data(), xs.size());
+				const auto bounds = graph.bounds(box);
+				const auto [minIt, maxIt] = minmax_element(densities.begin(), densities.end());
+				const auto excess = max(bounds.lower - *minIt, *maxIt - bounds.upper);
+				if (excess > 1e-4f) {
+					violations++;
+					worst = max(worst, excess);
+				}
+			}
+			cout << setw(8) << left << name << right << ": " << boxes << " boxes, " << violations << " outside their bounds";
+			if (violations > 0)
+				cout << " (by up to " << worst << ")";
+			cout << "\n";
+			failed |= violations > 0;
+		}
+		return failed ? 1 : 0;
+	}
+
+	int benchmarkGeneration(const vector<string>& args) {
+		if (args.size() > 1)
+			ChunkCreator::setDensityGraph(DensityGraph::load(args[1]));
+		const auto radius = argOr(args, 2, 3);
+		const auto height = argOr(args, 3, 8);
+
+		// columns of chunks reaching far above and below the surface
+		vector<glm::ivec3> positions;
+		for (int z = -height; z <= height; z++)
+			for (int y = -radius; y <= radius; y++)
+				for (int x = -radius; x <= radius; x++)
+					positions.emplace_back(x, y, z);
+
+		size_t referenceVertices = 0;
+		for (const auto bounds : {false, true}) {
+			global::densityBounds = bounds;
+			GenerationStats total;
+			size_t vertices = 0;
+			const auto start = Clock::now();
+			for (const auto& pos : positions) {
+				GenerationStats stats;
+				vertices += ChunkCreator::createChunk(pos, Mesher::MARCHING_CUBES, &stats).vertices.size();
+				total.chunksSkipped += stats.chunksSkipped;
+				total.samplesEvaluated += stats.samplesEvaluated;
+				total.samplesSkipped += stats.samplesSkipped;
+				total.samplesReused += stats.samplesReused;
+			}
+			const auto seconds = secondsSince(start);
+			if (!bounds)
+				referenceVertices = vertices;
+
+			cout << (bounds ? "with bounds:    " : "without bounds: ") << positions.size() << " chunks in " << fixed << setprecision(3) << seconds << "s, "
+				 << total.chunksSkipped << " skipped, " << total.samplesEvaluated << " samples evaluated, " << total.samplesSkipped << " skipped, " << total.samplesReused << " reused, "
+				 << vertices << " vertices" << (vertices == referenceVertices ? "" : " (MISMATCH)") << "\n";
+		}
+		return 0;
+	}
+
+	int benchmarkDensityStorage(const vector<string>& args) {
+		if (args.size() > 1)
+			ChunkCreator::setDensityGraph(DensityGraph::load(args[1]));
+		const auto radius = argOr(args, 2, 2);
+		const auto repetitions = argOr(args, 3, 5);
+
+		// reference chunks along the surface, generated and meshed with float densities
+		global::densityFormat = static_cast<int>(DensityFormat::FLOAT);
+		vector<Chunk> reference;
+		for (int z = -1; z <= 1; z++)
+			for (int y = -radius; y <= radius; y++)
+				for (int x = -radius; x <= radius; x++)
+					if (auto c = ChunkCreator::createChunk({x, y, z}, Mesher::MARCHING_CUBES); !c.vertices.empty())
+						reference.push_back(move(c));
+
+		const auto cell = [](glm::vec3 p) { return glm::ivec3{glm::floor(p)}; };
+
+		for (const auto format : {DensityFormat::FLOAT, DensityFormat::HALF, DensityFormat::INT16, DensityFormat::INT8}) {
+			vector<Chunk> chunks;
+			size_t bytes = 0;
+			for (const auto& r : reference) {
+				Chunk c(r.chunkIndex());
+				c.densities = r.densities;
+				c.densities.convert(format);
+				bytes += c.densities.byteSize();
+				chunks.push_back(move(c));
+			}
+
+			const auto start = Clock::now();
+			for (int i = 0; i < repetitions; i++)
+				for (auto& c : chunks)
+					c.march();
+			const auto seconds = secondsSince(start);
+
+			// distance from each vertex to the nearest reference vertex, and the angle between their normals
+			double positionError = 0, maxPositionError = 0, normalError = 0;
+			size_t vertices = 0;
+			for (size_t i = 0; i < chunks.size(); i++) {
+				unordered_multimap<glm::ivec3, const RVertex*> grid;
+				for (const auto& v : reference[i].vertices)
+					grid.emplace(cell(v.position), &v);
+				for (const auto& v : chunks[i].vertices) {
+					const RVertex* nearest = nullptr;
+					auto nearestDistance = numeric_limits<float>::max();
+					glm::ivec3 d;
+					for (d.z = -1; d.z <= 1; d.z++)
+						for (d.y = -1; d.y <= 1; d.y++)
+							for (d.x = -1; d.x <= 1; d.x++)
+								for (auto [it, end] = grid.equal_range(cell(v.position) + d); it != end; ++it)
+									if (const auto dist = glm::distance(v.position, it->second->position); dist < nearestDistance) {
+										nearestDistance = dist;
+										nearest = it->second;
+									}
+					if (!nearest)
+						continue;
+					positionError += nearestDistance;
+					maxPositionError = max<double>(maxPositionError, nearestDistance);
+					normalError += acos(glm::clamp(glm::dot(v.normal, nearest->normal), -1.0f, 1.0f));
+					vertices++;
+				}
+			}
+
+			cout << setw(6) << formatName(format) << ": " << sizeToString(bytes / chunks.size()) << " densities per chunk, "
+				 << fixed << setprecision(3) << seconds * 1000 / (repetitions * chunks.size()) << "ms march, "
+				 << setprecision(5) << "vertex error avg " << positionError / vertices << " max " << maxPositionError << ", "
+				 << "normal error avg " << radToDeg(normalError / vertices) << " deg\n";
+		}
+		return 0;
+	}
+
+	int benchmarkMeshers(const vector<string>& args) {
+		if (args.size() > 1)
+			ChunkCreator::setDensityGraph(DensityGraph::load(args[1]));
+		const auto radius = argOr(args, 2, 2);
+		const auto repetitions = argOr(args, 3, 5);
+
+		vector<Chunk> chunks;
+		for (int z = -1; z <= 1; z++)
+			for (int y = -radius; y <= radius; y++)
+				for (int x = -radius; x <= radius; x++)
+					chunks.push_back(ChunkCreator::createChunk({x, y, z}, Mesher::MARCHING_CUBES));
+
+		for (const auto mesher : {Mesher::MARCHING_CUBES, Mesher::SURFACE_NETS}) {
+			const auto start = Clock::now();
+			for (int i = 0; i < repetitions; i++)
+				for (auto& c : chunks)
+					c.mesh(mesher);
+			const auto seconds = secondsSince(start);
+
+			// triangles whose winding agrees with their vertex normals
+			size_t vertices = 0, triangles = 0, consistent = 0;
+			for (const auto& c : chunks) {
+				vertices += c.vertices.size();
+				triangles += c.triangles.size();
+				for (const auto& t : c.triangles) {
+					const auto& a = c.vertices[t[0]];
+					const auto& b = c.vertices[t[1]];
+					const auto& d = c.vertices[t[2]];
+					const auto face = glm::cross(b.position - a.position, d.position - a.position);
+					if (glm::dot(face, a.normal + b.normal + d.normal) > 0)
+						consistent++;
+				}
+			}
+
+			cout << (mesher == Mesher::MARCHING_CUBES ? "marching cubes: " : "surface nets:   ") << vertices << " vertices, " << triangles << " triangles, "
+				 << sizeToString(vertices * sizeof(RVertex) + triangles * sizeof(glm::uvec3)) << " upload, " << fixed << setprecision(3)
+				 << seconds * 1000 / (repetitions * chunks.size()) << "ms per chunk, " << setprecision(1) << 100.0 * consistent / triangles << "% consistently wound\n"
+				 << defaultfloat;
+		}
+
+		// a chunk stored by one mesher and loaded while the other is active gets the mesh of the active one
+		const auto dir = filesystem::temp_directory_path() / "dpg_bench_mesher";
+		filesystem::remove_all(dir);
+		global::enableChunkCache = true;
+		{
+			ChunkSerializer serializer(dir);
+			serializer.storeChunk(ChunkCreator::createChunk({0, 0, 0}, Mesher::MARCHING_CUBES));
+		}
+		bool remeshed = false;
+		{
+			ChunkSerializer serializer(dir);
+			serializer.setMesher(Mesher::SURFACE_NETS);
+			const auto loaded = serializer.read({0, 0, 0});
+			const auto fresh = ChunkCreator::createChunk({0, 0, 0}, Mesher::SURFACE_NETS);
+			remeshed = loaded.mesher == Mesher::SURFACE_NETS && loaded.vertices.size() == fresh.vertices.size() && loaded.triangles.size() == fresh.triangles.size();
+		}
+		filesystem::remove_all(dir);
+		cout << "stored by marching cubes, loaded for surface nets: " << (remeshed ? "remeshed" : "STORED MESH KEPT") << "\n";
+		return remeshed ? 0 : 1;
+	}
+
+	int benchmarkNormals(const vector<string>& args) {
+		if (args.size() > 1)
+			ChunkCreator::setDensityGraph(DensityGraph::load(args[1]));
+		const auto radius = argOr(args, 2, 2);
+		const auto repetitions = argOr(args, 3, 20);
+
+		vector<Chunk> chunks;
+		for (int z = -1; z <= 1; z++)
+			for (int y = -radius; y <= radius; y++)
+				for (int x = -radius; x <= radius; x++)
+					if (auto c = ChunkCreator::createChunk({x, y, z}, Mesher::MARCHING_CUBES); !c.vertices.empty())
+						chunks.push_back(move(c));
+
+		const auto start = Clock::now();
+		for (int i = 0; i < repetitions; i++)
+			for (auto& c : chunks)
+				c.march();
+		const auto seconds = secondsSince(start);
+
+		// the angle between each vertex normal and the normal of the density graph at the vertex
+		const auto graph = ChunkCreator::densityGraph();
+		constexpr auto h = 0.01f;
+		vector<double> errors;
+		for (const auto& c : chunks) {
+			for (const auto& v : c.vertices) {
+				const auto p = v.position;
+				const glm::vec3 g{
+					graph->evaluate(p + glm::vec3{h, 0, 0}) - graph->evaluate(p - glm::vec3{h, 0, 0}),
+					graph->evaluate(p + glm::vec3{0, h, 0}) - graph->evaluate(p - glm::vec3{0, h, 0}),
+					graph->evaluate(p + glm::vec3{0, 0, h}) - graph->evaluate(p - glm::vec3{0, 0, h})};
+				if (g == glm::vec3{0})
+					continue;
+				errors.push_back(radToDeg(acos(glm::clamp(glm::dot(v.normal, -glm::normalize(g)), -1.0f, 1.0f))));
+			}
+		}
+		sort(errors.begin(), errors.end());
+		const auto average = accumulate(errors.begin(), errors.end(), 0.0) / errors.size();
+
+		cout << chunks.size() << " chunks, " << errors.size() << " vertices, " << fixed << setprecision(3) << seconds * 1000 / (repetitions * chunks.size())
+			 << "ms march per chunk, normal error avg " << setprecision(2) << average << " deg, median " << errors[errors.size() / 2] << " deg, p99 " << errors[errors.size() * 99 / 100] << " deg, max "
+			 << errors.back() << " deg\n"
+			 << defaultfloat;
+		return 0;
+	}
+
+	int benchmarkResolution(const vector<string>& args) {
+		// the same volume of terrain for every resolution, so builds with different DPG_CHUNK_RESOLUTION can be compared
+		const auto side = argOr(args, 1, 128);
+		const auto chunksPerSide = max(1, side / chunkResolution);
+
+		vector<double> chunkSeconds;
+		size_t densityBytes = 0, meshBytes = 0;
+		const auto start = Clock::now();
+		for (int z = -chunksPerSide / 2; z < chunksPerSide - chunksPerSide / 2; z++) {
+			for (int y = 0; y < chunksPerSide; y++) {
+				for (int x = 0; x < chunksPerSide; x++) {
+					const auto chunkStart = Clock::now();
+					const auto c = ChunkCreator::createChunk({x, y, z}, Mesher::MARCHING_CUBES);
+					chunkSeconds.push_back(secondsSince(chunkStart));
+					densityBytes += c.densities.byteSize();
+					meshBytes += c.vertices.size() * sizeof(RVertex) + c.triangles.size() * sizeof(glm::uvec3);
+				}
+			}
+		}
+		const auto seconds = secondsSince(start);
+
+		sort(chunkSeconds.begin(), chunkSeconds.end());
+		const auto voxels = pow(static_cast<double>(chunksPerSide * chunkResolution), 3);
+		cout << "resolution " << chunkResolution << ": " << chunkSeconds.size() << " chunks for " << chunksPerSide * chunkResolution << "^3 voxels in "
+			 << fixed << setprecision(3) << seconds << "s, " << setprecision(1) << seconds * 1e9 / voxels << "ns per voxel\n"
+			 << "    chunk latency: median " << setprecision(3) << chunkSeconds[chunkSeconds.size() / 2] * 1000 << "ms, max " << chunkSeconds.back() * 1000 << "ms\n"
+			 << "    densities " << sizeToString(densityBytes) << " (" << setprecision(2) << densityBytes / voxels << " bytes per voxel), meshes " << sizeToString(meshBytes) << "\n"
+			 << defaultfloat;
+		return 0;
+	}
+
+	const map<string, function<int(const vector<string>&)>> benchmarks = {
+		{"bounds", benchmarkDensityBounds},
+		{"culling", benchmarkCulling},
+		{"compressed", benchmarkCompressedChunks},
+		{"dedup", benchmarkDeduplication},
+		{"delta", benchmarkDeltaPersistence},
+		{"density", benchmarkDensitySampling},
+		{"edit", benchmarkEditing},
+		{"export", benchmarkExport},
+		{"startup", benchmarkCacheStartup},
+		{"storage", benchmarkDensityStorage},
+		{"generation", benchmarkGeneration},
+		{"graph", benchmarkDensityGraph},
+		{"io", benchmarkChunkIO},
+		{"mapping", benchmarkMappedLoading},
+		{"mesher", benchmarkMeshers},
+		{"normals", benchmarkNormals},
+		{"physics", benchmarkPhysics},
+		{"prefetch", benchmarkPrefetch},
+		{"profiler", benchmarkProfiler},
+		{"replay", benchmarkReplay},
+		{"resolution", benchmarkResolution},
+		{"sections", benchmarkSectionedLoading},
+	};
+}
+
+int runBenchmark(const vector<string>& args) {
+	const auto it = args.empty() ? benchmarks.end() : benchmarks.find(args[0]);
+	if (it == benchmarks.end()) {
+		cerr << "usage: dpg --bench <name> [args...]\navailable benchmarks:\n";
+		for (const auto& [name, f] : benchmarks)
+			cerr << "    " << name << "\n";
+		return -1;
+	}
+
+	global::headless = true;
+	return it->second(args);
+}
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+/**
+* Runs the headless benchmark given by args[0] with the remaining args as parameters.
+* Returns the process exit code.
+*/
+int runBenchmark(const std::vector<std::string>& args);
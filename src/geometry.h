@@ -68,6 +68,32 @@ struct BoundingBox {
 	glm::vec3 upper;
 };
 
+/**
+* The six planes of a view frustum, with normals pointing inwards.
+*/
+struct Frustum {
+	std::array<glm::vec4, 6> planes;
+};
+
+// see: Gribb, Hartmann: Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix
+inline auto frustumFromMatrix(const glm::mat4& m) -> Frustum {
+	const auto row = [&](int i) { return glm::vec4{m[0][i], m[1][i], m[2][i], m[3][i]}; };
+	return {{row(3) + row(0), row(3) - row(0), row(3) + row(1), row(3) - row(1), row(3) + row(2), row(3) - row(2)}};
+}
+
+inline auto intersects(const Frustum& frustum, const BoundingBox& box) -> bool {
+	for (const auto& plane : frustum.planes) {
+		// the box corner furthest along the plane normal
+		const auto p = glm::vec3{
+			plane.x >= 0 ? box.upper.x : box.lower.x,
+			plane.y >= 0 ? box.upper.y : box.lower.y,
+			plane.z >= 0 ? box.upper.z : box.lower.z};
+		if (plane.x * p.x + plane.y * p.y + plane.z * p.z + plane.w < 0)
+			return false;
+	}
+	return true;
+}
+
 template<typename Range>
 void dumpTriangles(const std::filesystem::path& path, const Range& triangles) {
 	auto f = openFileOut(path, std::ios::binary);
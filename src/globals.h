@@ -10,8 +10,22 @@ namespace global {
 	inline bool showChunks = false;
 	inline bool showVoxels = true;
 	inline bool enableChunkCache = false;
+	inline bool mapChunkFiles = true; // view cached chunks in memory mapped files instead of reading them to the heap
+	inline bool lazyDensities = true; // load only the mesh of cached chunks, their densities when first accessed
+	inline bool ioUring = true; // chunk caches created afterwards submit their reads and writes through io_uring where available
 	inline bool freeCamera = false;
+	inline bool occlusionCulling = true;
+	inline bool compressChunks = true; // move chunks far outside the render sphere to a compressed in-memory cache instead of keeping them loaded
+	inline int compressedCacheMiB = 256; // budget of the compressed chunk cache, the chunks evicted longest ago are dropped beyond it
+	inline bool prefetchChunks = true; // load the chunks ahead of the moving camera before they enter the render sphere
+	inline bool densityBounds = true; // skip sampling regions the density graph proves to be solid or air
+	inline bool headless = false; // no GL context, chunks are not uploaded
+	inline int densityFormat = 0; // DensityFormat of generated and loaded chunks
 	inline int CAMERA_CHUNK_RADIUS = 0;
+	inline const char* densityGraphFile = "density.cfg"; // loaded at startup and on reload if it exists
+	inline bool writeMetrics = false; // write all metrics to metricsFile every metricsInterval seconds, for monitoring
+	inline int metricsInterval = 10;
+	inline const char* metricsFile = "metrics.prom";
 
 	namespace noise {
 		inline int octaves = 6;
@@ -4,14 +4,27 @@
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_opengl3.h>
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <fstream>
+#include <future>
 #include <iomanip>
 #include <iostream>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <type_traits>
 
 #include "Camera.h"
+#include "CameraPath.h"
+#include "ChunkCreator.h"
+#include "MemoryTracker.h"
+#include "Physics.h"
+#include "Metrics.h"
 #include "Player.h"
+#include "Profiler.h"
+#include "benchmarks.h"
 #include "timed.h"
 #include "World.h"
 #include "globals.h"
@@ -35,9 +48,207 @@ gl::Program coordsProgram;
 World world;
 Camera camera;
 Player player;
+PhysicsSystem physics;
+Brush brush;
 
 glm::mat4 projectionMatrix;
 
+std::string densityGraphStatus = "built-in";
+
+int exportRadius = 8;
+std::string exportStatus;
+std::future<MeshExportStats> exportResult;
+std::atomic<std::size_t> exportWritten{0};
+std::atomic<std::size_t> exportTotal{0};
+
+void exportMeshes(const char* path) {
+	exportWritten = 0;
+	exportTotal = 0;
+	exportStatus = path;
+	exportResult = world.exportMeshes(path, camera.position, exportRadius, [](std::size_t written, std::size_t total) {
+		exportWritten = written;
+		exportTotal = total;
+	});
+}
+
+void finishExport() {
+	if (!exportResult.valid() || exportResult.wait_for(std::chrono::seconds{0}) != std::future_status::ready)
+		return;
+	const std::string path = exportStatus;
+	try {
+		const auto stats = exportResult.get();
+		std::stringstream ss;
+		ss << path << ": " << stats.chunks << " chunks, " << stats.triangles << " triangles, " << sizeToString(stats.bytes) << " in " << std::fixed << std::setprecision(2) << stats.seconds << " s";
+		exportStatus = ss.str();
+	} catch (const std::exception& e) {
+		exportStatus = e.what();
+		cerr << e.what() << endl;
+	}
+}
+
+const auto cameraPathFile = "camera.path";
+CameraPath cameraPath;
+bool recordingPath = false;
+std::optional<std::size_t> replayFrame; // the next frame of cameraPath while it is replayed
+std::string cameraPathStatus;
+
+void startReplay() {
+	try {
+		cameraPath = CameraPath::load(cameraPathFile);
+		if (cameraPath.empty())
+			throw std::runtime_error(std::string{cameraPathFile} + " has no frames");
+		if (cameraPath.chunkRadius > 0)
+			global::CAMERA_CHUNK_RADIUS = cameraPath.chunkRadius;
+		recordingPath = false;
+		replayFrame = 0;
+		cameraPathStatus = "replaying " + std::to_string(cameraPath.size()) + " frames";
+	} catch (const std::exception& e) {
+		cameraPathStatus = e.what();
+		cerr << e.what() << endl;
+	}
+}
+
+void stopRecording() {
+	recordingPath = false;
+	try {
+		cameraPath.save(cameraPathFile);
+		std::stringstream ss;
+		ss << cameraPathFile << ": " << cameraPath.size() << " frames, " << std::fixed << std::setprecision(1) << cameraPath.seconds() << " s";
+		cameraPathStatus = ss.str();
+	} catch (const std::exception& e) {
+		cameraPathStatus = e.what();
+		cerr << e.what() << endl;
+	}
+}
+
+std::string metricsStatus;
+std::chrono::steady_clock::time_point lastMetricsWrite;
+
+void writeMetricsPeriodically() {
+	const auto now = std::chrono::steady_clock::now();
+	if (!global::writeMetrics || now - lastMetricsWrite < std::chrono::seconds(global::metricsInterval))
+		return;
+	lastMetricsWrite = now;
+	world.updateMetrics();
+	try {
+		Metrics::writeFile(global::metricsFile);
+		metricsStatus = std::string{"written to "} + global::metricsFile;
+	} catch (const std::exception& e) {
+		metricsStatus = e.what();
+		cerr << e.what() << endl;
+	}
+}
+
+void drawMetrics() {
+	Metrics::forEach([](const std::string& name, const auto& metric) {
+		using T = std::decay_t<decltype(metric)>;
+		if constexpr (std::is_same_v<T, Histogram>)
+			ImGui::Text("%s: %llu, p50 <= %.3f ms, p99 <= %.3f ms", name.c_str(), static_cast<unsigned long long>(metric.count()), metric.quantile(0.5) * 1000,
+						metric.quantile(0.99) * 1000);
+		else
+			ImGui::Text("%s: %lld", name.c_str(), static_cast<long long>(metric.value()));
+	});
+}
+
+void drawMemory() {
+	ImGui::Text("allocated by subsystem: live, peak, allocations");
+	for (std::size_t i = 0; i < memoryTagCount; i++) {
+		const auto tag = static_cast<MemoryTag>(i);
+		const auto s = MemoryTracker::stats(tag);
+		ImGui::LabelText(tagName(tag), "%s, %s, %llu", sizeToString(static_cast<size_t>(s.liveBytes)).c_str(),
+						 sizeToString(static_cast<size_t>(s.peakBytes)).c_str(), static_cast<unsigned long long>(s.allocations));
+	}
+	if (ImGui::Button("reset peaks"))
+		MemoryTracker::resetPeaks();
+
+	const auto mem = world.memoryFootprint();
+	ImGui::Separator();
+	ImGui::Text("loaded chunks");
+	ImGui::LabelText("densities", "%s", sizeToString(mem.densityBytes).c_str());
+	ImGui::LabelText("vertices", "%s", sizeToString(mem.vertexBytes).c_str());
+	ImGui::LabelText("triangles", "%s", sizeToString(mem.triangleBytes).c_str());
+	ImGui::LabelText("voxel cases", "%s", sizeToString(mem.voxelCaseBytes).c_str());
+	ImGui::LabelText("heap", "%s", sizeToString(mem.heapBytes()).c_str());
+	ImGui::LabelText("viewed", "%s", sizeToString(mem.viewedBytes).c_str());
+	ImGui::LabelText("GPU", "%s", sizeToString(mem.gpuBytes).c_str());
+}
+
+bool freezeProfile = false;
+ProfileFrame shownProfile;
+std::string profileStatus;
+
+auto profileColor(const char* name) -> ImU32 {
+	const auto h = std::hash<const void*>{}(name) * 0x9E3779B97F4A7C15ull;
+	return IM_COL32(96 + (h >> 16) % 144, 96 + (h >> 24) % 144, 96 + (h >> 32) % 144, 255);
+}
+
+// one row per nesting depth and thread, scaled to the width of the window
+void drawProfileTimeline(const ProfileFrame& frame) {
+	constexpr auto rowHeight = 18.0f;
+	const auto duration = static_cast<float>(std::max<uint64_t>(frame.end - frame.start, 1));
+	const auto width = ImGui::GetContentRegionAvail().x;
+	auto* drawList = ImGui::GetWindowDrawList();
+	for (const auto& t : frame.threads) {
+		uint32_t depth = 0;
+		for (const auto& e : t.events)
+			depth = std::max(depth, e.depth);
+		ImGui::Text("%s", t.name.c_str());
+		const auto origin = ImGui::GetCursorScreenPos();
+		ImGui::Dummy(ImVec2(width, (depth + 1) * rowHeight));
+
+		for (const auto& e : t.events) {
+			// scopes on other threads may have started in an earlier frame
+			const auto start = static_cast<float>(e.start > frame.start ? e.start - frame.start : 0);
+			const auto end = static_cast<float>(e.end > frame.start ? e.end - frame.start : 0);
+			const ImVec2 min{origin.x + width * start / duration, origin.y + e.depth * rowHeight};
+			const ImVec2 max{std::max(origin.x + width * end / duration, min.x + 1), min.y + rowHeight - 1};
+			drawList->AddRectFilled(min, max, profileColor(e.name));
+			if (max.x - min.x > 24) {
+				drawList->PushClipRect(min, max, true);
+				drawList->AddText(ImVec2(min.x + 2, min.y + 2), IM_COL32(0, 0, 0, 255), e.name);
+				drawList->PopClipRect();
+			}
+			if (ImGui::IsMouseHoveringRect(min, max))
+				ImGui::SetTooltip("%s\n%.3f ms", e.name, (e.end - e.start) / 1e6);
+		}
+	}
+}
+
+// time per marker over all threads, including nested markers
+void drawProfileTotals(const ProfileFrame& frame) {
+	struct Total {
+		const char* name;
+		std::size_t count;
+		uint64_t nanoseconds;
+	};
+	std::vector<Total> totals;
+	for (const auto& t : frame.threads)
+		for (const auto& e : t.events) {
+			auto it = std::find_if(totals.begin(), totals.end(), [&](const Total& total) { return total.name == e.name; });
+			if (it == totals.end())
+				it = totals.insert(totals.end(), {e.name, 0, 0});
+			it->count++;
+			it->nanoseconds += e.end - e.start;
+		}
+	std::sort(totals.begin(), totals.end(), [](const Total& a, const Total& b) { return a.nanoseconds > b.nanoseconds; });
+	for (const auto& total : totals)
+		ImGui::Text("%8.3f ms %5zux %s", total.nanoseconds / 1e6, total.count, total.name);
+}
+
+void loadDensityGraph() {
+	if (!fs::exists(global::densityGraphFile))
+		return;
+	try {
+		auto graph = DensityGraph::load(global::densityGraphFile);
+		densityGraphStatus = std::string{global::densityGraphFile} + " (" + std::to_string(graph.instructionCount()) + " instructions)";
+		ChunkCreator::setDensityGraph(std::move(graph));
+	} catch (const std::exception& e) {
+		// keep the previous graph, the file can be fixed and reloaded
+		densityGraphStatus = e.what();
+		cerr << e.what() << endl;
+	}
+}
+
 void resizeGLScene(GLFWwindow*, int width, int height) {
 	if (height <= 0)
 		height = 1;
@@ -71,6 +282,8 @@ bool initGL() {
 }
 
 void update(double interval) {
+	PROFILE_SCOPE("update");
+
 	std::stringstream caption;
 	caption << windowCaption << " @ " << fixed << setprecision(1) << 1 / interval << " FPS";
 	glfwSetWindowTitle(mainwindow, caption.str().c_str());
@@ -92,16 +305,32 @@ void update(double interval) {
 	if (glfwGetKey(mainwindow, GLFW_KEY_A) == GLFW_PRESS) moveFlags |= Left;
 	if (glfwGetKey(mainwindow, GLFW_KEY_D) == GLFW_PRESS) moveFlags |= Right;
 
-	if (global::freeCamera) {
+	const auto previousPosition = camera.position;
+	if (replayFrame) {
+		// the recorded interval, so the world sees the same camera velocity as during the recording
+		interval = cameraPath.apply((*replayFrame)++, camera);
+		player.velocity = {};
+		if (*replayFrame == cameraPath.size()) {
+			replayFrame.reset();
+			cameraPathStatus = "replay finished";
+		}
+	} else if (global::freeCamera) {
 		camera.update(interval, delta.x, delta.y, moveFlags);
 		player.velocity = {};
 	} else
 		player.update(interval, delta.x, delta.y, moveFlags, world, camera);
+	if (recordingPath)
+		cameraPath.record(interval, camera);
 
-	world.update(camera);
+	physics.update(interval, world);
+
+	// the camera velocity covers the free camera as well as the player
+	world.update(camera, interval > 0 ? (camera.position - previousPosition) / static_cast<float>(interval) : glm::vec3{});
 }
 
 void render() {
+	PROFILE_SCOPE("render");
+
 	if (global::showHud) {
 		ImGui_ImplOpenGL3_NewFrame();
 		ImGui_ImplGlfw_NewFrame();
@@ -127,6 +356,7 @@ void render() {
 	glUniformMatrix4fv(shaderProgram.uniformLocation("uNormalMatrix"), 1, GL_FALSE, glm::value_ptr(normalMatrix));
 
 	// render the world
+	world.cull(camera, viewProjectionMatrix);
 	world.render();
 
 	// render coordinate system
@@ -148,6 +378,7 @@ void render() {
 	glMatrixMode(GL_MODELVIEW);
 	glLoadMatrixf(glm::value_ptr(viewMatrix));
 	world.renderAuxiliary();
+	physics.render();
 
 	// hud
 	if (global::showHud) {
@@ -159,10 +390,29 @@ void render() {
 		ImGui::Checkbox("show chunks", &global::showChunks);
 		ImGui::Checkbox("show voxels", &global::showVoxels);
 		ImGui::SliderInt("chunk radius", &global::CAMERA_CHUNK_RADIUS, 1, 10);
+		ImGui::Checkbox("occlusion culling", &global::occlusionCulling);
+		{
+			const auto& stats = world.cullStats();
+			ImGui::Text("chunks in radius %zu, in frustum %zu, drawn %zu", stats.inRadius, stats.inFrustum, stats.drawn);
+		}
 		ImGui::SliderInt("octaves", &global::noise::octaves, 1, 10);
 
 		if (ImGui::Button("regenerate"))
 			world.clearChunks();
+		ImGui::SameLine();
+		if (ImGui::Button("reload density graph")) {
+			loadDensityGraph();
+			world.clearChunks();
+		}
+		ImGui::Text("density graph: %s", densityGraphStatus.c_str());
+		ImGui::Checkbox("density bounds", &global::densityBounds);
+		{
+			auto mesher = static_cast<int>(world.mesher());
+			ImGui::RadioButton("marching cubes", &mesher, static_cast<int>(Mesher::MARCHING_CUBES));
+			ImGui::SameLine();
+			ImGui::RadioButton("surface nets", &mesher, static_cast<int>(Mesher::SURFACE_NETS));
+			world.setMesher(static_cast<Mesher>(mesher));
+		}
 
 		ImGui::Checkbox("free camera", &global::freeCamera);
 
@@ -174,6 +424,223 @@ void render() {
 			ImGui::End();
 		}
 
+		{
+			ImGui::Begin("Physics");
+			ImGui::LabelText("bodies", "%zu", physics.size());
+			if (ImGui::Button("spawn 100")) {
+				for (int i = 0; i < 100; i++) {
+					const auto offset = glm::vec3{i % 10 - 4.5f, i / 10 - 4.5f, 5.0f};
+					physics.spawn(camera.position + offset, camera.viewVector() * 5.0f);
+				}
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("clear"))
+				physics.clear();
+			ImGui::End();
+		}
+
+		{
+			const auto& stats = world.editStats();
+			ImGui::Begin("Brush");
+			ImGui::RadioButton("add", reinterpret_cast<int*>(&brush.mode), static_cast<int>(BrushMode::ADD));
+			ImGui::SameLine();
+			ImGui::RadioButton("subtract", reinterpret_cast<int*>(&brush.mode), static_cast<int>(BrushMode::SUBTRACT));
+			ImGui::SameLine();
+			ImGui::RadioButton("smooth", reinterpret_cast<int*>(&brush.mode), static_cast<int>(BrushMode::SMOOTH));
+			ImGui::RadioButton("sphere", reinterpret_cast<int*>(&brush.shape), static_cast<int>(BrushShape::SPHERE));
+			ImGui::SameLine();
+			ImGui::RadioButton("box", reinterpret_cast<int*>(&brush.shape), static_cast<int>(BrushShape::BOX));
+			ImGui::SliderFloat("radius", &brush.radius, 0.5f, 16.0f);
+			ImGui::SliderFloat("strength", &brush.strength, 0.1f, 5.0f);
+			ImGui::LabelText("edits", "%zu", stats.edits);
+			ImGui::LabelText("remeshes", "%zu", stats.remeshes);
+			ImGui::LabelText("latency last", "%.2f ms", stats.lastLatency * 1000);
+			ImGui::LabelText("latency avg", "%.2f ms", stats.averageLatency * 1000);
+			ImGui::LabelText("latency max", "%.2f ms", stats.maxLatency * 1000);
+			ImGui::End();
+		}
+
+		{
+			const auto stats = world.persistenceStats();
+			ImGui::Begin("Chunk cache");
+			ImGui::Checkbox("enable", &global::enableChunkCache);
+			ImGui::Checkbox("memory map files", &global::mapChunkFiles);
+			ImGui::Checkbox("load densities lazily", &global::lazyDensities);
+			ImGui::LabelText("full chunks stored", "%zu (%s)", stats.fullChunksStored, sizeToString(stats.fullBytesStored).c_str());
+			ImGui::LabelText("delta chunks stored", "%zu (%s instead of %s)", stats.deltaChunksStored, sizeToString(stats.deltaBytesStored).c_str(), sizeToString(stats.deltaBytesAsFull).c_str());
+			ImGui::LabelText("deduplicated chunks", "%zu (%s not written)", stats.dedupedChunks, sizeToString(stats.dedupedBytes).c_str());
+			ImGui::LabelText("unchanged chunks", "%zu", stats.unchangedChunks);
+			if (stats.fullChunksLoaded > 0)
+				ImGui::LabelText("full chunk load", "%.3f ms", stats.fullLoadSeconds * 1000 / stats.fullChunksLoaded);
+			if (stats.deltaChunksLoaded > 0)
+				ImGui::LabelText("delta chunk load", "%.3f ms", stats.deltaLoadSeconds * 1000 / stats.deltaChunksLoaded);
+			ImGui::LabelText("lazy density loads", "%zu (%s)", stats.densityLoads, sizeToString(stats.densityBytesLoaded).c_str());
+			ImGui::LabelText("shared payload loads", "%zu", stats.sharedLoads);
+
+			const auto io = world.ioStats();
+			ImGui::LabelText("I/O backend", "%s", world.ioBackend());
+			ImGui::LabelText("queue depth", "%zu (max %zu)", io.queueDepth, io.maxQueueDepth);
+			if (io.reads > 0)
+				ImGui::LabelText("read latency", "%.3f ms", io.readSeconds * 1000 / io.reads);
+			if (io.writes > 0)
+				ImGui::LabelText("write latency", "%.3f ms", io.writeSeconds * 1000 / io.writes);
+			ImGui::LabelText("throughput", "%s/s read, %s/s written", sizeToString(static_cast<size_t>(io.bytesRead / io.seconds)).c_str(),
+							 sizeToString(static_cast<size_t>(io.bytesWritten / io.seconds)).c_str());
+			ImGui::End();
+		}
+
+		{
+			const auto stats = world.generationStats();
+			const auto samples = stats.samplesEvaluated + stats.samplesSkipped + stats.samplesReused;
+			ImGui::Begin("Generation");
+			for (const auto format : {DensityFormat::FLOAT, DensityFormat::HALF, DensityFormat::INT16, DensityFormat::INT8}) {
+				if (format != DensityFormat::FLOAT)
+					ImGui::SameLine();
+				if (ImGui::RadioButton(formatName(format), &global::densityFormat, static_cast<int>(format)))
+					world.clearChunks();
+			}
+			ImGui::LabelText("chunks", "%zu", stats.chunks);
+			ImGui::LabelText("chunks skipped", "%zu", stats.chunksSkipped);
+			ImGui::LabelText("samples evaluated", "%zu", stats.samplesEvaluated);
+			ImGui::LabelText("samples skipped", "%zu (%.1f%%)", stats.samplesSkipped, samples > 0 ? 100.0 * stats.samplesSkipped / samples : 0.0);
+			ImGui::LabelText("samples reused", "%zu (%.1f%%)", stats.samplesReused, samples > 0 ? 100.0 * stats.samplesReused / samples : 0.0);
+			ImGui::End();
+		}
+
+		{
+			const auto stats = world.compressedCacheStats();
+			ImGui::Begin("Compressed chunks");
+			ImGui::Checkbox("enable", &global::compressChunks);
+			ImGui::SliderInt("budget (MiB)", &global::compressedCacheMiB, 0, 4096);
+			ImGui::LabelText("loaded chunks", "%zu", world.loadedChunkCount());
+			ImGui::LabelText("compressed chunks", "%zu", stats.chunks);
+			ImGui::LabelText("size", "%s of %s", sizeToString(stats.bytes).c_str(), sizeToString(stats.uncompressedBytes).c_str());
+			ImGui::LabelText("hits", "%zu of %zu inserted, %zu dropped", stats.hits, stats.inserted, stats.evicted);
+			if (stats.inserted > 0)
+				ImGui::LabelText("compress", "%.3f ms", stats.compressSeconds * 1000 / stats.inserted);
+			if (stats.hits > 0)
+				ImGui::LabelText("decompress", "%.3f ms", stats.decompressSeconds * 1000 / stats.hits);
+			ImGui::End();
+		}
+
+		{
+			const auto stats = world.prefetchStats();
+			ImGui::Begin("Prefetch");
+			ImGui::Checkbox("enable", &global::prefetchChunks);
+			ImGui::LabelText("requested", "%zu (%zu in flight)", stats.requested, stats.inFlight);
+			ImGui::LabelText("hit rate", "%zu of %zu (%.1f%%)", stats.hits, stats.entered, stats.entered > 0 ? 100.0 * stats.hits / stats.entered : 0.0);
+			ImGui::LabelText("time to visible avg", "%.2f ms", stats.averageTimeToVisible * 1000);
+			ImGui::LabelText("time to visible max", "%.2f ms", stats.maxTimeToVisible * 1000);
+			ImGui::End();
+		}
+
+		{
+			ImGui::Begin("Export");
+			ImGui::SliderInt("radius (chunks)", &exportRadius, 0, 64);
+			finishExport();
+			if (exportResult.valid()) {
+				const std::size_t total = exportTotal;
+				ImGui::ProgressBar(total > 0 ? static_cast<float>(exportWritten) / total : 0.0f);
+				ImGui::Text("exporting %s", exportStatus.c_str());
+			} else {
+				if (ImGui::Button("export PLY"))
+					exportMeshes("export.ply");
+				ImGui::SameLine();
+				if (ImGui::Button("export OBJ"))
+					exportMeshes("export.obj");
+				ImGui::Text("%s", exportStatus.c_str());
+			}
+			ImGui::End();
+		}
+
+		{
+			if (ImGui::Begin("Metrics")) { // collapsed otherwise, the gauges are only set while shown
+				ImGui::Checkbox("write periodically", &global::writeMetrics);
+				ImGui::SliderInt("interval (s)", &global::metricsInterval, 1, 60);
+				ImGui::Text("%s", metricsStatus.c_str());
+				ImGui::Separator();
+				world.updateMetrics();
+				drawMetrics();
+			}
+			ImGui::End();
+		}
+
+		{
+			ImGui::Begin("Memory");
+			drawMemory();
+			ImGui::End();
+		}
+
+		{
+			ImGui::Begin("Camera path");
+			if (ImGui::Button(recordingPath ? "stop recording" : "record")) {
+				if (recordingPath)
+					stopRecording();
+				else {
+					cameraPath.clear();
+					cameraPath.chunkRadius = global::CAMERA_CHUNK_RADIUS;
+					replayFrame.reset();
+					recordingPath = true;
+				}
+			}
+			ImGui::SameLine();
+			if (ImGui::Button(replayFrame ? "stop replay" : "replay")) {
+				if (replayFrame) {
+					replayFrame.reset();
+					cameraPathStatus = "replay stopped";
+				} else
+					startReplay();
+			}
+			if (recordingPath)
+				ImGui::LabelText("recorded", "%zu frames", cameraPath.size());
+			if (replayFrame)
+				ImGui::LabelText("replayed", "%zu of %zu frames", *replayFrame, cameraPath.size());
+			ImGui::Text("%s", cameraPathStatus.c_str());
+			ImGui::End();
+		}
+
+		{
+			ImGui::Begin("Profiler");
+#if DPG_PROFILING
+			auto enabled = Profiler::enabled();
+			if (ImGui::Checkbox("enable", &enabled))
+				Profiler::setEnabled(enabled);
+			ImGui::SameLine();
+			ImGui::Checkbox("freeze", &freezeProfile);
+			if (!freezeProfile)
+				shownProfile = Profiler::lastFrame();
+
+			if (ImGui::Button(Profiler::capturing() ? "stop capture" : "start capture")) {
+				if (Profiler::capturing())
+					Profiler::stopCapture();
+				else
+					Profiler::startCapture();
+			}
+			ImGui::SameLine();
+			if (ImGui::Button("write trace")) {
+				Profiler::stopCapture();
+				try {
+					Profiler::writeChromeTrace("profile.json");
+					profileStatus = "profile.json: " + std::to_string(Profiler::capturedFrames()) + " frames";
+				} catch (const std::exception& e) {
+					profileStatus = e.what();
+					cerr << e.what() << endl;
+				}
+			}
+			ImGui::LabelText("captured frames", "%zu", Profiler::capturedFrames());
+			ImGui::LabelText("dropped events", "%zu", Profiler::droppedEvents());
+			ImGui::Text("%s", profileStatus.c_str());
+			ImGui::Separator();
+			ImGui::LabelText("frame", "%.3f ms", (shownProfile.end - shownProfile.start) / 1e6);
+			drawProfileTimeline(shownProfile);
+			ImGui::Separator();
+			drawProfileTotals(shownProfile);
+#else
+			ImGui::Text("profiling markers are compiled out (DPG_PROFILING=0)");
+#endif
+			ImGui::End();
+		}
+
 		{
 			const auto voxelPos = world.getVoxelPos(camera.position);
 			const auto cat = world.categorizeWorldPosition(camera.position);
@@ -199,6 +666,15 @@ void onMouseButton(GLFWwindow*, int button, int action, int modifiers) {
 				glfwGetCursorPos(mainwindow, &mouseDownPos.x, &mouseDownPos.y);
 				glfwSetInputMode(mainwindow, GLFW_CURSOR, GLFW_CURSOR_HIDDEN);
 				break;
+			case GLFW_MOUSE_BUTTON_LEFT:
+				if (global::showHud && ImGui::GetIO().WantCaptureMouse)
+					break;
+				// edit the terrain where we look at
+				if (const auto result = world.trace(camera.position, camera.position + camera.viewVector() * 100.0f); result.collision) {
+					brush.center = result.end;
+					world.edit(brush);
+				}
+				break;
 		}
 	}
 
@@ -285,6 +761,11 @@ void destroySDLWindow() {
 }
 
 int main(int argc, char** argv) try {
+	if (argc > 1 && argv[1] == std::string{"--bench"})
+		return runBenchmark({argv + 2, argv + argc});
+
+	loadDensityGraph();
+
 	if (!createSDLWindow(initialWindowWidth, initialWindowHeight))
 		return -1;
 
@@ -297,6 +778,7 @@ int main(int argc, char** argv) try {
 	camera.position.x += 0.5f;
 	camera.position.y += 0.5f;
 
+	Profiler::setThreadName("main");
 	auto lastTime = std::chrono::high_resolution_clock::now();
 	while (true) {
 		glfwPollEvents();
@@ -308,9 +790,17 @@ int main(int argc, char** argv) try {
 		update(std::chrono::duration_cast<std::chrono::duration<double>>(now - lastTime).count());
 		lastTime = now;
 		render();
-		glfwSwapBuffers(mainwindow);
+		{
+			PROFILE_SCOPE("swap");
+			glfwSwapBuffers(mainwindow);
+		}
+		Profiler::endFrame();
+		writeMetricsPeriodically();
 	}
 
+	// the export reads chunks of the world
+	if (exportResult.valid())
+		exportResult.wait();
 	destroySDLWindow();
 
 	return 0;
@@ -2,6 +2,8 @@
 
 #include <algorithm>
 
+#include "../MemoryTracker.h"
+
 namespace gl {
 	Buffer::Buffer() {
 		glGenBuffers(1, &m_id);
@@ -17,6 +19,7 @@ namespace gl {
 	}
 
 	Buffer::~Buffer() {
+		MemoryTracker::released(MemoryTag::GPU_BUFFERS, m_size);
 		glDeleteBuffers(1, &m_id);
 	}
 
@@ -28,8 +31,21 @@ namespace gl {
 		glBindBuffer(target, m_id);
 	}
 
+	void Buffer::setData(GLenum target, std::size_t size, const void* data, GLenum usage) {
+		bind(target);
+		glBufferData(target, static_cast<GLsizeiptr>(size), data, usage);
+		MemoryTracker::released(MemoryTag::GPU_BUFFERS, m_size);
+		MemoryTracker::allocated(MemoryTag::GPU_BUFFERS, size);
+		m_size = size;
+	}
+
+	auto Buffer::size() const -> std::size_t {
+		return m_size;
+	}
+
 	void Buffer::swap(Buffer& other) {
 		using std::swap;
 		swap(m_id, other.m_id);
+		swap(m_size, other.m_size);
 	}
 }
\ No newline at end of file
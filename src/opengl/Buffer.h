@@ -2,6 +2,8 @@
 
 #include <GL/glew.h>
 
+#include <cstddef>
+
 namespace gl {
 	class Buffer {
 	public:
@@ -15,9 +17,16 @@ namespace gl {
 		auto id() const -> GLuint;
 		void bind(GLenum target);
 
+		/**
+		* Binds the buffer and uploads size bytes, which are counted as MemoryTag::GPU_BUFFERS until replaced or deleted.
+		*/
+		void setData(GLenum target, std::size_t size, const void* data, GLenum usage);
+		auto size() const -> std::size_t;
+
 	private:
 		void swap(Buffer& other);
 
 		GLuint m_id = 0;
+		std::size_t m_size = 0;
 	};
 }
\ No newline at end of file
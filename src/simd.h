@@ -0,0 +1,49 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define DPG_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace simd {
+	inline constexpr std::size_t lanes = 4;
+
+#ifdef DPG_SSE2
+	/**
+	* Four floats processed together. Pointers passed to load and store must be 16 byte aligned.
+	*/
+	struct Float4 {
+		__m128 v;
+
+		static auto load(const float* p) -> Float4 { return {_mm_load_ps(p)}; }
+		static auto broadcast(float f) -> Float4 { return {_mm_set1_ps(f)}; }
+		void store(float* p) const { _mm_store_ps(p, v); }
+	};
+
+	inline auto operator+(Float4 a, Float4 b) -> Float4 { return {_mm_add_ps(a.v, b.v)}; }
+	inline auto operator-(Float4 a, Float4 b) -> Float4 { return {_mm_sub_ps(a.v, b.v)}; }
+	inline auto operator*(Float4 a, Float4 b) -> Float4 { return {_mm_mul_ps(a.v, b.v)}; }
+#else
+	struct Float4 {
+		std::array<float, lanes> v;
+
+		static auto load(const float* p) -> Float4 { return {{p[0], p[1], p[2], p[3]}}; }
+		static auto broadcast(float f) -> Float4 { return {{f, f, f, f}}; }
+		void store(float* p) const {
+			for (std::size_t i = 0; i < lanes; i++)
+				p[i] = v[i];
+		}
+	};
+
+	inline auto operator+(Float4 a, Float4 b) -> Float4 { return {{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]}}; }
+	inline auto operator-(Float4 a, Float4 b) -> Float4 { return {{a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]}}; }
+	inline auto operator*(Float4 a, Float4 b) -> Float4 { return {{a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]}}; }
+#endif
+
+	inline auto lerp(Float4 a, Float4 b, Float4 t) -> Float4 {
+		return a + (b - a) * t;
+	}
+}
@@ -1,13 +1,136 @@
+#include <atomic>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
 #include <iterator>
+#include <memory>
+#include <mutex>
 #include <sstream>
+#include <thread>
 
+#include "Profiler.h"
 #include "utils.h"
 
 using namespace std;
 
+namespace {
+	/**
+	* The jobs of one parallelBlocks call, taken one after another by the pool threads and the calling thread.
+	*/
+	struct Batch {
+		const function<void(size_t)>* job;
+		size_t count;
+		atomic<size_t> next{0};
+
+		mutex doneMutex;
+		condition_variable done;
+		size_t finished = 0;
+		exception_ptr error;
+
+		// runs the next job not taken yet, returns false if there is none
+		auto runNext() -> bool {
+			const auto i = next.fetch_add(1);
+			if (i >= count)
+				return false;
+			exception_ptr e;
+			try {
+				(*job)(i);
+			} catch (...) {
+				e = current_exception();
+			}
+			lock_guard lock{doneMutex};
+			if (e && !error)
+				error = e;
+			if (++finished == count)
+				done.notify_all();
+			return true;
+		}
+	};
+
+	/**
+	* Threads started on the first parallelFor, so a call does not pay for starting threads.
+	*/
+	class WorkerPool {
+	public:
+		WorkerPool() {
+			for (unsigned i = 1; i < max(1u, thread::hardware_concurrency()); i++)
+				m_workers.emplace_back(&WorkerPool::workerLoop, this);
+		}
+
+		~WorkerPool() {
+			{
+				lock_guard lock{m_mutex};
+				m_stop = true;
+			}
+			m_batchAvailable.notify_all();
+			for (auto& t : m_workers)
+				t.join();
+		}
+
+		auto threads() const -> size_t {
+			return m_workers.size() + 1;
+		}
+
+		void run(size_t count, const function<void(size_t)>& job) {
+			auto batch = make_shared<Batch>();
+			batch->job = &job;
+			batch->count = count;
+			{
+				lock_guard lock{m_mutex};
+				m_batches.push_back(batch);
+			}
+			m_batchAvailable.notify_all();
+
+			// the calling thread takes jobs as well, so it only waits for jobs already running, even when called from a job
+			while (batch->runNext()) {}
+			drop(batch);
+			unique_lock lock{batch->doneMutex};
+			batch->done.wait(lock, [&] { return batch->finished == batch->count; });
+			if (batch->error)
+				rethrow_exception(batch->error);
+		}
+
+	private:
+		void drop(const shared_ptr<Batch>& batch) {
+			lock_guard lock{m_mutex};
+			if (const auto it = find(m_batches.begin(), m_batches.end(), batch); it != m_batches.end())
+				m_batches.erase(it);
+		}
+
+		void workerLoop() {
+			Profiler::setThreadName("parallelFor");
+			for (;;) {
+				shared_ptr<Batch> batch;
+				{
+					unique_lock lock{m_mutex};
+					m_batchAvailable.wait(lock, [&] { return m_stop || !m_batches.empty(); });
+					if (m_stop)
+						return;
+					batch = m_batches.front();
+				}
+				// the job pointer is not used once all jobs are taken, so the batch may outlive its call
+				while (batch->runNext()) {}
+				drop(batch);
+			}
+		}
+
+		mutex m_mutex; // guards m_batches and m_stop
+		condition_variable m_batchAvailable;
+		deque<shared_ptr<Batch>> m_batches;
+		bool m_stop = false;
+		vector<thread> m_workers;
+	};
+
+	auto workerPool() -> WorkerPool& {
+		static WorkerPool pool;
+		return pool;
+	}
+}
+
 string sizeToString(size_t size) {
 	stringstream ss;
 
@@ -39,4 +162,43 @@ bool readFile(const std::string& fileName, string& buffer) {
 	sourceFile.close();
 
 	return true;
-}
\ No newline at end of file
+}
+
+uint64_t hashBytes(const void* data, size_t size) {
+	constexpr uint64_t k0 = 0x9E3779B97F4A7C15ull;
+	constexpr uint64_t k1 = 0xC2B2AE3D27D4EB4Full;
+	const auto mix = [&](uint64_t h, uint64_t word) {
+		h ^= word * k1;
+		return ((h << 31) | (h >> 33)) * k0;
+	};
+
+	const auto* bytes = static_cast<const uint8_t*>(data);
+	uint64_t h = k0 ^ size;
+	size_t i = 0;
+	for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+		uint64_t word;
+		memcpy(&word, bytes + i, sizeof(word));
+		h = mix(h, word);
+	}
+	if (i < size) {
+		uint64_t word = 0;
+		memcpy(&word, bytes + i, size - i);
+		h = mix(h, word);
+	}
+
+	// final avalanche of MurmurHash3
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDull;
+	h ^= h >> 33;
+	h *= 0xC4CEB9FE1A85EC53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+auto parallelThreads() -> size_t {
+	return workerPool().threads();
+}
+
+void parallelBlocks(size_t count, const function<void(size_t)>& job) {
+	workerPool().run(count, job);
+}
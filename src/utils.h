@@ -1,8 +1,12 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <functional>
 #include <iomanip>
 #include <sstream>
 #include <string>
+#include <vector>
 
 std::string sizeToString(size_t size);
 
@@ -10,9 +14,43 @@ int roundToInt(float f);
 
 bool readFile(const std::string& fileName, std::string& buffer);
 
+/**
+* A fast 64 bit hash of the bytes, not suited against deliberate collisions.
+*/
+uint64_t hashBytes(const void* data, std::size_t size);
+
 template<typename T>
 std::string toHexString(T val) {
 	std::stringstream ss;
 	ss << std::hex << val;
 	return ss.str();
-}
\ No newline at end of file
+}
+
+/**
+* The number of threads parallelFor splits work for, the calling thread and those of a pool kept for the lifetime of the program.
+*/
+auto parallelThreads() -> std::size_t;
+
+/**
+* Calls job(i) for every i in [0, count) on the pool of parallelFor and the calling thread, and waits for them.
+* Rethrows the first exception of a job once all are done.
+*/
+void parallelBlocks(std::size_t count, const std::function<void(std::size_t)>& job);
+
+/**
+* Calls f(begin, end) on disjoint subranges of [0, count) on all hardware threads and waits for them.
+*/
+template<typename F>
+void parallelFor(std::size_t count, F f) {
+	const std::size_t threads = parallelThreads();
+	const std::size_t blockSize = (count + threads - 1) / threads;
+	if (threads == 1 || count < 2) {
+		f(std::size_t{0}, count);
+		return;
+	}
+
+	parallelBlocks((count + blockSize - 1) / blockSize, [&](std::size_t block) {
+		const auto begin = block * blockSize;
+		f(begin, std::min(begin + blockSize, count));
+	});
+}